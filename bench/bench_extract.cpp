@@ -0,0 +1,173 @@
+// Benchmark of field extraction from lines: the original DOM parse, a
+// generic SAX handler comparing a runtime path stack against the paths, and
+// the compile time path matcher (extract_tweet) driven by the SAX parser and
+// by the structural index, and the key scan
+// Usage: bench_extract twitter.json
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/rapidjson/document.h"
+#include "../options.hpp"
+#include "../tweet.hpp"
+
+using std::string;
+using std::vector;
+
+// Number of passes over the lines per run
+static const size_t N_PASSES = 5;
+
+// Paths of the fields, as the generic handler sees them
+static const vector<string> PATHS = {"doc.lang", "doc.text",
+									 "doc.entities.hashtags[].text"};
+
+/**
+ * SAX handler keeping the path to the current value as a stack of strings,
+ * and comparing the whole path against every path at each string.
+ */
+struct GenericHandler
+	: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, GenericHandler> {
+	vector<string> path;
+	vector<bool> in_array;
+	string key;
+	size_t n_fields = 0;
+
+	bool StartObject() {
+		enter(false);
+		return true;
+	}
+	bool StartArray() {
+		enter(true);
+		return true;
+	}
+	bool EndObject(rapidjson::SizeType) {
+		leave();
+		return true;
+	}
+	bool EndArray(rapidjson::SizeType) {
+		leave();
+		return true;
+	}
+	bool Key(const char* str, rapidjson::SizeType length, bool) {
+		key.assign(str, length);
+		return true;
+	}
+	bool String(const char*, rapidjson::SizeType, bool) {
+		string p = current();
+		for (const string& q : PATHS) {
+			if (p == q) {
+				n_fields++;
+			}
+		}
+		return true;
+	}
+	bool Default() {
+		return true;
+	}
+
+	string current() {
+		string p;
+		for (const string& s : path) {
+			p += s;
+		}
+		return in_array.empty() || in_array.back() ? p : p + key;
+	}
+	void enter(bool array) {
+		if (!in_array.empty()) {
+			path.push_back(in_array.back() ? (array ? "" : ".")
+										   : key + (array ? "[]" : "."));
+		}
+		in_array.push_back(array);
+	}
+	void leave() {
+		in_array.pop_back();
+		if (!path.empty()) {
+			path.pop_back();
+		}
+	}
+};
+
+/**
+ * Times f over N_PASSES passes and prints ns per line and MB/s.
+ * @param name name of the benchmark
+ * @param lines lines
+ * @param bytes total bytes in lines
+ * @param f function extracting the fields of a line (a mutable copy),
+ * returning the number of fields found
+ */
+template <typename F>
+void run(const string& name, const vector<string>& lines, size_t bytes, F f) {
+	size_t n_fields = 0;
+	string buf;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t pass = 0; pass < N_PASSES; pass++) {
+		for (const string& line : lines) {
+			buf.assign(line);
+			n_fields += f(buf);
+		}
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+	std::cout << "\t" << name << ": "
+			  << elapsed.count() * 1e9 / (N_PASSES * lines.size())
+			  << " ns/line, " << N_PASSES * bytes / elapsed.count() / 1e6
+			  << " MB/s (" << n_fields / N_PASSES << " fields)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: bench_extract twitter.json" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	// Read the lines of tweets (as threading.cpp trims them)
+	std::ifstream is(argv[1]);
+	vector<string> lines;
+	size_t bytes = 0;
+	string line;
+	while (getline(is, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty() || line.back() != ',') {
+			continue;
+		}
+		line.pop_back();
+		bytes += line.length();
+		lines.push_back(line);
+	}
+	std::cout << lines.size() << " lines" << std::endl;
+
+	run("DOM", lines, bytes, [](string& l) {
+		rapidjson::Document d;
+		d.Parse(l.c_str());
+		const rapidjson::Value& doc = d["doc"];
+		return (size_t)2 + doc["entities"]["hashtags"].Size();
+	});
+	run("generic SAX", lines, bytes, [](string& l) {
+		GenericHandler handler;
+		rapidjson::Reader reader;
+		rapidjson::InsituStringStream ss(&l[0]);
+		reader.Parse<rapidjson::kParseInsituFlag>(ss, handler);
+		return handler.n_fields;
+	});
+	Tweet tweet;
+	options.extractor = Extractor::SAX;
+	run("path matcher (SAX)", lines, bytes, [&tweet](string& l) {
+		extract_tweet(&l[0], l.length(), tweet);
+		return (size_t)2 + tweet.hashtags.size();
+	});
+	options.extractor = Extractor::INDEX;
+	run("path matcher (structural index)", lines, bytes, [&tweet](string& l) {
+		extract_tweet(&l[0], l.length(), tweet);
+		return (size_t)2 + tweet.hashtags.size();
+	});
+	options.extractor = Extractor::SCAN;
+	run("key scan", lines, bytes, [&tweet](string& l) {
+		extract_tweet(&l[0], l.length(), tweet);
+		return (size_t)2 + tweet.hashtags.size();
+	});
+	return 0;
+}
@@ -0,0 +1,103 @@
+// Benchmark of hashtag counting: std::unordered_map (the original way),
+// FreqTable::increment and FreqTable::increment_batch
+// Usage: bench_freq_table [distinct keys...] (default: 10K, 1M and 10M)
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../freq_table.hpp"
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Number of increments timed per run (independent of the number of keys)
+static const size_t N_INCREMENTS = 10 * 1000 * 1000;
+
+// Same as HASHTAG_BATCH_SIZE in threading.cpp
+static const size_t BATCH_SIZE = 256;
+
+/**
+ * Times f and prints ns per increment.
+ * @param name name of the benchmark
+ * @param f function performing N_INCREMENTS increments
+ */
+template <typename F> void run(const string& name, F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	std::chrono::duration<double, std::nano> elapsed =
+		std::chrono::steady_clock::now() - start;
+	std::cout << "\t" << name << ": " << elapsed.count() / N_INCREMENTS
+			  << " ns/increment" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	vector<size_t> cardinalities;
+	for (int i = 1; i < argc; i++) {
+		cardinalities.push_back(std::strtoul(argv[i], nullptr, 10));
+	}
+	if (cardinalities.empty()) {
+		cardinalities = {10 * 1000, 1000 * 1000, 10 * 1000 * 1000};
+	}
+
+	for (size_t n_keys : cardinalities) {
+		std::cout << "[*] " << n_keys << " distinct keys" << std::endl;
+
+		// Keys are first inserted in order, then incremented in random order
+		// (stream is laid out sequentially, so that only the table misses)
+		vector<string> keys, stream;
+		for (size_t i = 0; i < n_keys; i++) {
+			keys.push_back("#hashtag" + std::to_string(i));
+		}
+		std::mt19937_64 rng(42);
+		for (size_t i = 0; i < N_INCREMENTS; i++) {
+			stream.push_back(keys[rng() % n_keys]);
+		}
+
+		{
+			unordered_map<string, unsigned long> map;
+			for (const string& k : keys) {
+				map[k] = 1;
+			}
+			run("unordered_map", [&]() {
+				for (const string& k : stream) {
+					map[k] += 1;
+				}
+			});
+		}
+		{
+			FreqTable table;
+			for (const string& k : keys) {
+				table.increment(k);
+			}
+			run("FreqTable::increment", [&]() {
+				for (const string& k : stream) {
+					table.increment(k);
+				}
+			});
+		}
+		{
+			FreqTable table;
+			for (const string& k : keys) {
+				table.increment(k);
+			}
+			KeyBatch batch;
+			run("FreqTable::increment_batch", [&]() {
+				for (const string& k : stream) {
+					batch.add(k.data(), k.length());
+					if (batch.size() >= BATCH_SIZE) {
+						table.increment_batch(batch);
+						batch.clear();
+					}
+				}
+				table.increment_batch(batch);
+				batch.clear();
+			});
+		}
+	}
+	return 0;
+}
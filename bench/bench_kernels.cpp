@@ -0,0 +1,502 @@
+// Microbenchmark suite of the hot kernels, each measured in isolation on the
+// lines of a (generated) corpus: process_line end to end, parsing alone,
+// finding the hashtag of a text, lowercasing hashtags, counting keys at
+// several cardinalities, the thread merge and the serialisation of maps sent
+// between processes. Every kernel is run --repeat times (after a warm up
+// run), and the median, min and max are printed
+// Usage: bench_kernels [--repeat=n] [--lines=n] twitter.json [kernel...]
+// (kernels: line, parse, hashtag, lower, increment, merge, serialize)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../combine.hpp"
+#include "../freq_table.hpp"
+#include "../include/rapidjson/document.h"
+#include "../key_hash.hpp"
+#include "../line.hpp"
+#include "../options.hpp"
+#include "../tweet.hpp"
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Same as HASHTAG_BATCH_SIZE in threading.cpp
+static const size_t BATCH_SIZE = 256;
+
+// Number of increments per run of the increment kernels
+static const size_t N_INCREMENTS = 1000 * 1000;
+
+// Number of keys of the tables merged and the maps serialised
+static const size_t N_MERGE_KEYS = 100 * 1000;
+
+// Runs per kernel (after a warm up run)
+static size_t repeat = 10;
+
+// Checksums of the runs (so that no work is optimised away)
+static volatile uint64_t sink;
+
+/**
+ * Lines of the corpus, and the fields extracted from them.
+ */
+struct Corpus {
+	vector<string> lines;
+	size_t line_bytes = 0;
+	vector<string> texts;
+	size_t text_bytes = 0;
+	vector<string> hashtags; // entity hashtags, prefixed with "#"
+	size_t hashtag_bytes = 0;
+};
+
+// Function prototypes
+static Corpus read_corpus(const char* filename, size_t max_lines);
+static void bench_line(const Corpus& corpus);
+static void bench_parse(const Corpus& corpus);
+static void bench_hashtag(const Corpus& corpus);
+static void bench_lower(const Corpus& corpus);
+static void bench_increment();
+static void bench_merge();
+static void bench_serialize();
+
+/**
+ * Times f repeat times (after a warm up run) and prints the median, min and
+ * max ns per operation, and the bytes per second of the median run.
+ * @param name name of the kernel
+ * @param ops operations per run
+ * @param bytes bytes processed per run (0 if not meaningful)
+ * @param f function performing one run, returning a checksum
+ */
+template <typename F>
+void run(const string& name, size_t ops, size_t bytes, F f) {
+	sink = sink + f();
+	vector<double> ns;
+	for (size_t r = 0; r < repeat; r++) {
+		auto start = std::chrono::steady_clock::now();
+		sink = sink + f();
+		std::chrono::duration<double, std::nano> elapsed =
+			std::chrono::steady_clock::now() - start;
+		ns.push_back(elapsed.count() / ops);
+	}
+	std::sort(ns.begin(), ns.end());
+	double median = (ns[(repeat - 1) / 2] + ns[repeat / 2]) / 2;
+	std::cout << "\t" << std::left << std::setw(36) << name << std::right
+			  << std::fixed << std::setprecision(1) << std::setw(10) << median
+			  << " ns/op (min " << ns.front() << ", max " << ns.back() << ")";
+	if (bytes) {
+		std::cout << ", " << bytes / (median * ops) * 1e3 << " MB/s";
+	}
+	std::cout << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char** argv) {
+	size_t max_lines = 50000;
+	const char* filename = nullptr;
+	vector<string> kernels;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--repeat=", 9) == 0) {
+			repeat = std::max(1UL, strtoul(argv[i] + 9, nullptr, 10));
+		} else if (strncmp(argv[i], "--lines=", 8) == 0) {
+			max_lines = strtoul(argv[i] + 8, nullptr, 10);
+		} else if (!filename) {
+			filename = argv[i];
+		} else {
+			kernels.push_back(argv[i]);
+		}
+	}
+	if (!filename) {
+		std::cerr << "Usage: bench_kernels [--repeat=n] [--lines=n] "
+				  << "twitter.json [kernel...]" << std::endl
+				  << "(kernels: line, parse, hashtag, lower, increment, "
+				  << "merge, serialize)" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	auto selected = [&kernels](const string& kernel) {
+		return kernels.empty() || std::find(kernels.begin(), kernels.end(),
+											kernel) != kernels.end();
+	};
+
+	Corpus corpus = read_corpus(filename, max_lines);
+	std::cout << corpus.lines.size() << " lines, " << corpus.texts.size()
+			  << " texts, " << corpus.hashtags.size() << " hashtags, "
+			  << repeat << " runs" << std::endl;
+	if (selected("line")) {
+		bench_line(corpus);
+	}
+	if (selected("parse")) {
+		bench_parse(corpus);
+	}
+	if (selected("hashtag")) {
+		bench_hashtag(corpus);
+	}
+	if (selected("lower")) {
+		bench_lower(corpus);
+	}
+	if (selected("increment")) {
+		bench_increment();
+	}
+	if (selected("merge")) {
+		bench_merge();
+	}
+	if (selected("serialize")) {
+		bench_serialize();
+	}
+	return 0;
+}
+
+/**
+ * Reads the lines of tweets (as threading.cpp trims them), and extracts
+ * their texts and hashtags.
+ * @param filename path of the corpus
+ * @param max_lines most lines read
+ * @return corpus
+ */
+static Corpus read_corpus(const char* filename, size_t max_lines) {
+	Corpus corpus;
+	std::ifstream is(filename);
+	if (is.fail()) {
+		std::cerr << "Cannot read " << filename << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	string line;
+	while (corpus.lines.size() < max_lines && getline(is, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty() || line.back() != ',') {
+			continue;
+		}
+		line.pop_back();
+		corpus.line_bytes += line.length();
+		corpus.lines.push_back(line);
+	}
+
+	Tweet tweet;
+	options.extractor = Extractor::SAX;
+	for (string line : corpus.lines) {
+		if (!extract_tweet(&line[0], line.length(), tweet)) {
+			continue;
+		}
+		corpus.texts.emplace_back(tweet.text);
+		corpus.text_bytes += tweet.text.size();
+		for (std::string_view tag : tweet.hashtags) {
+			corpus.hashtags.push_back("#" + string(tag));
+			corpus.hashtag_bytes += tag.size() + 1;
+		}
+	}
+	return corpus;
+}
+
+/**
+ * process_line end to end (with each extractor), counting the batch every
+ * BATCH_SIZE hashtags as threading.cpp does. Lines are copied first (they
+ * are parsed in place), which the copy kernel times alone.
+ */
+static void bench_line(const Corpus& corpus) {
+	std::cout << "[*] process_line (per line)" << std::endl;
+	string buf;
+	run("copy", corpus.lines.size(), corpus.line_bytes, [&]() {
+		uint64_t sum = 0;
+		for (const string& line : corpus.lines) {
+			buf.assign(line);
+			sum += buf[0];
+		}
+		return sum;
+	});
+	const std::pair<const char*, Extractor> extractors[] = {
+		{"process_line (sax)", Extractor::SAX},
+		{"process_line (index)", Extractor::INDEX},
+		{"process_line (scan)", Extractor::SCAN}};
+	for (const auto& extractor : extractors) {
+		options.extractor = extractor.second;
+		Tweet tweet;
+		FreqTable lang_freq_map, hashtag_freq_map;
+		KeyBatch hashtag_batch;
+		run(extractor.first, corpus.lines.size(), corpus.line_bytes, [&]() {
+			for (const string& line : corpus.lines) {
+				buf.assign(line);
+				process_line(buf, tweet, lang_freq_map, hashtag_batch);
+				if (hashtag_batch.size() >= BATCH_SIZE) {
+					hashtag_freq_map.increment_batch(hashtag_batch);
+					hashtag_batch.clear();
+				}
+			}
+			hashtag_freq_map.increment_batch(hashtag_batch);
+			hashtag_batch.clear();
+			return lang_freq_map.size() + hashtag_freq_map.size();
+		});
+	}
+}
+
+/**
+ * Parsing alone: the original DOM parse, and extract_tweet with each
+ * extractor (lines are copied first, as they are parsed in place).
+ */
+static void bench_parse(const Corpus& corpus) {
+	std::cout << "[*] Parse (per line)" << std::endl;
+	string buf;
+	run("rapidjson DOM", corpus.lines.size(), corpus.line_bytes, [&]() {
+		uint64_t sum = 0;
+		for (const string& line : corpus.lines) {
+			buf.assign(line);
+			rapidjson::Document d;
+			d.Parse(buf.c_str());
+			sum += d.IsObject();
+		}
+		return sum;
+	});
+	const std::pair<const char*, Extractor> extractors[] = {
+		{"extract_tweet (sax)", Extractor::SAX},
+		{"extract_tweet (index)", Extractor::INDEX},
+		{"extract_tweet (scan)", Extractor::SCAN}};
+	Tweet tweet;
+	for (const auto& extractor : extractors) {
+		options.extractor = extractor.second;
+		run(extractor.first, corpus.lines.size(), corpus.line_bytes, [&]() {
+			uint64_t sum = 0;
+			for (const string& line : corpus.lines) {
+				buf.assign(line);
+				sum += extract_tweet(&buf[0], buf.length(), tweet);
+			}
+			return sum;
+		});
+	}
+}
+
+/**
+ * Finding the first hashtag of a text: regex_search with the original
+ * pattern (as line.cpp used to), the same regex optimised, and find_hashtag.
+ */
+static void bench_hashtag(const Corpus& corpus) {
+	std::cout << "[*] Hashtag of a text (per text)" << std::endl;
+	std::regex pattern("#[\\d\\w]+");
+	std::regex optimized("#[\\d\\w]+", std::regex::optimize);
+	for (const std::regex* re : {&pattern, &optimized}) {
+		run(re == &pattern ? "regex_search" : "regex_search (optimize)",
+			corpus.texts.size(), corpus.text_bytes, [&]() {
+				uint64_t sum = 0;
+				std::smatch matched;
+				for (const string& text : corpus.texts) {
+					if (std::regex_search(text, matched, *re)) {
+						sum += matched.length();
+					}
+				}
+				return sum;
+			});
+	}
+	run("find_hashtag", corpus.texts.size(), corpus.text_bytes, [&]() {
+		uint64_t sum = 0;
+		for (const string& text : corpus.texts) {
+			const char* start;
+			sum += find_hashtag(text.data(), text.length(), &start);
+		}
+		return sum;
+	});
+}
+
+/**
+ * Transform string to lowercase (as line.cpp used to).
+ * @param in input string (string), e.g.: "#ANice_Day"
+ * @return lower case equivalent of input string (string), e.g.: "#anice_day"
+ */
+static string to_lower(string in) {
+	for (char& i : in)
+		if ('A' <= i && i <= 'Z')
+			i += 32;
+	return in;
+}
+
+/**
+ * Lowercasing hashtags: the original to_lower, lower_hash (which also
+ * hashes, and folds any script), and KeyBatch::lower (lower_hash into a
+ * batch, as process_line does).
+ */
+static void bench_lower(const Corpus& corpus) {
+	std::cout << "[*] Lowercase (per hashtag)" << std::endl;
+	if (corpus.hashtags.empty()) {
+		return;
+	}
+	run("to_lower", corpus.hashtags.size(), corpus.hashtag_bytes, [&]() {
+		uint64_t sum = 0;
+		for (const string& hashtag : corpus.hashtags) {
+			sum += to_lower(hashtag).back();
+		}
+		return sum;
+	});
+	run("lower_hash", corpus.hashtags.size(), corpus.hashtag_bytes, [&]() {
+		uint64_t sum = 0;
+		vector<char> dst;
+		for (const string& hashtag : corpus.hashtags) {
+			dst.resize(2 * hashtag.length() + 16);
+			size_t n;
+			sum += lower_hash(hashtag.data(), hashtag.length(), dst.data(), n);
+		}
+		return sum;
+	});
+	KeyBatch batch;
+	run("KeyBatch::lower", corpus.hashtags.size(), corpus.hashtag_bytes,
+		[&]() {
+			uint64_t sum = 0;
+			for (const string& hashtag : corpus.hashtags) {
+				batch.push(batch.lower(hashtag.data(), hashtag.length()));
+				if (batch.size() >= BATCH_SIZE) {
+					sum += batch.bytes.size();
+					batch.clear();
+				}
+			}
+			batch.clear();
+			return sum;
+		});
+}
+
+/**
+ * Counting keys at 1K, 100K and 1M distinct keys (in random order):
+ * std::unordered_map (as the tables used to be), FreqTable::increment and
+ * FreqTable::increment_batch.
+ */
+static void bench_increment() {
+	for (size_t n_keys : {1000UL, 100 * 1000UL, 1000 * 1000UL}) {
+		std::cout << "[*] Increment, " << n_keys
+				  << " distinct keys (per increment)" << std::endl;
+		vector<string> keys;
+		for (size_t i = 0; i < n_keys; i++) {
+			keys.push_back("#hashtag" + std::to_string(i));
+		}
+		std::mt19937_64 rng(42);
+		vector<const string*> stream;
+		size_t bytes = 0;
+		for (size_t i = 0; i < N_INCREMENTS; i++) {
+			stream.push_back(&keys[rng() % n_keys]);
+			bytes += stream.back()->length();
+		}
+
+		unordered_map<string, unsigned long> map;
+		run("unordered_map", N_INCREMENTS, bytes, [&]() {
+			for (const string* key : stream) {
+				map[*key]++;
+			}
+			return map.size();
+		});
+		FreqTable table;
+		run("FreqTable::increment", N_INCREMENTS, bytes, [&]() {
+			for (const string* key : stream) {
+				table.increment(key->data(), key->length());
+			}
+			return table.size();
+		});
+		FreqTable batched;
+		KeyBatch batch;
+		run("FreqTable::increment_batch", N_INCREMENTS, bytes, [&]() {
+			for (const string* key : stream) {
+				batch.add(key->data(), key->length());
+				if (batch.size() == BATCH_SIZE) {
+					batched.increment_batch(batch);
+					batch.clear();
+				}
+			}
+			batched.increment_batch(batch);
+			batch.clear();
+			return batched.size();
+		});
+	}
+}
+
+/**
+ * Makes a map of the keys "#hashtag<i>" for i in [first, first + n).
+ * @param first first i
+ * @param n number of keys
+ * @return map of the keys, with frequencies from 1 to 7
+ */
+static unordered_map<string, unsigned long> make_map(size_t first, size_t n) {
+	unordered_map<string, unsigned long> map;
+	for (size_t i = first; i < first + n; i++) {
+		map["#hashtag" + std::to_string(i)] = 1 + i % 7;
+	}
+	return map;
+}
+
+/**
+ * The thread merge: the tables of two threads (of N_MERGE_KEYS keys each,
+ * half of them shared) merged into an empty table and converted to a map, as
+ * process_section does, against merging std::unordered_map.
+ */
+static void bench_merge() {
+	std::cout << "[*] Thread merge, 2 threads of " << N_MERGE_KEYS
+			  << " keys (per key merged)" << std::endl;
+	unordered_map<string, unsigned long> maps[2] = {
+		make_map(0, N_MERGE_KEYS), make_map(N_MERGE_KEYS / 2, N_MERGE_KEYS)};
+	FreqTable tables[2];
+	for (int t = 0; t < 2; t++) {
+		for (const auto& it : maps[t]) {
+			tables[t].increment(it.first, it.second);
+		}
+	}
+	run("unordered_map", 2 * N_MERGE_KEYS, 0, [&]() {
+		unordered_map<string, unsigned long> combined;
+		for (const auto& map : maps) {
+			for (const auto& it : map) {
+				combined[it.first] += it.second;
+			}
+		}
+		return combined.size();
+	});
+	run("FreqTable::merge", 2 * N_MERGE_KEYS, 0, [&]() {
+		FreqTable combined;
+		for (const FreqTable& table : tables) {
+			combined.merge(table);
+		}
+		return combined.size();
+	});
+	run("FreqTable::merge + to_map", 2 * N_MERGE_KEYS, 0, [&]() {
+		FreqTable combined;
+		for (const FreqTable& table : tables) {
+			combined.merge(table);
+		}
+		return combined.to_map().size();
+	});
+}
+
+/**
+ * Serialisation of the maps sent between processes (send_results and
+ * recv_results without MPI): serialize_map, and deserialize_map into an
+ * empty map and into a map of the same keys.
+ */
+static void bench_serialize() {
+	std::cout << "[*] Serialise a map of " << N_MERGE_KEYS
+			  << " keys (per key)" << std::endl;
+	unordered_map<string, unsigned long> map = make_map(0, N_MERGE_KEYS);
+	string keys;
+	vector<unsigned long> frequencies;
+	serialize_map(map, keys, frequencies);
+	size_t bytes = keys.length() + frequencies.size() * sizeof(unsigned long);
+
+	run("serialize_map", N_MERGE_KEYS, bytes, [&]() {
+		serialize_map(map, keys, frequencies);
+		return keys.length();
+	});
+	vector<char> buf(keys.length() + 1);
+	run("deserialize_map (new keys)", N_MERGE_KEYS, bytes, [&]() {
+		unordered_map<string, unsigned long> merged;
+		memcpy(buf.data(), keys.c_str(), keys.length() + 1);
+		deserialize_map(buf.data(), frequencies.data(), frequencies.size(),
+						merged);
+		return merged.size();
+	});
+	// (the keys are all in the map after the warm up run)
+	unordered_map<string, unsigned long> merged;
+	run("deserialize_map (existing keys)", N_MERGE_KEYS, bytes, [&]() {
+		memcpy(buf.data(), keys.c_str(), keys.length() + 1);
+		deserialize_map(buf.data(), frequencies.data(), frequencies.size(),
+						merged);
+		return merged.size();
+	});
+}
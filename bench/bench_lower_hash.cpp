@@ -0,0 +1,76 @@
+// Benchmark of hashtag key canonicalisation: the original to_lower (by value)
+// followed by std::hash, against the fused lower_hash kernel
+// Usage: bench_lower_hash
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../key_hash.hpp"
+
+using std::string;
+using std::vector;
+
+// Number of keys canonicalised per run
+static const size_t N_KEYS = 10 * 1000 * 1000;
+
+/**
+ * Transform string to lowercase (as line.cpp used to).
+ * @param in input string (string), e.g.: "#ANice_Day"
+ * @return lower case equivalent of input string (string), e.g.: "#anice_day"
+ */
+string to_lower(string in) {
+	for (char& i : in)
+		if ('A' <= i && i <= 'Z')
+			i += 32;
+	return in;
+}
+
+/**
+ * Times f and prints ns per key.
+ * @param name name of the benchmark
+ * @param f function canonicalising N_KEYS keys, returning a checksum
+ */
+template <typename F> void run(const string& name, F f) {
+	auto start = std::chrono::steady_clock::now();
+	uint64_t checksum = f();
+	std::chrono::duration<double, std::nano> elapsed =
+		std::chrono::steady_clock::now() - start;
+	std::cout << "\t" << name << ": " << elapsed.count() / N_KEYS
+			  << " ns/key (checksum " << checksum % 1000 << ")" << std::endl;
+}
+
+int main() {
+	// Keys of 4 to 40 bytes, mixed case
+	const string alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRST_0";
+	std::mt19937_64 rng(42);
+	vector<string> keys(4096);
+	for (string& k : keys) {
+		k = "#";
+		size_t length = 3 + rng() % 37;
+		for (size_t i = 0; i < length; i++) {
+			k += alphabet[rng() % alphabet.size()];
+		}
+	}
+
+	run("to_lower + std::hash", [&]() {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < N_KEYS; i++) {
+			sum += std::hash<string>()(to_lower(keys[i % keys.size()]));
+		}
+		return sum;
+	});
+	run("lower_hash", [&]() {
+		uint64_t sum = 0;
+		char dst[128];
+		for (size_t i = 0; i < N_KEYS; i++) {
+			const string& k = keys[i % keys.size()];
+			size_t n;
+			sum += lower_hash(k.data(), k.length(), dst, n);
+		}
+		return sum;
+	});
+	return 0;
+}
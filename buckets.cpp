@@ -0,0 +1,291 @@
+// Counts per time bucket (hour or day) of created_at
+// With --buckets, the language and the hashtags of each tweet are also
+// counted under the bucket of its created_at, as keys prefixed with the
+// bucket's index. The keys are counted by the same tables, merged across
+// threads and combined across processes like the other counts, and split
+// back into buckets for the report
+
+// References:
+// https://howardhinnant.github.io/date_algorithms.html (days_from_civil)
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include "buckets.hpp"
+#include "combine.hpp"
+#include "options.hpp"
+#include "trending.hpp"
+
+using std::string;
+using std::unordered_map;
+
+// Digits of the bucket index that prefixes the keys
+static const size_t BUCKET_DIGITS = 8;
+
+// Length of a created_at time, e.g.: "Wed Apr 01 12:34:56 +0000 2020"
+static const size_t CREATED_AT_LENGTH = 30;
+
+// Keys collected before they are counted together
+static const size_t BUCKET_BATCH_SIZE = 256;
+
+// Function prototypes
+static int two_digits(const char* p);
+static int parse_month(const char* p);
+static long long days_from_civil(long long y, unsigned m, unsigned d);
+static void civil_from_days(long long z, long long& y, unsigned& m,
+							unsigned& d);
+
+/**
+ * Counts the language and the (unique) hashtags of a tweet under the bucket
+ * of its created_at (a tweet without a valid one is not counted).
+ * @param tweet fields of the tweet
+ * @param hashtag_batch batch the hashtags of the tweet were added to
+ * @param first index of the first hashtag of the tweet in the batch
+ */
+void BucketCounts::add(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					   size_t first) {
+	long long seconds;
+	if (!parse_created_at(tweet.created_at.data(), tweet.created_at.size(),
+						  seconds)) {
+		return;
+	}
+	// The index always has BUCKET_DIGITS digits (as the year of created_at
+	// has 4, it is under 10^8 hours)
+	long long bucket =
+		seconds / (options.buckets == Buckets::HOUR ? 3600 : 86400);
+	char prefix[BUCKET_DIGITS];
+	for (size_t i = BUCKET_DIGITS; i-- > 0; bucket /= 10) {
+		prefix[i] = (char)('0' + bucket % 10);
+	}
+
+	if (tweet.lang.data()) {
+		key.assign(prefix, BUCKET_DIGITS);
+		key.append(tweet.lang.data(), tweet.lang.size());
+		langs.increment(key);
+	}
+	for (size_t i = first; i < hashtag_batch.keys.size(); i++) {
+		const BatchKey& k = hashtag_batch.keys[i];
+		key.assign(prefix, BUCKET_DIGITS);
+		key.append(hashtag_batch.bytes.data() + k.offset, k.length);
+		batch.add(key.data(), key.size());
+	}
+	if (batch.size() >= BUCKET_BATCH_SIZE) {
+		flush();
+	}
+}
+
+/**
+ * Counts the hashtags collected so far.
+ */
+void BucketCounts::flush() {
+	hashtags.increment_batch(batch);
+	batch.clear();
+}
+
+/**
+ * Adds the counts of another thread.
+ * @param other counts of the thread (flushed)
+ */
+void BucketCounts::merge(BucketCounts& other) {
+	other.flush();
+	langs.merge(other.langs);
+	hashtags.merge(other.hashtags);
+}
+
+/**
+ * Parses a created_at time in Twitter's fixed layout, by the position of
+ * each field (no strptime, so no locale).
+ * @param str time, e.g.: "Wed Apr 01 12:34:56 +0000 2020"
+ * @param length number of bytes in str
+ * @param seconds set to the seconds since 1970-01-01 00:00:00 UTC
+ * @return whether the time is valid (and not before 1970)
+ */
+bool parse_created_at(const char* str, size_t length, long long& seconds) {
+	if (str == nullptr || length != CREATED_AT_LENGTH || str[3] != ' ' ||
+		str[7] != ' ' || str[10] != ' ' || str[13] != ':' ||
+		str[16] != ':' || str[19] != ' ' || str[25] != ' ' ||
+		(str[20] != '+' && str[20] != '-')) {
+		return false;
+	}
+	int month = parse_month(str + 4);
+	int day = two_digits(str + 8);
+	int hour = two_digits(str + 11);
+	int minute = two_digits(str + 14);
+	int second = two_digits(str + 17);
+	int offset_hours = two_digits(str + 21);
+	int offset_minutes = two_digits(str + 23);
+	int century = two_digits(str + 26);
+	int year = two_digits(str + 28);
+	if (month < 1 || day < 1 || day > 31 || hour < 0 || hour > 23 ||
+		minute < 0 || minute > 59 || second < 0 || second > 60 ||
+		offset_hours < 0 || offset_minutes < 0 || century < 0 || year < 0) {
+		return false;
+	}
+	long long offset = offset_hours * 3600 + offset_minutes * 60;
+	seconds = days_from_civil(century * 100 + year, month, day) * 86400 +
+			  hour * 3600 + minute * 60 + second -
+			  (str[20] == '+' ? offset : -offset);
+	return seconds >= 0;
+}
+
+/**
+ * Combines the counts per bucket of all processes and prints the top
+ * languages and hashtags of each bucket, in time order (and the trending
+ * hashtags, with --trending), called by all processes.
+ * @param counts counts of this process
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+void report_buckets(BucketCounts& counts, int rank, int size,
+					const unordered_map<string, string>& lang_map) {
+	counts.flush();
+	unordered_map<string, unsigned long> langs = counts.langs.to_map();
+	unordered_map<string, unsigned long> hashtags = counts.hashtags.to_map();
+	counts = BucketCounts();
+	combine_maps(langs, rank, size);
+	combine_maps(hashtags, rank, size);
+	if (rank != 0) {
+		return;
+	}
+
+	// Split the keys into their buckets
+	std::map<long long, std::pair<unordered_map<string, unsigned long>,
+								  unordered_map<string, unsigned long>>>
+		buckets;
+	for (const auto& it : langs) {
+		buckets[std::stoll(it.first.substr(0, BUCKET_DIGITS))].first.emplace(
+			it.first.substr(BUCKET_DIGITS), it.second);
+	}
+	for (const auto& it : hashtags) {
+		buckets[std::stoll(it.first.substr(0, BUCKET_DIGITS))].second.emplace(
+			it.first.substr(BUCKET_DIGITS), it.second);
+	}
+
+	std::function<string(string)> lang_printer =
+		std::bind(format_lang, lang_map, std::placeholders::_1);
+	for (auto& it : buckets) {
+		if (options.bucket_top == 0) {
+			break;
+		}
+		string name = bucket_name(it.first);
+		std::cout << std::endl
+				  << "[*] Language Freq Results, " << name << std::endl;
+		easy_print(it.second.first, lang_printer, options.bucket_top);
+		std::cout << "[*] Hashtag Freq Results, " << name << std::endl;
+		easy_print(
+			it.second.second, [](string key) { return key; },
+			options.bucket_top);
+	}
+
+	// Hashtags rising in a sliding window of buckets (see trending.cpp)
+	if (options.trending) {
+		std::map<long long, const unordered_map<string, unsigned long>*>
+			bucket_hashtags;
+		for (const auto& it : buckets) {
+			bucket_hashtags.emplace(it.first, &it.second.second);
+		}
+		report_trending(bucket_hashtags);
+	}
+}
+
+/**
+ * Value of two decimal digits (-1 if they are not digits).
+ */
+static int two_digits(const char* p) {
+	unsigned a = (unsigned char)p[0] - '0';
+	unsigned b = (unsigned char)p[1] - '0';
+	return a < 10 && b < 10 ? (int)(a * 10 + b) : -1;
+}
+
+/**
+ * Number of an English month abbreviation, e.g.: "Apr" -> 4 (0 if it is not
+ * one).
+ */
+static int parse_month(const char* p) {
+	switch ((p[0] << 16) | (p[1] << 8) | p[2]) {
+	case ('J' << 16) | ('a' << 8) | 'n':
+		return 1;
+	case ('F' << 16) | ('e' << 8) | 'b':
+		return 2;
+	case ('M' << 16) | ('a' << 8) | 'r':
+		return 3;
+	case ('A' << 16) | ('p' << 8) | 'r':
+		return 4;
+	case ('M' << 16) | ('a' << 8) | 'y':
+		return 5;
+	case ('J' << 16) | ('u' << 8) | 'n':
+		return 6;
+	case ('J' << 16) | ('u' << 8) | 'l':
+		return 7;
+	case ('A' << 16) | ('u' << 8) | 'g':
+		return 8;
+	case ('S' << 16) | ('e' << 8) | 'p':
+		return 9;
+	case ('O' << 16) | ('c' << 8) | 't':
+		return 10;
+	case ('N' << 16) | ('o' << 8) | 'v':
+		return 11;
+	case ('D' << 16) | ('e' << 8) | 'c':
+		return 12;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Days since 1970-01-01 of a date of the proleptic Gregorian calendar.
+ * @param y year
+ * @param m month (1 to 12)
+ * @param d day of the month (1 to 31)
+ * @return days since 1970-01-01
+ */
+static long long days_from_civil(long long y, unsigned m, unsigned d) {
+	y -= m <= 2;
+	long long era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long long)doe - 719468;
+}
+
+/**
+ * Date of the proleptic Gregorian calendar of a number of days since
+ * 1970-01-01 (the inverse of days_from_civil).
+ */
+static void civil_from_days(long long z, long long& y, unsigned& m,
+							unsigned& d) {
+	z += 719468;
+	long long era = (z >= 0 ? z : z - 146096) / 146097;
+	unsigned doe = (unsigned)(z - era * 146097);
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = (long long)yoe + era * 400 + (m <= 2);
+}
+
+/**
+ * Name of a bucket, e.g.: 440484 -> "2020-04-01 12:00 UTC" (for hours) or
+ * 18353 -> "2020-04-01 UTC" (for days).
+ * @param bucket index of the bucket (hours or days since 1970-01-01)
+ * @return name of the bucket
+ */
+string bucket_name(long long bucket) {
+	bool hours = options.buckets == Buckets::HOUR;
+	long long y;
+	unsigned m, d;
+	civil_from_days(hours ? bucket / 24 : bucket, y, m, d);
+	// Large enough for any long long year, month and day (the compiler
+	// cannot tell they are in range)
+	char name[48];
+	if (hours) {
+		snprintf(name, sizeof(name), "%04lld-%02u-%02u %02lld:00 UTC", y, m,
+				 d, bucket % 24);
+	} else {
+		snprintf(name, sizeof(name), "%04lld-%02u-%02u UTC", y, m, d);
+	}
+	return name;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include "freq_table.hpp"
+#include "tweet.hpp"
+
+/**
+ * Languages and hashtags counted per time bucket (of created_at, with
+ * --buckets), keyed by the bucket's index in BUCKET_DIGITS decimal digits
+ * followed by the language or hashtag, e.g.: "00440484#auspol".
+ */
+struct BucketCounts {
+	FreqTable langs;
+	FreqTable hashtags;
+	KeyBatch batch;
+	std::string key;
+
+	void add(const Tweet& tweet, const KeyBatch& hashtag_batch, size_t first);
+	void flush();
+	void merge(BucketCounts& other);
+};
+
+/**
+ * Parses a created_at time, e.g.: "Wed Apr 01 12:34:56 +0000 2020".
+ */
+bool parse_created_at(const char* str, size_t length, long long& seconds);
+
+/**
+ * Combines the counts per bucket of all processes and prints the top
+ * languages and hashtags of each bucket (called by all processes).
+ */
+void report_buckets(BucketCounts& counts, int rank, int size,
+					const std::unordered_map<std::string, std::string>&
+						lang_map);
+
+/**
+ * Name of a bucket (by its index), e.g.: "2020-04-01 12:00 UTC".
+ */
+std::string bucket_name(long long bucket);
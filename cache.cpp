@@ -0,0 +1,631 @@
+// Columnar cache of the fields that are counted
+// "tp --compile" writes the fields of every valid tweet to a cache: its
+// language, as an id into a dictionary of languages, and its distinct
+// lowercased hashtags, as ids into a dictionary of hashtags. Rows are stored
+// in row groups of up to CACHE_GROUP_ROWS tweets. A later run on the cache
+// maps it into memory and counts the ids of each process's row groups with
+// its threads, instead of parsing the JSON again
+//
+// Layout (native byte order, every section aligned to 8 bytes):
+//   CacheHeader
+//   languages: n + 1 uint64 offsets of the keys, then the keys
+//   hashtags: likewise
+//   row groups: n_rows uint16 language ids (padded to 4 bytes), n_rows + 1
+//     uint32 offsets into the hashtag ids, then the uint32 hashtag ids
+//   directory: a CacheGroup per row group
+
+#define OMPI_SKIP_MPICXX
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <omp.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.hpp"
+#include "options.hpp"
+#include "progress.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
+
+using std::pair;
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+// First bytes of a cache (of version 1 of the layout)
+static const char CACHE_MAGIC[8] = {'T', 'P', 'C', 'A', 'C', 'H', 'E', '1'};
+
+// Largest write of MPI_File_write_at (its count is an int)
+static const uint64_t MAX_WRITE = 1 << 30;
+
+/**
+ * Start of a cache.
+ */
+struct CacheHeader {
+	char magic[8];
+	uint64_t source_length;   // bytes of the JSON file compiled
+	uint64_t n_rows;          // tweets
+	uint64_t n_groups;        // row groups
+	uint64_t langs_offset;    // offset of the dictionary of languages
+	uint64_t n_langs;
+	uint64_t hashtags_offset; // offset of the dictionary of hashtags
+	uint64_t n_hashtags;
+	uint64_t groups_offset;   // offset of the directory of row groups
+};
+
+/**
+ * Entry of the directory of row groups.
+ */
+struct CacheGroup {
+	uint64_t offset;
+	uint32_t n_rows;
+	uint32_t n_hashtags;
+};
+
+// Function prototypes
+static uint16_t lang_id(uint32_t id);
+static void remap_group(CacheRowGroup& group, const vector<uint32_t>& lang_ids,
+						const vector<uint32_t>& hashtag_ids);
+static CacheDictionary merge_dictionaries(const CacheDictionary& dictionary,
+										  vector<uint32_t>& ids, int rank,
+										  int size);
+static void append_dictionary(string& out, const CacheDictionary& dictionary);
+static void append_group(string& out, const CacheRowGroup& group);
+static void write_at(MPI_File file, uint64_t offset, const string& data);
+static vector<string_view> read_dictionary(const char* filename,
+										   const char* base, uint64_t length,
+										   uint64_t offset, uint64_t n);
+static void corrupt_cache(const char* filename, const char* reason);
+
+/**
+ * Offset of the hashtag offsets in a row group.
+ * @param n_rows rows of the group
+ */
+static inline uint64_t offsets_at(uint64_t n_rows) {
+	return (2 * n_rows + 3) & ~(uint64_t)3;
+}
+
+/**
+ * Bytes of a row group (with its padding).
+ * @param n_rows rows of the group
+ * @param n_hashtags hashtag ids of the group
+ */
+static inline uint64_t group_bytes(uint64_t n_rows, uint64_t n_hashtags) {
+	return (offsets_at(n_rows) + 4 * (n_rows + 1 + n_hashtags) + 7) &
+		   ~(uint64_t)7;
+}
+
+/**
+ * Returns the id of a key, adding it if it is new.
+ * @param key key, e.g.: "#hashtag"
+ * @return id (the number of keys before it was added)
+ */
+uint32_t CacheDictionary::intern(string_view key) {
+	auto it = ids.find(key);
+	if (it != ids.end()) {
+		return it->second;
+	}
+	uint32_t id = keys.size();
+	keys.emplace_back(key);
+	ids.emplace(keys.back(), id);
+	return id;
+}
+
+/**
+ * Adds the row of a tweet.
+ * @param lang language of the tweet (null data() for none)
+ * @param batch batch that the hashtags of the tweet were added to
+ * @param first index of the first hashtag of the tweet in batch
+ */
+void CacheWriter::add_row(string_view lang, const KeyBatch& batch,
+						  size_t first) {
+	if (groups.empty() || groups.back().langs.size() == CACHE_GROUP_ROWS) {
+		groups.emplace_back();
+	}
+	CacheRowGroup& group = groups.back();
+	group.langs.push_back(lang.data() ? lang_id(langs.intern(lang))
+									  : NO_LANG);
+	for (size_t i = first; i < batch.size(); i++) {
+		const BatchKey& key = batch.keys[i];
+		group.hashtags.push_back(hashtags.intern(
+			string_view(&batch.bytes[key.offset], key.length)));
+	}
+	group.offsets.push_back(group.hashtags.size());
+}
+
+/**
+ * Moves the rows of another writer (e.g.: of a thread) into this one,
+ * renumbering them with the ids of this writer.
+ * @param other writer whose rows are moved
+ */
+void CacheWriter::merge(CacheWriter& other) {
+	vector<uint32_t> lang_ids, hashtag_ids;
+	for (const string& key : other.langs.keys) {
+		lang_ids.push_back(langs.intern(key));
+	}
+	for (const string& key : other.hashtags.keys) {
+		hashtag_ids.push_back(hashtags.intern(key));
+	}
+	for (CacheRowGroup& group : other.groups) {
+		remap_group(group, lang_ids, hashtag_ids);
+		groups.push_back(std::move(group));
+	}
+	other.groups.clear();
+}
+
+/**
+ * Checks that a language id fits in a row, exiting if it does not.
+ * @param id language id
+ * @return id
+ */
+static uint16_t lang_id(uint32_t id) {
+	if (id >= NO_LANG) {
+		std::cerr << "[!] Too many languages for the cache (more than "
+				  << NO_LANG << ")" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return id;
+}
+
+/**
+ * Renumbers the ids of a row group.
+ * @param group row group
+ * @param lang_ids new id of each language id
+ * @param hashtag_ids new id of each hashtag id
+ */
+static void remap_group(CacheRowGroup& group, const vector<uint32_t>& lang_ids,
+						const vector<uint32_t>& hashtag_ids) {
+	for (uint16_t& lang : group.langs) {
+		if (lang != NO_LANG) {
+			lang = lang_id(lang_ids[lang]);
+		}
+	}
+	for (uint32_t& hashtag : group.hashtags) {
+		hashtag = hashtag_ids[hashtag];
+	}
+}
+
+/**
+ * Writes the rows of every process to a cache file, with the dictionaries
+ * merged on rank 0. Called by all processes, which write their row groups in
+ * rank order.
+ * @param writer rows of this process (renumbered)
+ * @param path path of the cache
+ * @param source_length bytes of the JSON file compiled
+ */
+void write_cache(CacheWriter& writer, const string& path,
+				 long long source_length) {
+	int rank, size;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+	// Renumber the rows with the merged dictionaries
+	vector<uint32_t> lang_ids, hashtag_ids;
+	CacheDictionary langs =
+		merge_dictionaries(writer.langs, lang_ids, rank, size);
+	CacheDictionary hashtags =
+		merge_dictionaries(writer.hashtags, hashtag_ids, rank, size);
+	string data;
+	vector<CacheGroup> directory;
+	uint64_t n_rows = 0;
+	for (CacheRowGroup& group : writer.groups) {
+		remap_group(group, lang_ids, hashtag_ids);
+		directory.push_back(CacheGroup{data.size(),
+									   (uint32_t)group.langs.size(),
+									   (uint32_t)group.hashtags.size()});
+		n_rows += group.langs.size();
+		append_group(data, group);
+	}
+
+	// Rank 0 starts the file with the header and dictionaries, which the
+	// row groups of every process follow (in rank order)
+	CacheHeader header = {};
+	string head(sizeof(CacheHeader), '\0');
+	if (rank == 0) {
+		header.langs_offset = head.size();
+		header.n_langs = langs.keys.size();
+		append_dictionary(head, langs);
+		header.hashtags_offset = head.size();
+		header.n_hashtags = hashtags.keys.size();
+		append_dictionary(head, hashtags);
+	}
+	uint64_t data_start = head.size();
+	MPI_Bcast(&data_start, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	uint64_t data_size = data.size(), data_offset = 0;
+	MPI_Exscan(&data_size, &data_offset, 1, MPI_UINT64_T, MPI_SUM,
+			   MPI_COMM_WORLD);
+	if (rank == 0) {
+		data_offset = 0;
+	}
+	for (CacheGroup& group : directory) {
+		group.offset += data_start + data_offset;
+	}
+
+	// Gather the directory and the totals to rank 0
+	int bytes = directory.size() * sizeof(CacheGroup);
+	vector<int> all_bytes(size), displacements(size);
+	MPI_Gather(&bytes, 1, MPI_INT, all_bytes.data(), 1, MPI_INT, 0,
+			   MPI_COMM_WORLD);
+	string all_directory;
+	if (rank == 0) {
+		for (int r = 0; r < size; r++) {
+			displacements[r] = all_directory.size();
+			all_directory.resize(all_directory.size() + all_bytes[r]);
+		}
+	}
+	MPI_Gatherv(directory.data(), bytes, MPI_BYTE, &all_directory[0],
+				all_bytes.data(), displacements.data(), MPI_BYTE, 0,
+				MPI_COMM_WORLD);
+	uint64_t total_rows = 0, total_size = 0;
+	MPI_Reduce(&n_rows, &total_rows, 1, MPI_UINT64_T, MPI_SUM, 0,
+			   MPI_COMM_WORLD);
+	MPI_Reduce(&data_size, &total_size, 1, MPI_UINT64_T, MPI_SUM, 0,
+			   MPI_COMM_WORLD);
+
+	// Write (the header last, once the rest of rank 0's part is known)
+	MPI_File file;
+	if (MPI_File_open(MPI_COMM_WORLD, path.c_str(),
+					  MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+					  &file) != MPI_SUCCESS) {
+		std::cerr << "[!] MPI " << rank << " failed to open cache " << path
+				  << " for writing" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	MPI_File_set_size(file, 0);
+	write_at(file, data_start + data_offset, data);
+	if (rank == 0) {
+		memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.source_length = source_length;
+		header.n_rows = total_rows;
+		header.n_groups = all_directory.size() / sizeof(CacheGroup);
+		header.groups_offset = data_start + total_size;
+		write_at(file, header.groups_offset, all_directory);
+		memcpy(&head[0], &header, sizeof(header));
+		write_at(file, 0, head);
+	}
+	MPI_File_close(&file);
+
+	if (rank == 0) {
+		std::stringstream m;
+		m << "[*] Cache " << path << ": " << total_rows << " tweets, "
+		  << header.n_langs << " languages, " << header.n_hashtags
+		  << " hashtags (in bytes): "
+		  << header.groups_offset + all_directory.size() << std::endl;
+		std::cerr << m.str();
+	}
+}
+
+/**
+ * Merges the dictionaries of all processes into one on rank 0, giving each
+ * key of this process its merged id.
+ * @param dictionary dictionary of this process
+ * @param ids set to the merged id of each key of dictionary
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @return merged dictionary (on rank 0, empty on the others)
+ */
+static CacheDictionary merge_dictionaries(const CacheDictionary& dictionary,
+										  vector<uint32_t>& ids, int rank,
+										  int size) {
+	// Keys of this process, each followed by a null (keys have no nulls)
+	string keys;
+	for (const string& key : dictionary.keys) {
+		keys += key;
+		keys += '\0';
+	}
+	int length = keys.size();
+	int count = dictionary.keys.size();
+	vector<int> lengths(size), counts(size);
+	vector<int> key_displacements(size), id_displacements(size);
+	MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0,
+			   MPI_COMM_WORLD);
+	MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0,
+			   MPI_COMM_WORLD);
+	string all_keys;
+	int total_count = 0;
+	if (rank == 0) {
+		for (int r = 0; r < size; r++) {
+			key_displacements[r] = all_keys.size();
+			all_keys.resize(all_keys.size() + lengths[r]);
+			id_displacements[r] = total_count;
+			total_count += counts[r];
+		}
+	}
+	MPI_Gatherv(keys.data(), length, MPI_CHAR, &all_keys[0], lengths.data(),
+				key_displacements.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+	// Intern the keys of every process in rank order
+	CacheDictionary merged;
+	vector<uint32_t> all_ids;
+	if (rank == 0) {
+		all_ids.reserve(total_count);
+		const char* key = all_keys.data();
+		const char* end = key + all_keys.size();
+		while (key < end) {
+			size_t n = strlen(key);
+			all_ids.push_back(merged.intern(string_view(key, n)));
+			key += n + 1;
+		}
+	}
+	ids.resize(count);
+	MPI_Scatterv(all_ids.data(), counts.data(), id_displacements.data(),
+				 MPI_UINT32_T, ids.data(), count, MPI_UINT32_T, 0,
+				 MPI_COMM_WORLD);
+	return merged;
+}
+
+/**
+ * Appends a dictionary: the offsets of its keys, then the keys.
+ * @param out bytes of the cache
+ * @param dictionary dictionary
+ */
+static void append_dictionary(string& out, const CacheDictionary& dictionary) {
+	vector<uint64_t> offsets(1, 0);
+	for (const string& key : dictionary.keys) {
+		offsets.push_back(offsets.back() + key.size());
+	}
+	out.append((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+	for (const string& key : dictionary.keys) {
+		out += key;
+	}
+	out.resize((out.size() + 7) & ~(size_t)7, '\0');
+}
+
+/**
+ * Appends a row group.
+ * @param out bytes of the row groups
+ * @param group row group
+ */
+static void append_group(string& out, const CacheRowGroup& group) {
+	size_t start = out.size();
+	size_t n_rows = group.langs.size();
+	out.append((const char*)group.langs.data(), n_rows * sizeof(uint16_t));
+	out.resize(start + offsets_at(n_rows), '\0');
+	out.append((const char*)group.offsets.data(),
+			   group.offsets.size() * sizeof(uint32_t));
+	out.append((const char*)group.hashtags.data(),
+			   group.hashtags.size() * sizeof(uint32_t));
+	out.resize(start + group_bytes(n_rows, group.hashtags.size()), '\0');
+}
+
+/**
+ * Writes bytes at an offset of a file, exiting on failure.
+ * @param file file opened with MPI_File_open
+ * @param offset offset in bytes
+ * @param data bytes
+ */
+static void write_at(MPI_File file, uint64_t offset, const string& data) {
+	for (uint64_t done = 0; done < data.size();) {
+		int n = std::min(MAX_WRITE, data.size() - done);
+		if (MPI_File_write_at(file, offset + done, data.data() + done, n,
+							  MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+			std::cerr << "[!] Failed to write the cache" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		done += n;
+	}
+}
+
+/**
+ * Path of the cache of an input file: options.compile_path, or the input
+ * with ".tpc" appended.
+ * @param filename path of twitter file
+ */
+string cache_path(const char* filename) {
+	if (!options.compile_path.empty()) {
+		return options.compile_path;
+	}
+	return string(filename) + ".tpc";
+}
+
+/**
+ * Whether a file is a cache (starts with its magic bytes) rather than JSON.
+ * @param filename path of the file
+ */
+bool is_cache(const char* filename) {
+	char magic[sizeof(CACHE_MAGIC)];
+	std::ifstream is(filename, std::ifstream::binary);
+	return is.read(magic, sizeof(magic)) &&
+		   memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Counts the languages and hashtags of this process's row groups of a cache
+ * (those whose first row is in its share of the rows), with a thread per
+ * row group at a time.
+ * @param filename path of the cache
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @return maps of <language, count> and <hashtag, count>
+ */
+pair<unordered_map<string, unsigned long>,
+	 unordered_map<string, unsigned long>>
+process_cache(const char* filename, int rank, int size) {
+	// Map the cache into memory
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		std::cerr << "[!] MPI " << rank << " failed to open cache, error num:"
+				  << strerror(errno) << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	uint64_t length = st.st_size;
+	if (length < sizeof(CacheHeader)) {
+		corrupt_cache(filename, "shorter than its header");
+	}
+	void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		std::cerr << "[!] MPI " << rank << " failed to map cache, error num:"
+				  << strerror(errno) << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	const char* base = (const char*)mapped;
+	CacheHeader header;
+	memcpy(&header, base, sizeof(header));
+	vector<string_view> langs = read_dictionary(
+		filename, base, length, header.langs_offset, header.n_langs);
+	vector<string_view> hashtags = read_dictionary(
+		filename, base, length, header.hashtags_offset, header.n_hashtags);
+	if (header.groups_offset > length || header.groups_offset % 8 != 0 ||
+		header.n_groups >
+			(length - header.groups_offset) / sizeof(CacheGroup)) {
+		corrupt_cache(filename, "directory out of bounds");
+	}
+	const CacheGroup* groups =
+		(const CacheGroup*)(base + header.groups_offset);
+
+	// Row groups of this process
+	long long first = 0, last = 0;
+	uint64_t row = 0, bytes = 0;
+	for (uint64_t g = 0; g < header.n_groups; g++) {
+		const CacheGroup& group = groups[g];
+		uint64_t n = group_bytes(group.n_rows, group.n_hashtags);
+		if (group.offset % 8 != 0 || group.offset > length ||
+			n > length - group.offset) {
+			corrupt_cache(filename, "row group out of bounds");
+		}
+		uint64_t owner = row * size / std::max<uint64_t>(header.n_rows, 1);
+		if (owner < (uint64_t)rank) {
+			first = g + 1;
+		}
+		if (owner <= (uint64_t)rank) {
+			last = g + 1;
+			bytes += owner == (uint64_t)rank ? n : 0;
+		}
+		row += group.n_rows;
+	}
+
+	// Count the ids of each row group
+	uint32_t n_langs = langs.size(), n_hashtags = hashtags.size();
+	vector<unsigned long> lang_counts(n_langs), hashtag_counts(n_hashtags);
+	bool corrupt = false;
+	progress_start(bytes);
+#pragma omp parallel default(none)                                            \
+	shared(base, groups, first, last, n_langs, n_hashtags, lang_counts,       \
+		   hashtag_counts, corrupt)
+	{
+		vector<unsigned long> thread_langs(n_langs);
+		vector<unsigned long> thread_hashtags(n_hashtags);
+		bool bad = false;
+		progress_thread_start();
+
+#pragma omp for schedule(dynamic)
+		for (long long g = first; g < last; g++) {
+			double chunk_start = trace_now();
+			stage_start();
+			const CacheGroup& group = groups[g];
+			const char* p = base + group.offset;
+			const uint16_t* row_langs = (const uint16_t*)p;
+			const uint32_t* offsets =
+				(const uint32_t*)(p + offsets_at(group.n_rows));
+			const uint32_t* ids = offsets + group.n_rows + 1;
+			bad |= offsets[group.n_rows] != group.n_hashtags;
+			for (uint32_t r = 0; r < group.n_rows; r++) {
+				uint16_t lang = row_langs[r];
+				if (lang < n_langs) {
+					thread_langs[lang]++;
+				} else {
+					bad |= lang != 0xFFFF;
+				}
+			}
+			for (uint32_t i = 0; i < group.n_hashtags; i++) {
+				uint32_t id = ids[i];
+				if (id < n_hashtags) {
+					thread_hashtags[id]++;
+				} else {
+					bad = true;
+				}
+			}
+			stage_lap(COUNT);
+			uint64_t n = group_bytes(group.n_rows, group.n_hashtags);
+			progress_add(n, group.n_rows);
+			trace_chunk(chunk_start, n, group.n_rows);
+		}
+
+		// Combine together thread by thread (i.e. not concurrently)
+#pragma omp critical
+		{
+			stage_start();
+			for (uint32_t i = 0; i < n_langs; i++) {
+				lang_counts[i] += thread_langs[i];
+			}
+			for (uint32_t i = 0; i < n_hashtags; i++) {
+				hashtag_counts[i] += thread_hashtags[i];
+			}
+			corrupt |= bad;
+			stage_lap(THREAD_MERGE);
+		}
+		timing_end_thread();
+	}
+	progress_stop();
+	if (corrupt) {
+		corrupt_cache(filename, "id out of range");
+	}
+
+	// Counts of the keys that appear
+	pair<unordered_map<string, unsigned long>,
+		 unordered_map<string, unsigned long>>
+		results;
+	for (uint32_t i = 0; i < n_langs; i++) {
+		if (lang_counts[i]) {
+			results.first.emplace(langs[i], lang_counts[i]);
+		}
+	}
+	for (uint32_t i = 0; i < n_hashtags; i++) {
+		if (hashtag_counts[i]) {
+			results.second.emplace(hashtags[i], hashtag_counts[i]);
+		}
+	}
+	munmap(mapped, length);
+	return results;
+}
+
+/**
+ * Reads a dictionary of a mapped cache, exiting if it is out of bounds.
+ * @param filename path of the cache
+ * @param base start of the mapped cache
+ * @param length bytes of the cache
+ * @param offset offset of the dictionary
+ * @param n number of keys
+ * @return keys (pointing into the mapped cache)
+ */
+static vector<string_view> read_dictionary(const char* filename,
+										   const char* base, uint64_t length,
+										   uint64_t offset, uint64_t n) {
+	if (offset > length || offset % 8 != 0 ||
+		n >= (length - offset) / sizeof(uint64_t)) {
+		corrupt_cache(filename, "dictionary out of bounds");
+	}
+	const uint64_t* offsets = (const uint64_t*)(base + offset);
+	const char* keys = (const char*)(offsets + n + 1);
+	uint64_t available = length - offset - (n + 1) * sizeof(uint64_t);
+	vector<string_view> dictionary;
+	dictionary.reserve(n);
+	for (uint64_t i = 0; i < n; i++) {
+		if (offsets[i] > offsets[i + 1] || offsets[i + 1] > available) {
+			corrupt_cache(filename, "dictionary out of bounds");
+		}
+		dictionary.emplace_back(keys + offsets[i],
+								offsets[i + 1] - offsets[i]);
+	}
+	return dictionary;
+}
+
+/**
+ * Exits on a cache that is not valid.
+ * @param filename path of the cache
+ * @param reason what is wrong, e.g.: "id out of range"
+ */
+static void corrupt_cache(const char* filename, const char* reason) {
+	std::cerr << "[!] Corrupt cache " << filename << ": " << reason
+			  << std::endl;
+	std::exit(EXIT_FAILURE);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "freq_table.hpp"
+
+// Rows (tweets) in a row group of the cache, the unit of work when reading
+static const uint32_t CACHE_GROUP_ROWS = 1 << 16;
+
+// Language id of a tweet without a language
+static const uint16_t NO_LANG = 0xFFFF;
+
+/**
+ * Interned keys (languages or hashtags) and their ids, in order of first
+ * appearance.
+ */
+struct CacheDictionary {
+	std::deque<std::string> keys; // a deque, so keys do not move
+	std::unordered_map<std::string_view, uint32_t> ids;
+
+	uint32_t intern(std::string_view key);
+};
+
+/**
+ * Rows of a row group: the language id of each tweet, and its hashtag ids
+ * (those of row i are hashtags[offsets[i]] to hashtags[offsets[i + 1] - 1]).
+ */
+struct CacheRowGroup {
+	std::vector<uint16_t> langs;
+	std::vector<uint32_t> offsets{0};
+	std::vector<uint32_t> hashtags;
+};
+
+/**
+ * Rows collected by a thread (or a process) for the cache, with ids into its
+ * own dictionaries.
+ */
+struct CacheWriter {
+	CacheDictionary langs;
+	CacheDictionary hashtags;
+	std::vector<CacheRowGroup> groups;
+
+	void add_row(std::string_view lang, const KeyBatch& batch, size_t first);
+	void merge(CacheWriter& other);
+};
+
+/**
+ * Writes the rows of every process to a cache file (called by all
+ * processes).
+ */
+void write_cache(CacheWriter& writer, const std::string& path,
+				 long long source_length);
+
+/**
+ * Path of the cache of an input file (options.compile_path, or next to the
+ * input).
+ */
+std::string cache_path(const char* filename);
+
+/**
+ * Whether a file is a cache (rather than JSON).
+ */
+bool is_cache(const char* filename);
+
+/**
+ * Counts the languages and hashtags of this process's row groups of a cache.
+ */
+std::pair<std::unordered_map<std::string, unsigned long>,
+		  std::unordered_map<std::string, unsigned long>>
+process_cache(const char* filename, int rank, int size);
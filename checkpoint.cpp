@@ -0,0 +1,299 @@
+// Checkpoints of incremental runs
+// With --checkpoint=file, the counts of the input and the offset they were
+// counted up to are saved after a run. The next run on the input (after
+// tweets were appended to it) only processes the lines after that offset,
+// and adds its counts to the saved ones. The offset is the end of the last
+// complete ('\n' terminated) line, so a line that is still being written is
+// left for the next run. As sections process the lines that start in them
+// (see process_section_thread), the line at the offset is counted once
+//
+// Format (text):
+//   tp checkpoint 1
+//   offset <bytes>
+//   tail <hex of the CHECKPOINT_TAIL bytes before offset>
+//   languages <n>
+//   <count> <language>  (n lines)
+//   hashtags <n>
+//   <count> <hashtag>   (n lines)
+
+#define OMPI_SKIP_MPICXX
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <sstream>
+#include <string>
+#include "checkpoint.hpp"
+#include "options.hpp"
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+
+// First line of a checkpoint (of version 1 of the format)
+static const char* const CHECKPOINT_VERSION = "tp checkpoint 1";
+
+// Bytes before the offset that are kept to check the input
+static const long long CHECKPOINT_TAIL = 64;
+
+// Bytes read at a time when looking for the last complete line
+static const long long SCAN_BLOCK = 1 << 16;
+
+// Function prototypes
+static bool read_state(const string& path, Checkpoint& checkpoint);
+static void read_counts(std::istream& is, const string& section,
+						unordered_map<string, unsigned long>& counts);
+static void write_counts(std::ostream& os, const string& section,
+						 const unordered_map<string, unsigned long>& counts);
+static long long complete_length(const char* filename, long long file_length);
+static string read_bytes(const char* filename, long long offset, long long n);
+static string to_hex(const string& bytes);
+static string from_hex(const string& hex);
+static void checkpoint_error(const string& message);
+
+/**
+ * Reads the checkpoint of an input (options.checkpoint) on rank 0, checking
+ * that the input was only appended to since, and gives every process the
+ * range of bytes to process: from the offset of the checkpoint (0 if there
+ * is none yet) to the end of the last complete line.
+ * @param filename path of twitter file
+ * @param file_length length of twitter file in bytes
+ * @param checkpoint set to the checkpoint (its counts on rank 0 only)
+ * @param end set to the end of the bytes to process (exclusive)
+ */
+void load_checkpoint(const char* filename, long long file_length,
+					 Checkpoint& checkpoint, long long& end) {
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	long long range[2] = {0, 0};
+	if (rank == 0) {
+		bool resumed = read_state(options.checkpoint, checkpoint);
+		long long n = checkpoint.tail.size();
+		if (checkpoint.offset > file_length) {
+			checkpoint_error("the input is shorter than at the checkpoint");
+		}
+		if (read_bytes(filename, checkpoint.offset - n, n) !=
+			checkpoint.tail) {
+			checkpoint_error("the input changed before the offset of the "
+							 "checkpoint (it can only be appended to)");
+		}
+		range[0] = checkpoint.offset;
+		range[1] = std::max(complete_length(filename, file_length),
+							checkpoint.offset);
+		if (resumed) {
+			std::stringstream m;
+			m << "[*] Checkpoint " << options.checkpoint << ": resuming at "
+			  << range[0] << " (new bytes: " << range[1] - range[0] << ")"
+			  << std::endl;
+			std::cerr << m.str();
+		}
+	}
+	MPI_Bcast(range, 2, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+	checkpoint.offset = range[0];
+	end = range[1];
+}
+
+/**
+ * Adds the counts of a checkpoint to the results of a process (rank 0's, so
+ * that they are combined with the new counts).
+ * @param checkpoint checkpoint
+ * @param results pair of lang_freq_map and hashtag_freq_map
+ */
+void add_checkpoint_counts(
+	const Checkpoint& checkpoint,
+	pair<unordered_map<string, unsigned long>,
+		 unordered_map<string, unsigned long>>& results) {
+	for (const auto& it : checkpoint.langs) {
+		results.first[it.first] += it.second;
+	}
+	for (const auto& it : checkpoint.hashtags) {
+		results.second[it.first] += it.second;
+	}
+}
+
+/**
+ * Writes a checkpoint (to options.checkpoint, through a temporary file that
+ * replaces it, so a failed write leaves the previous one).
+ * @param filename path of twitter file (for the bytes before the offset)
+ * @param checkpoint offset and counts to save (the tail is set here)
+ */
+void save_checkpoint(const char* filename, Checkpoint& checkpoint) {
+	long long n = std::min(checkpoint.offset, CHECKPOINT_TAIL);
+	checkpoint.tail = read_bytes(filename, checkpoint.offset - n, n);
+
+	string temporary = options.checkpoint + ".tmp";
+	std::ofstream os(temporary, std::ofstream::binary);
+	os << CHECKPOINT_VERSION << "\n"
+	   << "offset " << checkpoint.offset << "\n"
+	   << "tail " << to_hex(checkpoint.tail) << "\n";
+	write_counts(os, "languages", checkpoint.langs);
+	write_counts(os, "hashtags", checkpoint.hashtags);
+	os.close();
+	if (os.fail() ||
+		std::rename(temporary.c_str(), options.checkpoint.c_str()) != 0) {
+		checkpoint_error(string("cannot be written (") + strerror(errno) +
+						 ")");
+	}
+	std::stringstream m;
+	m << "[*] Checkpoint " << options.checkpoint << ": saved at "
+	  << checkpoint.offset << std::endl;
+	std::cerr << m.str();
+}
+
+/**
+ * Reads a checkpoint, exiting if it is not valid.
+ * @param path path of the checkpoint
+ * @param checkpoint set to the checkpoint
+ * @return whether there is a checkpoint (false if the file does not exist)
+ */
+static bool read_state(const string& path, Checkpoint& checkpoint) {
+	std::ifstream is(path, std::ifstream::binary);
+	if (!is.is_open()) {
+		if (errno == ENOENT) {
+			return false;
+		}
+		checkpoint_error(string("cannot be read (") + strerror(errno) + ")");
+	}
+	string line, word, hex;
+	getline(is, line);
+	if (line != CHECKPOINT_VERSION) {
+		checkpoint_error("not a checkpoint (or of another version)");
+	}
+	is >> word >> checkpoint.offset;
+	if (word != "offset" || checkpoint.offset < 0) {
+		checkpoint_error("invalid offset");
+	}
+	is >> word;
+	getline(is, hex);
+	hex.erase(0, hex.find_first_not_of(' '));
+	checkpoint.tail = from_hex(hex);
+	if (word != "tail" ||
+		(long long)checkpoint.tail.size() !=
+			std::min(checkpoint.offset, CHECKPOINT_TAIL) ||
+		(checkpoint.offset && checkpoint.tail.back() != '\n')) {
+		checkpoint_error("invalid tail");
+	}
+	read_counts(is, "languages", checkpoint.langs);
+	read_counts(is, "hashtags", checkpoint.hashtags);
+	return true;
+}
+
+/**
+ * Reads a section of counts of a checkpoint, exiting if it is not valid.
+ * @param is checkpoint
+ * @param section name of the section, e.g.: "languages"
+ * @param counts set to the counts
+ */
+static void read_counts(std::istream& is, const string& section,
+						unordered_map<string, unsigned long>& counts) {
+	string word, line;
+	unsigned long n = 0;
+	is >> word >> n;
+	getline(is, line);
+	if (word != section || !is) {
+		checkpoint_error("invalid " + section);
+	}
+	for (unsigned long i = 0; i < n; i++) {
+		getline(is, line);
+		size_t space = line.find(' ');
+		char* end;
+		unsigned long count = strtoul(line.c_str(), &end, 10);
+		if (!is || space == string::npos || end != line.c_str() + space) {
+			checkpoint_error("invalid " + section);
+		}
+		counts[line.substr(space + 1)] += count;
+	}
+}
+
+/**
+ * Writes a section of counts of a checkpoint.
+ * @param os checkpoint
+ * @param section name of the section, e.g.: "languages"
+ * @param counts counts
+ */
+static void write_counts(std::ostream& os, const string& section,
+						 const unordered_map<string, unsigned long>& counts) {
+	os << section << " " << counts.size() << "\n";
+	for (const auto& it : counts) {
+		os << it.second << " " << it.first << "\n";
+	}
+}
+
+/**
+ * Finds the end of the last complete ('\n' terminated) line of a file.
+ * @param filename path of the file
+ * @param file_length length of the file in bytes
+ * @return offset after the last '\n' (0 if there is none)
+ */
+static long long complete_length(const char* filename, long long file_length) {
+	for (long long end = file_length; end > 0;) {
+		long long start = std::max(end - SCAN_BLOCK, 0LL);
+		string block = read_bytes(filename, start, end - start);
+		size_t newline = block.rfind('\n');
+		if (newline != string::npos) {
+			return start + newline + 1;
+		}
+		end = start;
+	}
+	return 0;
+}
+
+/**
+ * Reads bytes of a file, exiting if they cannot be read.
+ * @param filename path of the file
+ * @param offset offset of the first byte
+ * @param n number of bytes
+ * @return bytes
+ */
+static string read_bytes(const char* filename, long long offset, long long n) {
+	string bytes(n, '\0');
+	std::ifstream is(filename, std::ifstream::binary);
+	is.seekg(offset);
+	if (!is.read(&bytes[0], n)) {
+		std::cerr << "[!] Failed to read " << filename << ", error num:"
+				  << strerror(errno) << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return bytes;
+}
+
+/**
+ * Encodes bytes in hexadecimal, e.g.: "\r\n" -> "0d0a".
+ */
+static string to_hex(const string& bytes) {
+	static const char digits[] = "0123456789abcdef";
+	string hex;
+	for (unsigned char c : bytes) {
+		hex += digits[c >> 4];
+		hex += digits[c & 15];
+	}
+	return hex;
+}
+
+/**
+ * Decodes hexadecimal, exiting if it is not valid, e.g.: "0d0a" -> "\r\n".
+ */
+static string from_hex(const string& hex) {
+	if (hex.size() % 2 != 0 ||
+		hex.find_first_not_of("0123456789abcdef") != string::npos) {
+		checkpoint_error("invalid tail");
+	}
+	string bytes;
+	for (size_t i = 0; i < hex.size(); i += 2) {
+		bytes += (char)std::stoi(hex.substr(i, 2), nullptr, 16);
+	}
+	return bytes;
+}
+
+/**
+ * Exits on a checkpoint that cannot be used.
+ * @param message what is wrong, e.g.: "invalid offset"
+ */
+static void checkpoint_error(const string& message) {
+	std::cerr << "[!] Checkpoint " << options.checkpoint << ": " << message
+			  << std::endl;
+	std::exit(EXIT_FAILURE);
+}
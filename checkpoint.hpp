@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * State saved by --checkpoint: the counts of the input up to offset, the
+ * start of a line (the byte before it is a '\n'), and the bytes before it
+ * (to check that the input was only appended to since).
+ */
+struct Checkpoint {
+	long long offset = 0;
+	std::string tail;
+	std::unordered_map<std::string, unsigned long> langs;
+	std::unordered_map<std::string, unsigned long> hashtags;
+};
+
+/**
+ * Reads the checkpoint of an input on rank 0 (an empty one if there is none
+ * yet), and gives every process the range of bytes to process.
+ */
+void load_checkpoint(const char* filename, long long file_length,
+					 Checkpoint& checkpoint, long long& end);
+
+/**
+ * Adds the counts of a checkpoint to the results of a process.
+ */
+void add_checkpoint_counts(
+	const Checkpoint& checkpoint,
+	std::pair<std::unordered_map<std::string, unsigned long>,
+			  std::unordered_map<std::string, unsigned long>>& results);
+
+/**
+ * Writes a checkpoint of an input (on rank 0).
+ */
+void save_checkpoint(const char* filename, Checkpoint& checkpoint);
@@ -4,58 +4,59 @@
 #include <cstdlib>
 #include <functional>
 #include <iostream>
-#include <iterator>
 #include <mpi.h>
-#include <sstream>
 #include <string.h>
 #include <unordered_map>
 #include <vector>
+#include "combine.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
 
 using std::pair;
 using std::string;
 using std::unordered_map;
 
-// Function prototypes
-void combine_maps(unordered_map<string, unsigned long>& freq_map, int rank,
-				  int size);
-
-void easy_print(unordered_map<string, unsigned long>& map,
-				const std::function<string(string)>& printer);
-
-string format_number(string number_str);
-
-string format_lang(unordered_map<string, string> lang_map,
-				   const string& short_lang);
-
 /**
  * Calls on functions to combine results from multiple processes together and
  * print them.
- * @param results pair of lang_freq_map and hashtag_freq_map (pair)
+ * @param results pair of lang_freq_map and hashtag_freq_map (pair), combined
+ * in place (the totals are left in rank 0's)
  * @param rank rank of the running process in the group of comm (integer)
  * @param size number of processes in the group of comm (integer)
  * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
  */
-void combine_results(const pair<unordered_map<string, unsigned long>,
-								unordered_map<string, unsigned long>>& results,
+void combine_results(pair<unordered_map<string, unsigned long>,
+						  unordered_map<string, unsigned long>>& results,
 					 int rank, int size,
 					 const unordered_map<string, string>& lang_map) {
 	// Extract from pair
-	unordered_map<string, unsigned long> combined_lang_freq = results.first;
-	unordered_map<string, unsigned long> combined_hashtag_freq =
+	unordered_map<string, unsigned long>& combined_lang_freq = results.first;
+	unordered_map<string, unsigned long>& combined_hashtag_freq =
 		results.second;
 
 	// Combine and print
 	combine_maps(combined_lang_freq, rank, size);
 	combine_maps(combined_hashtag_freq, rank, size);
+	if (rank == 0) {
+		print_results(combined_lang_freq, combined_hashtag_freq, lang_map);
+	}
+}
 
+/**
+ * Prints the top TOP_K languages and hashtags.
+ * @param lang_freq combined map of <language, count>
+ * @param hashtag_freq combined map of <hashtag, count>
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+void print_results(unordered_map<string, unsigned long>& lang_freq,
+				   unordered_map<string, unsigned long>& hashtag_freq,
+				   const unordered_map<string, string>& lang_map) {
 	std::function<string(string)> lang_printer =
 		std::bind(format_lang, lang_map, std::placeholders::_1);
-	if (rank == 0) {
-		std::cout << std::endl << "[*] Language Freq Results" << std::endl;
-		easy_print(combined_lang_freq, lang_printer);
-		std::cout << std::endl << "[*] Hashtag Freq Results" << std::endl;
-		easy_print(combined_hashtag_freq, [](string key) { return key; });
-	}
+	std::cout << std::endl << "[*] Language Freq Results" << std::endl;
+	easy_print(lang_freq, lang_printer);
+	std::cout << std::endl << "[*] Hashtag Freq Results" << std::endl;
+	easy_print(hashtag_freq, [](string key) { return key; });
 }
 
 /**
@@ -87,12 +88,13 @@ string format_lang(unordered_map<string, string> lang_map,
 }
 
 /**
- * Prints top 10 of <string, unsigned long> maps.
+ * Prints top k of <string, unsigned long> maps.
  * @param map combined map of languages or hashtags (unordered_map)
  * @param printer function pointer to format key (pointer)
+ * @param k number of keys printed (and any ties of the k-th), e.g.: TOP_K
  */
 void easy_print(unordered_map<string, unsigned long>& map,
-				const std::function<string(string)>& printer) {
+				const std::function<string(string)>& printer, size_t k) {
 	unordered_map<string, unsigned long>::iterator it;
 
 	// Put items of map into vector as pairs for sorting
@@ -104,50 +106,76 @@ void easy_print(unordered_map<string, unsigned long>& map,
 				  return a.second > b.second;
 			  });
 
-	// Get frequency of 10th element
-	unsigned long freq = pairs[std::min(9UL, pairs.size() - 1)].second;
+	if (pairs.empty() || k == 0) {
+		return;
+	}
+
+	// Get frequency of k-th element
+	unsigned long freq = pairs[std::min(k, pairs.size()) - 1].second;
 
-	// Print up to 10th element (and any ties for 10th place)
-	for (int i = 0; pairs[i].second >= freq; i++) {
+	// Print up to k-th element (and any ties for k-th place)
+	for (size_t i = 0; i < pairs.size() && pairs[i].second >= freq; i++) {
 		std::cout << i + 1 << ". " << printer(pairs[i].first) << ", "
 				  << format_number(std::to_string(pairs[i].second))
 				  << std::endl;
 	}
 }
+/**
+ * Serialises a map into its keys (each null terminated, as keys of other
+ * counts, e.g.: places, can have commas) and their frequencies.
+ * @param freq_map frequency map of languages or hashtags (unordered_map)
+ * @param keys set to the keys, e.g.: "#a\0#b\0"
+ * @param frequencies set to the frequencies of the keys, e.g.: {2, 1}
+ */
+void serialize_map(const unordered_map<string, unsigned long>& freq_map,
+				   string& keys, std::vector<unsigned long>& frequencies) {
+	keys.clear();
+	frequencies.clear();
+	for (const auto& it : freq_map) {
+		keys.append(it.first);
+		keys.push_back('\0');
+		frequencies.push_back(it.second);
+	}
+}
+
+/**
+ * Merges serialised keys and frequencies into a map.
+ * @param keys null terminated keys, e.g.: "#a\0#b\0"
+ * @param frequencies frequencies of the keys
+ * @param count number of keys
+ * @param freq_map frequency map of languages or hashtags (unordered_map)
+ */
+void deserialize_map(char* keys, const unsigned long* frequencies,
+					 unsigned long count,
+					 unordered_map<string, unsigned long>& freq_map) {
+	char* code = keys;
+	for (unsigned long f = 0; f < count; f++) {
+		freq_map[code] += frequencies[f];
+		code += strlen(code) + 1;
+	}
+}
+
 /**
  * Send maps (results) to the destination MPI process.
  * @param dest the rank of the destination process
  * @param freq_map frequency map of languages or hashtags (unordered_map)
  */
 void send_results(int dest, unordered_map<string, unsigned long>& freq_map) {
-	std::vector<string> keys;
+	string keys;
 	std::vector<unsigned long> frequencies;
-
-	// Elements in map to 2 vectors
-	unordered_map<string, unsigned long>::iterator it;
-	for (it = freq_map.begin(); it != freq_map.end(); it++) {
-		keys.push_back(it->first);
-		frequencies.push_back(it->second);
-	}
-
-	// Combine keys to comma separated string
-	// Adapted from stackoverflow 5689003
-	std::stringstream combined;
-	std::copy(keys.begin(), keys.end(),
-			  std::ostream_iterator<string>(combined, ","));
+	serialize_map(freq_map, keys, frequencies);
 
 	// Number of key/value pairs
 	unsigned long count = frequencies.size();
 	// Length of key string
-	unsigned long length = combined.str().length();
+	unsigned long length = keys.length();
 
 	// Send all to first process
 	MPI_Send(&count, 1, MPI_UNSIGNED_LONG, dest, 0, MPI_COMM_WORLD);
 	MPI_Send(&length, 1, MPI_UNSIGNED_LONG, dest, 1, MPI_COMM_WORLD);
 	MPI_Send(&frequencies[0], (int)count, MPI_UNSIGNED_LONG, dest, 2,
 			 MPI_COMM_WORLD);
-	MPI_Send(combined.str().c_str(), (int)length, MPI_CHAR, dest, 3,
-			 MPI_COMM_WORLD);
+	MPI_Send(keys.c_str(), (int)length, MPI_CHAR, dest, 3, MPI_COMM_WORLD);
 }
 
 /**
@@ -177,33 +205,38 @@ void recv_results(int source, unordered_map<string, unsigned long>& freq_map) {
 	keys[length] = '\0';
 
 	// Merge frequencies into rank 0's map
-	char* code = strtok(keys, ",");
-	for (unsigned long f = 0; f < count; f++) {
-		if (freq_map.end() != freq_map.find(code)) {
-			freq_map[code] += frequencies[f];
-		} else {
-			freq_map[code] = frequencies[f];
-		}
-		code = strtok(nullptr, ",");
-	}
+	deserialize_map(keys, frequencies, count, freq_map);
 	free(frequencies);
 	free(keys);
 }
 
 /**
  * Combine maps (results) from multiple MPI processes together.
+ * At each level, processes that are an odd multiple of s send their maps to
+ * the process s below them, so rank 0 ends up with every map (for any number
+ * of processes).
  * @param freq_map frequency map of languages or hashtags (unordered_map)
  * @param rank rank of the running process in the group of comm (integer)
  * @param size number of processes in the group of comm (integer)
  */
 void combine_maps(unordered_map<string, unsigned long>& freq_map, int rank,
 				  int size) {
-	for (int s = size / 2; s > 0; s >>= 1) {
-		if (rank < s) {
-			recv_results(s + rank, freq_map);
-		} else if (rank < 2 * s) {
+	int level = 0;
+	for (int s = 1; s < size; s <<= 1, level++) {
+		stage_start();
+		double start = trace_now();
+		if (rank % (2 * s) == s) {
 			send_results(rank - s, freq_map);
+			trace_combine("send", start, level, rank - s);
+		} else if (rank % (2 * s) == 0 && rank + s < size) {
+			recv_results(rank + s, freq_map);
+			trace_combine("recv", start, level, rank + s);
 		}
+		start = trace_now();
 		MPI_Barrier(MPI_COMM_WORLD);
+		trace_combine("barrier", start, level, -1);
+		if (level < MAX_COMBINE_LEVELS) {
+			stage_lap(COMBINE + level);
+		}
 	}
 }
@@ -1,19 +1,69 @@
+#include <functional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 using std::pair;
 using std::string;
 using std::unordered_map;
 
+// Number of languages and hashtags printed (and any ties of the last)
+static const size_t TOP_K = 10;
+
 /**
  * Calls on functions to combine results from multiple processes together and
  * print them.
  */
-void combine_results(const pair<unordered_map<string, unsigned long>,
-								unordered_map<string, unsigned long>>& results,
+void combine_results(pair<unordered_map<string, unsigned long>,
+						  unordered_map<string, unsigned long>>& results,
 					 int rank, int size,
 					 const unordered_map<string, string>& lang_map);
 
+/**
+ * Prints the top TOP_K languages and hashtags.
+ */
+void print_results(unordered_map<string, unsigned long>& lang_freq,
+				   unordered_map<string, unsigned long>& hashtag_freq,
+				   const unordered_map<string, string>& lang_map);
+
+/**
+ * Prints top k of <string, unsigned long> maps.
+ */
+void easy_print(unordered_map<string, unsigned long>& map,
+				const std::function<string(string)>& printer,
+				size_t k = TOP_K);
+
+/**
+ * Formats a number with thousands separators, e.g.: "6743991" -> "6,743,991".
+ */
+string format_number(string number_str);
+
+/**
+ * Maps a language from language identifier to real name.
+ */
+string format_lang(unordered_map<string, string> lang_map,
+				   const string& short_lang);
+
+/**
+ * Combine maps (results) from multiple MPI processes together (into rank
+ * 0's).
+ */
+void combine_maps(unordered_map<string, unsigned long>& freq_map, int rank,
+				  int size);
+
+/**
+ * Serialises a map into its keys (null terminated) and their frequencies.
+ */
+void serialize_map(const unordered_map<string, unsigned long>& freq_map,
+				   string& keys, std::vector<unsigned long>& frequencies);
+
+/**
+ * Merges serialised keys and frequencies into a map.
+ */
+void deserialize_map(char* keys, const unsigned long* frequencies,
+					 unsigned long count,
+					 unordered_map<string, unsigned long>& freq_map);
+
 /**
  * Send maps (results) to the destination MPI process.
  */
@@ -0,0 +1,216 @@
+// Frequency table used by threads to count hashtags and languages
+// Counting is the hot path once a tweet is parsed, so the table is an open
+// addressing table rather than std::unordered_map (one node per key)
+
+// References:
+// https://gcc.gnu.org/onlinedocs/gcc/Other-Builtins.html (__builtin_prefetch)
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "freq_table.hpp"
+#include "key_hash.hpp"
+
+using std::string;
+using std::unordered_map;
+
+// How many keys ahead of the key being counted to prefetch its slot
+static const size_t PREFETCH_DISTANCE = 16;
+
+/**
+ * Adds a key to the batch, hashing it now so that its slot can be
+ * prefetched when the batch is counted.
+ * @param key key bytes
+ * @param length number of bytes in key
+ */
+void KeyBatch::add(const char* key, size_t length) {
+	BatchKey k{hash_bytes(key, length), (uint32_t)bytes.size(),
+			   (uint32_t)length};
+	bytes.insert(bytes.end(), key, key + length);
+	keys.push_back(k);
+}
+
+/**
+ * Case folds and hashes a key (lower_hash) straight into the batch bytes.
+ * The key is not counted unless it is then passed to push.
+ * @param key key bytes, e.g.: "#ANice_Day"
+ * @param length number of bytes in key
+ * @return the folded key, e.g.: "#anice_day"
+ */
+BatchKey KeyBatch::lower(const char* key, size_t length) {
+	// Room for lower_hash to write into (see lower_hash)
+	size_t offset = bytes.size(), folded_length;
+	bytes.resize(offset + 2 * length + 16);
+	uint64_t hash =
+		lower_hash(key, length, bytes.data() + offset, folded_length);
+	bytes.resize(offset + folded_length);
+	return BatchKey{hash, (uint32_t)offset, (uint32_t)folded_length};
+}
+
+/**
+ * Removes the bytes of a key from the batch (the last key passed to lower).
+ * @param key key returned by lower
+ */
+void KeyBatch::drop(const BatchKey& key) {
+	bytes.resize(key.offset);
+}
+
+/**
+ * Empties the batch (keeping its memory for the next group of tweets).
+ */
+void KeyBatch::clear() {
+	bytes.clear();
+	keys.clear();
+}
+
+/**
+ * @param capacity number of keys the table can hold before growing
+ */
+FreqTable::FreqTable(size_t capacity) : used(0), mask(0) {
+	reserve(capacity);
+}
+
+/**
+ * Adds to the frequency of a key, inserting it if it is not present.
+ * @param key key (string), e.g.: "#hashtag"
+ * @param by amount to add
+ */
+void FreqTable::increment(const string& key, unsigned long by) {
+	increment(hash_bytes(key.data(), key.length()), key.data(), key.length(),
+			  by);
+}
+
+/**
+ * Adds to the frequency of a key, inserting it if it is not present.
+ * @param key key bytes
+ * @param length number of bytes in key
+ * @param by amount to add
+ */
+void FreqTable::increment(const char* key, size_t length, unsigned long by) {
+	increment(hash_bytes(key, length), key, length, by);
+}
+
+/**
+ * Adds to the frequency of a key whose hash is already known.
+ * @param hash hash_bytes(key, length)
+ * @param key key bytes
+ * @param length number of bytes in key
+ * @param by amount to add
+ */
+void FreqTable::increment(uint64_t hash, const char* key, size_t length,
+						  unsigned long by) {
+	if (by == 0) {
+		return;
+	}
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		Slot& s = slots[i];
+		if (s.count == 0) {
+			// Empty slot, insert key
+			if ((used + 1) * 10 > slots.size() * 7) {
+				reserve(used + 1);
+				increment(hash, key, length, by);
+				return;
+			}
+			if (arena.size() + length > UINT32_MAX) {
+				std::cerr << "Frequency table key arena is full" << std::endl;
+				std::exit(EXIT_FAILURE);
+			}
+			s.hash = hash;
+			s.count = by;
+			s.offset = (uint32_t)arena.size();
+			s.length = (uint32_t)length;
+			arena.insert(arena.end(), key, key + length);
+			used++;
+			return;
+		}
+		if (s.hash == hash && s.length == length &&
+			memcmp(arena.data() + s.offset, key, length) == 0) {
+			s.count += by;
+			return;
+		}
+	}
+}
+
+/**
+ * Increments the frequency of every key in the batch by 1.
+ * Slots are prefetched PREFETCH_DISTANCE keys ahead (and the stored key
+ * bytes half as far ahead), so that the cache misses of a large table
+ * overlap instead of being paid one after another.
+ * @param batch keys to count
+ */
+void FreqTable::increment_batch(const KeyBatch& batch) {
+	const BatchKey* keys = batch.keys.data();
+	const char* bytes = batch.bytes.data();
+	size_t n = batch.keys.size();
+
+	// Grow first, prefetched addresses must stay valid for the whole batch
+	reserve(used + n);
+
+	for (size_t i = 0; i < n; i++) {
+		if (i + PREFETCH_DISTANCE < n) {
+			__builtin_prefetch(&slots[keys[i + PREFETCH_DISTANCE].hash & mask]);
+		}
+		if (i + PREFETCH_DISTANCE / 2 < n) {
+			const BatchKey& k = keys[i + PREFETCH_DISTANCE / 2];
+			const Slot& s = slots[k.hash & mask];
+			if (s.count && s.hash == k.hash) {
+				__builtin_prefetch(arena.data() + s.offset);
+			}
+		}
+		increment(keys[i].hash, bytes + keys[i].offset, keys[i].length);
+	}
+}
+
+/**
+ * Adds the frequencies of another table into this one.
+ * @param other table to merge from
+ */
+void FreqTable::merge(const FreqTable& other) {
+	reserve(used + other.used);
+	for (const Slot& s : other.slots) {
+		if (s.count) {
+			increment(s.hash, other.arena.data() + s.offset, s.length,
+					  s.count);
+		}
+	}
+}
+
+/**
+ * Copies the table into an unordered_map.
+ * @return map of <key, frequency> pairs
+ */
+unordered_map<string, unsigned long> FreqTable::to_map() const {
+	unordered_map<string, unsigned long> map(used);
+	for_each([&map](const char* key, size_t length, unsigned long count) {
+		map.emplace(string(key, length), count);
+	});
+	return map;
+}
+
+/**
+ * Grows the table (if needed) so that n keys fit under the load factor.
+ * @param n number of keys
+ */
+void FreqTable::reserve(size_t n) {
+	size_t capacity = 16;
+	while (n * 10 > capacity * 7) {
+		capacity <<= 1;
+	}
+	if (capacity <= slots.size()) {
+		return;
+	}
+
+	// Reinsert existing slots using their stored hashes
+	std::vector<Slot> old(capacity, Slot{0, 0, 0, 0});
+	old.swap(slots);
+	mask = capacity - 1;
+	for (const Slot& s : old) {
+		if (s.count) {
+			size_t i = s.hash & mask;
+			while (slots[i].count) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = s;
+		}
+	}
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A key collected into a KeyBatch, with its hash computed up front.
+ */
+struct BatchKey {
+	uint64_t hash;
+	uint32_t offset;
+	uint32_t length;
+};
+
+/**
+ * Keys collected from a group of tweets, counted together by
+ * FreqTable::increment_batch.
+ */
+struct KeyBatch {
+	std::vector<char> bytes;
+	std::vector<BatchKey> keys;
+
+	void add(const char* key, size_t length);
+	BatchKey lower(const char* key, size_t length);
+	void drop(const BatchKey& key);
+	void push(const BatchKey& key) {
+		keys.push_back(key);
+	}
+	size_t size() const {
+		return keys.size();
+	}
+	void clear();
+};
+
+/**
+ * Set of the distinct keys of one tweet (lowered into a KeyBatch), held in a
+ * fixed-capacity array on the stack. While the set holds fewer than
+ * LINEAR_LIMIT keys, duplicates are found by a linear scan (comparing hashes
+ * first); past that, keys are appended as they come and duplicates are
+ * removed by sorting, when the set is read with for_each.
+ */
+template <size_t N, size_t LINEAR_LIMIT = 16> class SmallKeySet {
+  public:
+	/**
+	 * @param bytes bytes of the batch that keys are lowered into
+	 */
+	explicit SmallKeySet(const std::vector<char>& bytes)
+		: bytes(bytes), n(0) {}
+
+	/**
+	 * Adds a key, unless the set is full or it is found to be a duplicate.
+	 * @return whether the key was added
+	 */
+	bool insert(const BatchKey& key) {
+		if (n == N) {
+			return false;
+		}
+		if (n < LINEAR_LIMIT) {
+			for (size_t i = 0; i < n; i++) {
+				if (equal(keys[i], key)) {
+					return false;
+				}
+			}
+		}
+		keys[n++] = key;
+		return true;
+	}
+
+	/**
+	 * Calls f(key) for every distinct key in the set.
+	 */
+	template <typename F> void for_each(F f) {
+		if (n > LINEAR_LIMIT) {
+			std::sort(keys, keys + n, [this](const BatchKey& a,
+											 const BatchKey& b) {
+				if (a.hash != b.hash) {
+					return a.hash < b.hash;
+				}
+				if (a.length != b.length) {
+					return a.length < b.length;
+				}
+				return memcmp(bytes.data() + a.offset,
+							  bytes.data() + b.offset, a.length) < 0;
+			});
+		}
+		for (size_t i = 0; i < n; i++) {
+			if (n <= LINEAR_LIMIT || i == 0 || !equal(keys[i - 1], keys[i])) {
+				f(keys[i]);
+			}
+		}
+	}
+
+  private:
+	const std::vector<char>& bytes;
+	BatchKey keys[N];
+	size_t n;
+
+	bool equal(const BatchKey& a, const BatchKey& b) const {
+		return a.hash == b.hash && a.length == b.length &&
+			   memcmp(bytes.data() + a.offset, bytes.data() + b.offset,
+					  a.length) == 0;
+	}
+};
+
+/**
+ * Open addressing (linear probing) table of <key, frequency> pairs.
+ * Keys are copied into an arena owned by the table, and every slot keeps the
+ * hash of its key so that growing and merging never rehash strings.
+ */
+class FreqTable {
+  public:
+	explicit FreqTable(size_t capacity = 64);
+
+	void increment(const std::string& key, unsigned long by = 1);
+	void increment(const char* key, size_t length, unsigned long by = 1);
+	void increment(uint64_t hash, const char* key, size_t length,
+				   unsigned long by = 1);
+	void increment_batch(const KeyBatch& batch);
+	void merge(const FreqTable& other);
+
+	size_t size() const {
+		return used;
+	}
+	std::unordered_map<std::string, unsigned long> to_map() const;
+
+	/**
+	 * Calls f(key, length, frequency) for every key in the table.
+	 */
+	template <typename F> void for_each(F f) const {
+		for (const Slot& s : slots) {
+			if (s.count) {
+				f(arena.data() + s.offset, (size_t)s.length, s.count);
+			}
+		}
+	}
+
+  private:
+	struct Slot {
+		uint64_t hash;
+		unsigned long count;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<char> arena;
+	size_t used;
+	size_t mask;
+
+	void reserve(size_t n);
+};
@@ -0,0 +1,593 @@
+// Group-by engine (--group-by)
+// Dimensions are extractors of the keys of a tweet (its language, hashtags,
+// user, mentions, link domains, ...), registered in DIMENSIONS. --group-by
+// names groups of one or more dimensions, e.g.: "user,place,lang+hour", and
+// each group is counted in a table of its own, keyed by every combination of
+// the keys of its dimensions, from the fields extracted for the tweet in the
+// one pass. The tables are merged across threads and combined across
+// processes like the other counts, and the top keys of each are printed. A
+// new dimension only needs an entry in DIMENSIONS (and its field in Tweet, if
+// it is new)
+//
+// The tables that are kept anyway are not counted again: a group of the
+// language or of the hashtags alone is read from the language or hashtag
+// table of the results, and one of both from the hashtags per language of
+// --by-lang (which are then counted even without it)
+//
+// TweetCounts also holds the other counts kept besides the languages and
+// hashtags (--buckets, --pairs and --by-lang), so that they all share one
+// path through the threads and processes
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <strings.h>
+#include "combine.hpp"
+#include "groups.hpp"
+#include "options.hpp"
+
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+// Separator of the keys of the dimensions of a group in its keys
+static const char GROUP_KEY_SEPARATOR = '\x1f';
+
+// Keys collected before they are counted together
+static const size_t GROUP_BATCH_SIZE = 256;
+
+// Unique mentions or domains of a tweet that are counted (as for hashtags)
+static const size_t MAX_ENTITY_KEYS = 160;
+
+// Table a group is counted in: its own, or one that is kept anyway (see
+// group_table)
+enum class GroupTable { OWN, LANGS, HASHTAGS, LANG_HASHTAGS, HASHTAG_LANGS };
+
+// Function prototypes
+static void lang_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					  size_t first, KeyBatch& keys);
+static void hashtag_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+						 size_t first, KeyBatch& keys);
+static void user_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					  size_t first, KeyBatch& keys);
+static void place_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					   size_t first, KeyBatch& keys);
+static void hour_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					  size_t first, KeyBatch& keys);
+static void mention_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+						 size_t first, KeyBatch& keys);
+static void domain_keys(const Tweet& tweet, const KeyBatch& hashtag_batch,
+						size_t first, KeyBatch& keys);
+static std::string_view url_domain(std::string_view url);
+static string format_key(const string& key,
+						 const unordered_map<string, string>& lang_map);
+static string format_language(const string& key,
+							  const unordered_map<string, string>& lang_map);
+static string format_user(const string& key,
+						  const unordered_map<string, string>& lang_map);
+static string format_hour(const string& key,
+						  const unordered_map<string, string>& lang_map);
+static void add_combinations(const vector<size_t>& group, size_t i,
+							 const vector<KeyBatch>& keys, string& key,
+							 KeyBatch& batch);
+static GroupTable group_table(const vector<size_t>& dimensions);
+static unordered_map<string, unsigned long>
+kept_table(GroupTable table,
+		   const unordered_map<string, unsigned long>& lang_freq,
+		   const unordered_map<string, unsigned long>& hashtag_freq,
+		   const unordered_map<string, unsigned long>& lang_hashtags);
+static void report_groups(
+	TweetCounts& counts, const unordered_map<string, unsigned long>& lang_freq,
+	const unordered_map<string, unsigned long>& hashtag_freq,
+	const unordered_map<string, unsigned long>& lang_hashtags, int rank,
+	int size, const unordered_map<string, string>& lang_map);
+
+// Dimensions that tweets can be grouped by
+static const Dimension DIMENSIONS[] = {
+	{"lang", "Language", TweetFields::CORE, lang_keys, format_language},
+	{"hashtag", "Hashtag", TweetFields::CORE, hashtag_keys, format_key},
+	{"user", "User", TweetFields::ALL, user_keys, format_user},
+	{"place", "Place", TweetFields::ALL, place_keys, format_key},
+	{"hour", "Hour", TweetFields::CORE, hour_keys, format_hour},
+	{"mention", "Mention", TweetFields::ENTITIES, mention_keys, format_user},
+	{"domain", "Domain", TweetFields::ENTITIES, domain_keys, format_key},
+};
+static const size_t N_DIMENSIONS = sizeof(DIMENSIONS) / sizeof(Dimension);
+
+// Indexes in DIMENSIONS of the language and the hashtags
+static const size_t LANG = 0;
+static const size_t HASHTAG = 1;
+
+// Groups of --group-by (the indexes of their dimensions in DIMENSIONS), the
+// table each is counted in, and the dimensions in any group with a table of
+// its own
+static vector<vector<size_t>> group_dimensions;
+static vector<GroupTable> group_tables;
+static vector<size_t> used_dimensions;
+
+// Whether the hashtags per language are counted (for --by-lang or a group)
+static bool lang_hashtags_kept;
+
+/**
+ * Reads the groups of --group-by, e.g.: "user,lang+hour", exiting if a
+ * dimension is unknown or repeated in a group, and has the fields they need
+ * extracted. Called before any TweetCounts is made.
+ * @return whether any counts besides the languages and hashtags are kept
+ */
+bool init_counts() {
+	group_dimensions.clear();
+	group_tables.clear();
+	used_dimensions.clear();
+	lang_hashtags_kept = options.by_lang;
+	TweetFields fields = TweetFields::CORE;
+	size_t start = 0;
+	const string& spec = options.group_by;
+	while (start < spec.size()) {
+		size_t end = spec.find(',', start);
+		end = end == string::npos ? spec.size() : end;
+		string group = spec.substr(start, end - start);
+		vector<size_t> dimensions;
+		size_t p = 0;
+		while (p <= group.size()) {
+			size_t q = group.find('+', p);
+			q = q == string::npos ? group.size() : q;
+			string name = group.substr(p, q - p);
+			size_t d = 0;
+			while (d < N_DIMENSIONS && name != DIMENSIONS[d].name) {
+				d++;
+			}
+			if (d == N_DIMENSIONS) {
+				std::cerr << "Unknown dimension: " << name << " (";
+				for (size_t i = 0; i < N_DIMENSIONS; i++) {
+					std::cerr << (i ? ", " : "") << DIMENSIONS[i].name;
+				}
+				std::cerr << ")" << std::endl;
+				std::exit(EXIT_FAILURE);
+			}
+			for (size_t other : dimensions) {
+				if (other == d) {
+					std::cerr << "Dimension repeated in group: " << group
+							  << std::endl;
+					std::exit(EXIT_FAILURE);
+				}
+			}
+			dimensions.push_back(d);
+			fields = std::max(fields, DIMENSIONS[d].fields);
+			p = q + 1;
+		}
+		GroupTable table = group_table(dimensions);
+		for (size_t d : dimensions) {
+			bool used = table != GroupTable::OWN;
+			for (size_t u : used_dimensions) {
+				used = used || u == d;
+			}
+			if (!used) {
+				used_dimensions.push_back(d);
+			}
+		}
+		lang_hashtags_kept = lang_hashtags_kept ||
+							 table == GroupTable::LANG_HASHTAGS ||
+							 table == GroupTable::HASHTAG_LANGS;
+		group_dimensions.push_back(dimensions);
+		group_tables.push_back(table);
+		start = end + 1;
+	}
+	extract_fields(fields);
+	return !group_dimensions.empty() || options.buckets != Buckets::NONE ||
+		   options.pairs || options.by_lang;
+}
+
+/**
+ * Table a group is counted in: the language or hashtag table of the results
+ * for the language or the hashtags alone, the hashtags per language for both
+ * (in either order), or its own.
+ * @param dimensions dimensions of the group
+ * @return table of the group
+ */
+static GroupTable group_table(const vector<size_t>& dimensions) {
+	if (dimensions.size() == 1) {
+		return dimensions[0] == LANG	  ? GroupTable::LANGS
+			   : dimensions[0] == HASHTAG ? GroupTable::HASHTAGS
+										  : GroupTable::OWN;
+	}
+	if (dimensions.size() == 2 && dimensions[0] == LANG &&
+		dimensions[1] == HASHTAG) {
+		return GroupTable::LANG_HASHTAGS;
+	}
+	if (dimensions.size() == 2 && dimensions[0] == HASHTAG &&
+		dimensions[1] == LANG) {
+		return GroupTable::HASHTAG_LANGS;
+	}
+	return GroupTable::OWN;
+}
+
+/**
+ * Makes a table for each group (left empty for those counted in a table that
+ * is kept anyway).
+ */
+TweetCounts::TweetCounts()
+	: groups(group_dimensions.size()), batches(group_dimensions.size()),
+	  keys(N_DIMENSIONS) {}
+
+/**
+ * Counts a tweet in every count that is kept.
+ * @param tweet fields of the tweet
+ * @param hashtag_batch batch the hashtags of the tweet were added to
+ * @param first index of the first hashtag of the tweet in the batch
+ */
+void TweetCounts::add(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					  size_t first) {
+	if (options.buckets != Buckets::NONE) {
+		buckets.add(tweet, hashtag_batch, first);
+	}
+	if (options.pairs) {
+		pairs.add(hashtag_batch, first);
+	}
+	if (lang_hashtags_kept) {
+		lang_hashtags.add(tweet.lang, hashtag_batch, first);
+	}
+	if (used_dimensions.empty()) {
+		return;
+	}
+
+	// Keys of the tweet in each dimension, then every combination of them
+	// in each group
+	for (size_t d : used_dimensions) {
+		keys[d].clear();
+		DIMENSIONS[d].extract(tweet, hashtag_batch, first, keys[d]);
+	}
+	for (size_t g = 0; g < group_dimensions.size(); g++) {
+		if (group_tables[g] != GroupTable::OWN) {
+			continue;
+		}
+		key.clear();
+		add_combinations(group_dimensions[g], 0, keys, key, batches[g]);
+		if (batches[g].size() >= GROUP_BATCH_SIZE) {
+			groups[g].increment_batch(batches[g]);
+			batches[g].clear();
+		}
+	}
+}
+
+/**
+ * Counts the keys of the groups collected so far.
+ */
+void TweetCounts::flush() {
+	for (size_t g = 0; g < groups.size(); g++) {
+		groups[g].increment_batch(batches[g]);
+		batches[g].clear();
+	}
+}
+
+/**
+ * Adds the counts of another thread.
+ * @param other counts of the thread
+ */
+void TweetCounts::merge(TweetCounts& other) {
+	other.flush();
+	for (size_t g = 0; g < groups.size(); g++) {
+		groups[g].merge(other.groups[g]);
+	}
+	if (options.buckets != Buckets::NONE) {
+		buckets.merge(other.buckets);
+	}
+	if (options.pairs) {
+		pairs.merge(other.pairs);
+	}
+	if (lang_hashtags_kept) {
+		lang_hashtags.merge(other.lang_hashtags);
+	}
+}
+
+/**
+ * Combines the counts of all processes and prints them: those of
+ * --buckets, --pairs and --by-lang, then the top of each group (called by
+ * all processes).
+ * @param counts counts of this process
+ * @param lang_freq combined map of <language, count> (on rank 0)
+ * @param hashtag_freq combined map of <hashtag, count> (on rank 0)
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+void report_counts(TweetCounts& counts,
+				   const unordered_map<string, unsigned long>& lang_freq,
+				   const unordered_map<string, unsigned long>& hashtag_freq,
+				   int rank, int size,
+				   const unordered_map<string, string>& lang_map) {
+	if (options.buckets != Buckets::NONE) {
+		report_buckets(counts.buckets, rank, size, lang_map);
+	}
+	if (options.pairs) {
+		report_pairs(counts.pairs, rank, size);
+	}
+	unordered_map<string, unsigned long> lang_hashtags;
+	if (lang_hashtags_kept) {
+		lang_hashtags =
+			combine_lang_hashtags(counts.lang_hashtags, rank, size);
+	}
+	if (options.by_lang && rank == 0) {
+		report_lang_hashtags(lang_hashtags, lang_freq, lang_map);
+	}
+	report_groups(counts, lang_freq, hashtag_freq, lang_hashtags, rank, size,
+				  lang_map);
+}
+
+/**
+ * Combines the table of each group across processes and prints its top
+ * options.group_top keys, e.g.: "1. English (en) / 13:00 UTC, 42".
+ * @param counts counts of this process
+ * @param lang_freq combined map of <language, count> (on rank 0)
+ * @param hashtag_freq combined map of <hashtag, count> (on rank 0)
+ * @param lang_hashtags combined map of <language + hashtag, count> (on rank
+ * 0, if they are kept)
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+static void report_groups(
+	TweetCounts& counts, const unordered_map<string, unsigned long>& lang_freq,
+	const unordered_map<string, unsigned long>& hashtag_freq,
+	const unordered_map<string, unsigned long>& lang_hashtags, int rank,
+	int size, const unordered_map<string, string>& lang_map) {
+	counts.flush();
+	for (size_t g = 0; g < group_dimensions.size(); g++) {
+		unordered_map<string, unsigned long> map;
+		if (group_tables[g] == GroupTable::OWN) {
+			map = counts.groups[g].to_map();
+			counts.groups[g] = FreqTable();
+			combine_maps(map, rank, size);
+		}
+		if (rank != 0) {
+			continue;
+		}
+		if (group_tables[g] != GroupTable::OWN) {
+			map = kept_table(group_tables[g], lang_freq, hashtag_freq,
+							 lang_hashtags);
+		}
+
+		const vector<size_t>& group = group_dimensions[g];
+		std::cout << std::endl << "[*] ";
+		for (size_t i = 0; i < group.size(); i++) {
+			std::cout << (i ? " / " : "") << DIMENSIONS[group[i]].title;
+		}
+		std::cout << " Freq Results" << std::endl;
+		easy_print(
+			map,
+			[&group, &lang_map](string key) {
+				string formatted;
+				size_t start = 0;
+				for (size_t i = 0; i < group.size(); i++) {
+					size_t end = i + 1 < group.size()
+									 ? key.find(GROUP_KEY_SEPARATOR, start)
+									 : key.size();
+					formatted += (i ? " / " : "") +
+								 DIMENSIONS[group[i]].format(
+									 key.substr(start, end - start), lang_map);
+					start = end + 1;
+				}
+				return formatted;
+			},
+			options.group_top);
+	}
+}
+
+/**
+ * Keys of a group counted in a table that is kept anyway, as they would be in
+ * a table of its own.
+ * @param table table of the group
+ * @param lang_freq combined map of <language, count>
+ * @param hashtag_freq combined map of <hashtag, count>
+ * @param lang_hashtags combined map of <language + hashtag, count>
+ * @return map of <key, count> of the group
+ */
+static unordered_map<string, unsigned long>
+kept_table(GroupTable table,
+		   const unordered_map<string, unsigned long>& lang_freq,
+		   const unordered_map<string, unsigned long>& hashtag_freq,
+		   const unordered_map<string, unsigned long>& lang_hashtags) {
+	if (table == GroupTable::LANGS) {
+		return lang_freq;
+	}
+	if (table == GroupTable::HASHTAGS) {
+		return hashtag_freq;
+	}
+	unordered_map<string, unsigned long> map(lang_hashtags.size());
+	for (const auto& it : lang_hashtags) {
+		size_t hash = it.first.rfind('#');
+		string lang = it.first.substr(0, hash);
+		string hashtag = it.first.substr(hash);
+		map.emplace(table == GroupTable::LANG_HASHTAGS
+						? lang + GROUP_KEY_SEPARATOR + hashtag
+						: hashtag + GROUP_KEY_SEPARATOR + lang,
+					it.second);
+	}
+	return map;
+}
+
+/**
+ * Adds every combination of the keys of the dimensions of a group from the
+ * i-th on to the batch, each after key (the keys of those before it).
+ * @param group dimensions of the group
+ * @param i index of the dimension in the group
+ * @param keys keys of the tweet in each dimension
+ * @param key keys of the dimensions before the i-th (restored on return)
+ * @param batch batch of the group
+ */
+static void add_combinations(const vector<size_t>& group, size_t i,
+							 const vector<KeyBatch>& keys, string& key,
+							 KeyBatch& batch) {
+	const KeyBatch& dimension = keys[group[i]];
+	size_t length = key.size();
+	for (const BatchKey& k : dimension.keys) {
+		key.resize(length);
+		if (i) {
+			key.push_back(GROUP_KEY_SEPARATOR);
+		}
+		key.append(dimension.bytes.data() + k.offset, k.length);
+		if (i + 1 < group.size()) {
+			add_combinations(group, i + 1, keys, key, batch);
+		} else {
+			batch.add(key.data(), key.size());
+		}
+	}
+	key.resize(length);
+}
+
+/**
+ * Language of a tweet (none if it has none).
+ */
+static void lang_keys(const Tweet& tweet, const KeyBatch&, size_t,
+					  KeyBatch& keys) {
+	if (tweet.lang.data()) {
+		keys.add(tweet.lang.data(), tweet.lang.size());
+	}
+}
+
+/**
+ * Unique (lowercased) hashtags of a tweet, e.g.: "#covid19".
+ */
+static void hashtag_keys(const Tweet&, const KeyBatch& hashtag_batch,
+						 size_t first, KeyBatch& keys) {
+	for (size_t i = first; i < hashtag_batch.size(); i++) {
+		const BatchKey& k = hashtag_batch.keys[i];
+		keys.add(hashtag_batch.bytes.data() + k.offset, k.length);
+	}
+}
+
+/**
+ * Screen name of the user of a tweet, lowercased (as they are not case
+ * sensitive).
+ */
+static void user_keys(const Tweet& tweet, const KeyBatch&, size_t,
+					  KeyBatch& keys) {
+	if (tweet.user.data()) {
+		keys.push(keys.lower(tweet.user.data(), tweet.user.size()));
+	}
+}
+
+/**
+ * Full name of the place of a tweet, e.g.: "Melbourne, Victoria" (none for
+ * most tweets).
+ */
+static void place_keys(const Tweet& tweet, const KeyBatch&, size_t,
+					   KeyBatch& keys) {
+	if (tweet.place.data()) {
+		keys.add(tweet.place.data(), tweet.place.size());
+	}
+}
+
+/**
+ * Hour of the day (UTC) of the created_at of a tweet, e.g.: "13" (none if it
+ * is not valid).
+ */
+static void hour_keys(const Tweet& tweet, const KeyBatch&, size_t,
+					  KeyBatch& keys) {
+	long long seconds;
+	if (parse_created_at(tweet.created_at.data(), tweet.created_at.size(),
+						 seconds)) {
+		char hour[2] = {(char)('0' + seconds / 3600 % 24 / 10),
+						(char)('0' + seconds / 3600 % 24 % 10)};
+		keys.add(hour, 2);
+	}
+}
+
+/**
+ * Unique screen names mentioned in a tweet, lowercased (as for the user).
+ */
+static void mention_keys(const Tweet& tweet, const KeyBatch&, size_t,
+						 KeyBatch& keys) {
+	SmallKeySet<MAX_ENTITY_KEYS> unique(keys.bytes);
+	for (string_view mention : tweet.mentions) {
+		BatchKey key = keys.lower(mention.data(), mention.size());
+		if (!unique.insert(key)) {
+			keys.drop(key);
+		}
+	}
+	unique.for_each([&keys](const BatchKey& key) { keys.push(key); });
+}
+
+/**
+ * Unique domains of the URLs of a tweet, e.g.: "example.com" for
+ * "https://WWW.Example.com:8080/page" (see url_domain).
+ */
+static void domain_keys(const Tweet& tweet, const KeyBatch&, size_t,
+						KeyBatch& keys) {
+	SmallKeySet<MAX_ENTITY_KEYS> unique(keys.bytes);
+	for (string_view url : tweet.urls) {
+		string_view domain = url_domain(url);
+		if (domain.empty()) {
+			continue;
+		}
+		BatchKey key = keys.lower(domain.data(), domain.size());
+		if (!unique.insert(key)) {
+			keys.drop(key);
+		}
+	}
+	unique.for_each([&keys](const BatchKey& key) { keys.push(key); });
+}
+
+/**
+ * Host of a URL without its user, port, "www." or trailing dot (to be
+ * lowercased), e.g.: "Example.com" for "https://user@www.Example.com.:80/".
+ * @param url URL, with or without a scheme
+ * @return host (empty if there is none)
+ */
+static string_view url_domain(string_view url) {
+	size_t start = url.find("://");
+	start = start == string_view::npos ? 0 : start + 3;
+	string_view host = url.substr(start, url.find_first_of("/?#", start) -
+											 start);
+	size_t at = host.rfind('@');
+	if (at != string_view::npos) {
+		host.remove_prefix(at + 1);
+	}
+	if (!host.empty() && host[0] == '[') {
+		// IPv6 address, e.g.: "[::1]:80"
+		size_t close = host.find(']');
+		return close == string_view::npos ? string_view()
+										  : host.substr(0, close + 1);
+	}
+	host = host.substr(0, host.find(':'));
+	if (host.size() > 4 && strncasecmp(host.data(), "www.", 4) == 0) {
+		host.remove_prefix(4);
+	}
+	while (!host.empty() && host.back() == '.') {
+		host.remove_suffix(1);
+	}
+	return host;
+}
+
+/**
+ * Key as it is.
+ */
+static string format_key(const string& key,
+						 const unordered_map<string, string>&) {
+	return key;
+}
+
+/**
+ * Language by name, e.g.: "English (en)".
+ */
+static string format_language(const string& key,
+							  const unordered_map<string, string>& lang_map) {
+	return format_lang(lang_map, key);
+}
+
+/**
+ * User (or mention), e.g.: "@jack".
+ */
+static string format_user(const string& key,
+						  const unordered_map<string, string>&) {
+	return "@" + key;
+}
+
+/**
+ * Hour, e.g.: "13:00 UTC".
+ */
+static string format_hour(const string& key,
+						  const unordered_map<string, string>&) {
+	return key + ":00 UTC";
+}
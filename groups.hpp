@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "buckets.hpp"
+#include "freq_table.hpp"
+#include "lang_hashtags.hpp"
+#include "pairs.hpp"
+#include "tweet.hpp"
+
+/**
+ * A dimension that tweets can be grouped by: an extractor of the keys of a
+ * tweet in it (see DIMENSIONS in groups.cpp).
+ */
+struct Dimension {
+	const char* name;   // in --group-by, e.g.: "hashtag"
+	const char* title;  // in the results, e.g.: "Hashtag"
+	TweetFields fields; // fields it needs extracted (see extract_fields)
+	// Adds the keys of a tweet, whose unique hashtags are the keys of
+	// hashtag_batch from first
+	void (*extract)(const Tweet& tweet, const KeyBatch& hashtag_batch,
+					size_t first, KeyBatch& keys);
+	// Formats a key for the results
+	std::string (*format)(
+		const std::string& key,
+		const std::unordered_map<std::string, std::string>& lang_map);
+};
+
+/**
+ * Counts of a thread (or process) besides the languages and hashtags, all
+ * filled from the fields of each tweet in the same pass: a table for each
+ * group of --group-by, and the counts of --buckets, --pairs and --by-lang.
+ */
+struct TweetCounts {
+	std::vector<FreqTable> groups;
+	std::vector<KeyBatch> batches; // keys of each group yet to be counted
+	std::vector<KeyBatch> keys;    // keys of the tweet in each dimension
+	std::string key;
+	BucketCounts buckets;
+	PairCounts pairs;
+	LangHashtagCounts lang_hashtags;
+
+	TweetCounts();
+	void add(const Tweet& tweet, const KeyBatch& hashtag_batch, size_t first);
+	void flush();
+	void merge(TweetCounts& other);
+};
+
+/**
+ * Reads the groups of --group-by (exiting if they are not valid), before
+ * any TweetCounts is made.
+ * @return whether any counts besides the languages and hashtags are kept
+ */
+bool init_counts();
+
+/**
+ * Combines the counts of all processes and prints them (called by all
+ * processes).
+ */
+void report_counts(TweetCounts& counts,
+				   const std::unordered_map<std::string, unsigned long>&
+					   lang_freq,
+				   const std::unordered_map<std::string, unsigned long>&
+					   hashtag_freq,
+				   int rank, int size,
+				   const std::unordered_map<std::string, std::string>&
+					   lang_map);
@@ -0,0 +1,329 @@
+#pragma once
+
+// SAX handler matching a list of JSON paths that is known at compile time
+// The paths are built into a trie at compile time, and key lookups in each
+// object are generated as a switch on the key's length, then comparisons
+// against the (constant) keys of that length of the object's node, instead
+// of comparing a runtime path stack against strings
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include "include/rapidjson/reader.h"
+
+// Maximum number of nodes in a trie of paths (and depth of a path)
+static const size_t MAX_PATH_NODES = 32;
+
+// Maximum length of a key in a path (the cases of the switch on lengths)
+static const size_t MAX_PATH_KEY_LENGTH = 16;
+
+/**
+ * Node of a trie of paths: an object key, under the node of the object it is
+ * in (node 0 is the root object).
+ */
+struct PathNode {
+	const char* key;
+	size_t length;
+	size_t parent;
+	bool array;
+	int field;
+};
+
+/**
+ * Trie of paths.
+ */
+struct PathTrie {
+	PathNode nodes[MAX_PATH_NODES];
+	size_t size;
+};
+
+/**
+ * Whether the first length characters of a and b are equal (constexpr).
+ */
+constexpr bool path_key_equal(const char* a, const char* b, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Builds the trie of a list of paths, e.g. "doc.entities.hashtags[].text"
+ * (keys separated by ".", with "[]" after a key whose value is an array of
+ * values to match). The index of each path is its field number.
+ * @param paths paths
+ * @param n_paths number of paths
+ * @return trie of paths
+ */
+constexpr PathTrie build_path_trie(const char* const* paths, size_t n_paths) {
+	PathTrie t{};
+	t.nodes[0] = PathNode{"", 0, 0, false, -1};
+	t.size = 1;
+	for (size_t f = 0; f < n_paths; f++) {
+		const char* p = paths[f];
+		size_t parent = 0;
+		while (*p) {
+			// Next key
+			size_t length = 0;
+			while (p[length] && p[length] != '.' && p[length] != '[') {
+				length++;
+			}
+			bool array = p[length] == '[';
+
+			// Find or add node
+			size_t node = t.size;
+			for (size_t i = 1; i < t.size; i++) {
+				if (t.nodes[i].parent == parent &&
+					t.nodes[i].length == length &&
+					path_key_equal(t.nodes[i].key, p, length)) {
+					node = i;
+				}
+			}
+			if (node == t.size) {
+				t.nodes[t.size++] = PathNode{p, length, parent, array, -1};
+			}
+			parent = node;
+
+			p += length + (array ? 2 : 0);
+			if (*p == '.') {
+				p++;
+			}
+		}
+		t.nodes[parent].field = (int)f;
+	}
+	return t;
+}
+
+/**
+ * Length of the longest key in a trie of paths (constexpr).
+ */
+constexpr size_t path_trie_key_length(const PathTrie& t) {
+	size_t length = 0;
+	for (size_t i = 0; i < t.size; i++) {
+		length = t.nodes[i].length > length ? t.nodes[i].length : length;
+	}
+	return length;
+}
+
+/**
+ * Matcher of object keys against the trie of PATHS (an array of paths, see
+ * build_path_trie).
+ */
+template <const auto& PATHS> struct PathMatcher {
+	static constexpr PathTrie TRIE =
+		build_path_trie(PATHS, std::size(PATHS));
+	static constexpr size_t NONE = MAX_PATH_NODES;
+	static_assert(path_trie_key_length(TRIE) <= MAX_PATH_KEY_LENGTH,
+				  "a key of PATHS is longer than MAX_PATH_KEY_LENGTH");
+
+	/**
+	 * Finds the child of node parent whose key is key.
+	 * @param parent node of the object the key is in
+	 * @param key key bytes (not unescaped)
+	 * @param length number of bytes in key
+	 * @return child node (NONE if there is none)
+	 */
+	static inline size_t match(size_t parent, const char* key, size_t length) {
+		return match_parent(parent, key, length,
+							std::make_index_sequence<TRIE.size>());
+	}
+
+  private:
+	/**
+	 * Compares a key of length L against child C of node P (if C is a child
+	 * of P whose key has length L), with the bytes of the child's key as
+	 * constants.
+	 */
+	template <size_t P, size_t L, size_t C>
+	static inline bool match_child(const char* key, size_t& node) {
+		if constexpr (C != 0 && TRIE.nodes[C].parent == P &&
+					  TRIE.nodes[C].length == L) {
+			if (memcmp(key, TRIE.nodes[C].key, L) == 0) {
+				node = C;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <size_t P, size_t L, size_t... Cs>
+	static inline size_t match_length(const char* key,
+									  std::index_sequence<Cs...>) {
+		size_t node = NONE;
+		(match_child<P, L, Cs>(key, node) || ...);
+		return node;
+	}
+
+	template <size_t P, size_t L>
+	static inline size_t match_length(const char* key) {
+		return match_length<P, L>(key, std::make_index_sequence<TRIE.size>());
+	}
+
+	/**
+	 * Finds the child of node P whose key is key, by the children of P with
+	 * the key's length (none for most lengths).
+	 */
+	template <size_t P>
+	static inline size_t match_children(const char* key, size_t length) {
+		switch (length) {
+		case 1:
+			return match_length<P, 1>(key);
+		case 2:
+			return match_length<P, 2>(key);
+		case 3:
+			return match_length<P, 3>(key);
+		case 4:
+			return match_length<P, 4>(key);
+		case 5:
+			return match_length<P, 5>(key);
+		case 6:
+			return match_length<P, 6>(key);
+		case 7:
+			return match_length<P, 7>(key);
+		case 8:
+			return match_length<P, 8>(key);
+		case 9:
+			return match_length<P, 9>(key);
+		case 10:
+			return match_length<P, 10>(key);
+		case 11:
+			return match_length<P, 11>(key);
+		case 12:
+			return match_length<P, 12>(key);
+		case 13:
+			return match_length<P, 13>(key);
+		case 14:
+			return match_length<P, 14>(key);
+		case 15:
+			return match_length<P, 15>(key);
+		case 16:
+			return match_length<P, 16>(key);
+		default:
+			return NONE;
+		}
+	}
+
+	/**
+	 * Dispatches to the comparisons generated for node parent.
+	 */
+	template <size_t... Ps>
+	static inline size_t match_parent(size_t parent, const char* key,
+									  size_t length,
+									  std::index_sequence<Ps...>) {
+		size_t node = NONE;
+		((parent == Ps && (node = match_children<Ps>(key, length), true)) ||
+		 ...);
+		return node;
+	}
+};
+
+/**
+ * rapidjson SAX handler passing the strings found at PATHS (an array of
+ * paths, see build_path_trie) to sink.field(field, string, length).
+ * Everything not on a path is skipped, only counting nesting depth.
+ */
+template <const auto& PATHS, typename Sink>
+class PathHandler
+	: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
+										  PathHandler<PATHS, Sink>> {
+  public:
+	explicit PathHandler(Sink& sink) : sink(sink) {}
+
+	bool StartObject() {
+		if (skip) {
+			skip++;
+		} else if (depth == 0) {
+			push(0, false);
+		} else if (stack[depth - 1].array) {
+			// Element of a matched array
+			push(stack[depth - 1].node, false);
+		} else if (value != NONE && !TRIE.nodes[value].array) {
+			push(value, false);
+		} else {
+			skip = 1;
+		}
+		value = NONE;
+		return true;
+	}
+
+	bool StartArray() {
+		if (skip) {
+			skip++;
+		} else if (depth && !stack[depth - 1].array && value != NONE &&
+				   TRIE.nodes[value].array) {
+			push(value, true);
+		} else {
+			skip = 1;
+		}
+		value = NONE;
+		return true;
+	}
+
+	bool EndObject(rapidjson::SizeType) {
+		return end();
+	}
+
+	bool EndArray(rapidjson::SizeType) {
+		return end();
+	}
+
+	bool Key(const char* str, rapidjson::SizeType length, bool) {
+		if (!skip) {
+			value = Matcher::match(stack[depth - 1].node, str, length);
+		}
+		return true;
+	}
+
+	bool String(const char* str, rapidjson::SizeType length, bool) {
+		if (!skip) {
+			size_t node = stack[depth - 1].array ? stack[depth - 1].node
+												 : value;
+			if (node != NONE && TRIE.nodes[node].field >= 0) {
+				sink.field(TRIE.nodes[node].field, str, length);
+			}
+		}
+		value = NONE;
+		return true;
+	}
+
+	/**
+	 * Other scalars (numbers, booleans and null) are not matched.
+	 */
+	bool Default() {
+		value = NONE;
+		return true;
+	}
+
+  private:
+	using Matcher = PathMatcher<PATHS>;
+	static constexpr const PathTrie& TRIE = Matcher::TRIE;
+	static constexpr size_t NONE = Matcher::NONE;
+
+	struct Level {
+		size_t node;
+		bool array;
+	};
+
+	Sink& sink;
+	Level stack[MAX_PATH_NODES + 1];
+	size_t depth = 0;
+	size_t skip = 0;
+	size_t value = NONE;
+
+	void push(size_t node, bool array) {
+		stack[depth++] = Level{node, array};
+	}
+
+	bool end() {
+		if (skip) {
+			skip--;
+		} else {
+			depth--;
+		}
+		value = NONE;
+		return true;
+	}
+};
@@ -0,0 +1,138 @@
+// Decoding of JSON string escapes, for extractors that find strings without
+// rapidjson (decoding is the same as rapidjson's, including surrogate pairs)
+
+// References:
+// https://www.rfc-editor.org/rfc/rfc8259#section-7
+
+#include <cstdint>
+#include <cstring>
+#include "json_string.hpp"
+
+// Function prototypes
+static bool read_hex4(const char* p, uint32_t& value);
+static size_t write_utf8(uint32_t cp, char* dst);
+
+/**
+ * Decodes the escapes of a JSON string in place. The decoded string is never
+ * longer than the escaped one.
+ * @param str string bytes between the quotes, e.g.: "café\n"
+ * @param length number of bytes in str
+ * @return number of bytes in the decoded string, e.g.: 6, or
+ * INVALID_JSON_STRING (for an unknown escape or a lone high surrogate)
+ */
+size_t unescape_json_string(char* str, size_t length) {
+	char* p = (char*)memchr(str, '\\', length);
+	if (!p) {
+		return length;
+	}
+	const char* end = str + length;
+	const char* src = p;
+	char* dst = p;
+	while (src < end) {
+		if (*src != '\\') {
+			*dst++ = *src++;
+			continue;
+		}
+		if (src + 1 >= end) {
+			return INVALID_JSON_STRING;
+		}
+		switch (src[1]) {
+		case '"':
+		case '\\':
+		case '/':
+			*dst++ = src[1];
+			break;
+		case 'b':
+			*dst++ = '\b';
+			break;
+		case 'f':
+			*dst++ = '\f';
+			break;
+		case 'n':
+			*dst++ = '\n';
+			break;
+		case 'r':
+			*dst++ = '\r';
+			break;
+		case 't':
+			*dst++ = '\t';
+			break;
+		case 'u': {
+			uint32_t cp;
+			if (end - src < 6 || !read_hex4(src + 2, cp)) {
+				return INVALID_JSON_STRING;
+			}
+			if (cp >= 0xD800 && cp <= 0xDBFF) {
+				// High surrogate, which must be followed by a low one
+				uint32_t low;
+				if (end - src < 12 || src[6] != '\\' || src[7] != 'u' ||
+					!read_hex4(src + 8, low) || low < 0xDC00 || low > 0xDFFF) {
+					return INVALID_JSON_STRING;
+				}
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				src += 6;
+			}
+			dst += write_utf8(cp, dst);
+			src += 6;
+			continue;
+		}
+		default:
+			return INVALID_JSON_STRING;
+		}
+		src += 2;
+	}
+	return dst - str;
+}
+
+/**
+ * Reads 4 hexadecimal digits.
+ * @param p digits
+ * @param value set to the value of the digits
+ * @return whether all 4 are hexadecimal digits
+ */
+static bool read_hex4(const char* p, uint32_t& value) {
+	value = 0;
+	for (int i = 0; i < 4; i++) {
+		char c = p[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9') {
+			value |= c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			value |= c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			value |= c - 'A' + 10;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Encodes a code point as UTF-8.
+ * @param cp code point
+ * @param dst where the bytes are written (up to 4)
+ * @return number of bytes written
+ */
+static size_t write_utf8(uint32_t cp, char* dst) {
+	if (cp < 0x80) {
+		dst[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		dst[0] = (char)(0xC0 | (cp >> 6));
+		dst[1] = (char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		dst[0] = (char)(0xE0 | (cp >> 12));
+		dst[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		dst[2] = (char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	dst[0] = (char)(0xF0 | (cp >> 18));
+	dst[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+	dst[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+	dst[3] = (char)(0x80 | (cp & 0x3F));
+	return 4;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+// Returned by unescape_json_string for an invalid escape
+static const size_t INVALID_JSON_STRING = (size_t)-1;
+
+/**
+ * Decodes the escapes of a JSON string (without its quotes) in place and
+ * returns the new length.
+ */
+size_t unescape_json_string(char* str, size_t length);
@@ -0,0 +1,202 @@
+// Hashing and lowercasing of hashtag keys
+// Every hashtag is lowercased and then hashed by the frequency table, so both
+// are done here together, 16 (or 32 with AVX2) bytes at a time (non-ASCII
+// keys are case folded by unicode.cpp instead)
+
+// References:
+// https://github.com/wangyi-fudan/wyhash (mixing function and constants)
+// https://software.intel.com/sites/landingpage/IntrinsicsGuide/
+
+#include <cstring>
+#include "key_hash.hpp"
+#include "unicode.hpp"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Constants from wyhash
+static const uint64_t P0 = 0xa0761d6478bd642fULL;
+static const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t P3 = 0x589965cc75374cc3ULL;
+
+// Function prototypes
+static uint64_t lower_hash_fallback(const char* key, size_t length,
+									char* dst, size_t& dst_length);
+
+/**
+ * Multiplies a and b (to 128 bits) and folds the product to 64 bits.
+ */
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+/**
+ * Mixes one 16 byte block (as two little endian words) into the hash.
+ */
+static inline uint64_t hash_block(uint64_t h, uint64_t a, uint64_t b) {
+	return mix(a ^ P1, b ^ h);
+}
+
+/**
+ * Mixes the key length into the hash.
+ */
+static inline uint64_t hash_finish(uint64_t h, size_t length) {
+	return mix(h ^ P2, (uint64_t)length ^ P3);
+}
+
+#if defined(__SSE2__)
+// Loading 16 bytes from KEEP + 16 - n gives a mask of the first n bytes
+static const signed char KEEP[32] = {-1, -1, -1, -1, -1, -1, -1, -1,
+									 -1, -1, -1, -1, -1, -1, -1, -1};
+
+/**
+ * Loads the last rem (< 16) bytes of a key, padded with zeroes.
+ * The key is read with a single 16 byte load unless that load could cross
+ * into the next page (reading past the key within a page cannot fault).
+ * Copying through a buffer instead stalls on store forwarding.
+ */
+static inline __m128i load_tail(const char* p, size_t rem) {
+	if (((uintptr_t)p & 4095) > 4096 - 16) {
+		char buf[16] = {0};
+		memcpy(buf, p, rem);
+		return _mm_loadu_si128((const __m128i*)buf);
+	}
+	return _mm_and_si128(_mm_loadu_si128((const __m128i*)p),
+						 _mm_loadu_si128((const __m128i*)(KEEP + 16 - rem)));
+}
+
+/**
+ * Lowercases A-Z in a 16 byte vector (bytes >= 0x80 compare as negative, so
+ * they are never in range).
+ */
+static inline __m128i lower16(__m128i x) {
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+								  _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+	return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/**
+ * Mixes a 16 byte vector into the hash.
+ */
+static inline uint64_t hash_vector(uint64_t h, __m128i x) {
+	return hash_block(h, (uint64_t)_mm_cvtsi128_si64(x),
+					  (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(x, x)));
+}
+#endif
+
+#if defined(__AVX2__)
+/**
+ * Lowercases A-Z in a 32 byte vector.
+ */
+static inline __m256i lower32(__m256i x) {
+	__m256i upper =
+		_mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('A' - 1)),
+						 _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), x));
+	return _mm256_or_si256(x,
+						   _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+#endif
+
+/**
+ * Hashes a key, 16 bytes at a time (the last block is padded with zeroes).
+ * @param key key bytes
+ * @param length number of bytes in key
+ * @return hash of key
+ */
+uint64_t hash_bytes(const char* key, size_t length) {
+	uint64_t h = P0;
+	size_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 16 <= length; i += 16) {
+		h = hash_vector(h, _mm_loadu_si128((const __m128i*)(key + i)));
+	}
+	if (i < length) {
+		h = hash_vector(h, load_tail(key + i, length - i));
+	}
+#else
+	uint64_t a, b;
+	for (; i + 16 <= length; i += 16) {
+		memcpy(&a, key + i, 8);
+		memcpy(&b, key + i + 8, 8);
+		h = hash_block(h, a, b);
+	}
+	if (i < length) {
+		char buf[16] = {0};
+		memcpy(buf, key + i, length - i);
+		memcpy(&a, buf, 8);
+		memcpy(&b, buf + 8, 8);
+		h = hash_block(h, a, b);
+	}
+#endif
+	return hash_finish(h, length);
+}
+
+/**
+ * Case folds a key into dst and returns hash_bytes of the folded key.
+ * ASCII keys are lowercased and hashed in the same pass, with vector
+ * compares; keys containing non-ASCII bytes take lower_hash_fallback.
+ * @param key key bytes, e.g.: "#ANice_Day"
+ * @param length number of bytes in key
+ * @param dst where the folded key is written, e.g.: "#anice_day" (the last
+ * block is stored whole and folding can make a key longer, so there must be
+ * room for 2 * length + 16 bytes)
+ * @param dst_length set to the number of bytes in the folded key
+ * @return hash_bytes(dst, dst_length)
+ */
+uint64_t lower_hash(const char* key, size_t length, char* dst,
+					size_t& dst_length) {
+#if defined(__SSE2__)
+	uint64_t h = P0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= length; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(key + i));
+		if (_mm256_movemask_epi8(x)) {
+			return lower_hash_fallback(key, length, dst, dst_length);
+		}
+		x = lower32(x);
+		_mm256_storeu_si256((__m256i*)(dst + i), x);
+		h = hash_vector(h, _mm256_castsi256_si128(x));
+		h = hash_vector(h, _mm256_extracti128_si256(x, 1));
+	}
+#endif
+	for (; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(key + i));
+		if (_mm_movemask_epi8(x)) {
+			return lower_hash_fallback(key, length, dst, dst_length);
+		}
+		x = lower16(x);
+		_mm_storeu_si128((__m128i*)(dst + i), x);
+		h = hash_vector(h, x);
+	}
+	if (i < length) {
+		__m128i x = load_tail(key + i, length - i);
+		if (_mm_movemask_epi8(x)) {
+			return lower_hash_fallback(key, length, dst, dst_length);
+		}
+		x = lower16(x);
+		_mm_storeu_si128((__m128i*)(dst + i), x);
+		h = hash_vector(h, x);
+	}
+	dst_length = length;
+	return hash_finish(h, length);
+#else
+	return lower_hash_fallback(key, length, dst, dst_length);
+#endif
+}
+
+/**
+ * Case folds a key (as UTF-8), then hashes it.
+ * @param key key bytes
+ * @param length number of bytes in key
+ * @param dst where the folded key is written (up to 2 * length bytes)
+ * @param dst_length set to the number of bytes in the folded key
+ * @return hash_bytes(dst, dst_length)
+ */
+static uint64_t lower_hash_fallback(const char* key, size_t length,
+									char* dst, size_t& dst_length) {
+	dst_length = fold_utf8(key, length, dst);
+	return hash_bytes(dst, dst_length);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Hashes a key for use with FreqTable.
+ */
+uint64_t hash_bytes(const char* key, size_t length);
+
+/**
+ * Case folds a key into dst and returns hash_bytes of the folded key, in a
+ * single pass over the key when it is ASCII.
+ */
+uint64_t lower_hash(const char* key, size_t length, char* dst,
+					size_t& dst_length);
@@ -0,0 +1,121 @@
+// Hashtags per language (--by-lang)
+// The hashtags of each tweet are also counted under its language, in the
+// same pass as the other counts: the language and the hashtags are interned
+// per thread and a (language id, hashtag id) key is counted in a PairTable.
+// Thread tables are merged by reinterning, and the counts are combined across
+// processes as language + hashtag keys (e.g.: "th#thailand", split at the
+// last "#", which no hashtag has past its first byte) like the other counts
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "combine.hpp"
+#include "lang_hashtags.hpp"
+#include "options.hpp"
+
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+/**
+ * Counts the (unique) hashtags of a tweet under its language (a tweet without
+ * a language is not counted).
+ * @param lang language of the tweet (null data() for none)
+ * @param hashtag_batch batch the hashtags of the tweet were added to
+ * @param first index of the first hashtag of the tweet in the batch
+ */
+void LangHashtagCounts::add(string_view lang, const KeyBatch& hashtag_batch,
+							size_t first) {
+	if (!lang.data() || first == hashtag_batch.size()) {
+		return;
+	}
+	uint64_t lang_id = (uint64_t)langs.intern(lang) << 32;
+	for (size_t i = first; i < hashtag_batch.size(); i++) {
+		const BatchKey& k = hashtag_batch.keys[i];
+		string_view hashtag(hashtag_batch.bytes.data() + k.offset, k.length);
+		counts.increment(lang_id | hashtags.intern(hashtag));
+	}
+}
+
+/**
+ * Adds the counts of another thread.
+ * @param other counts of the thread (left empty)
+ */
+void LangHashtagCounts::merge(LangHashtagCounts& other) {
+	vector<uint64_t> lang_ids;
+	vector<uint32_t> hashtag_ids;
+	for (const string& key : other.langs.keys) {
+		lang_ids.push_back((uint64_t)langs.intern(key) << 32);
+	}
+	for (const string& key : other.hashtags.keys) {
+		hashtag_ids.push_back(hashtags.intern(key));
+	}
+	other.counts.for_each([&](uint64_t key, unsigned long count) {
+		counts.increment(lang_ids[key >> 32] | hashtag_ids[(uint32_t)key],
+						 count);
+	});
+	other = LangHashtagCounts();
+}
+
+/**
+ * Combines the hashtag counts per language of all processes (called by all
+ * processes).
+ * @param counts counts of this process (left empty)
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @return map of <language + hashtag, count>, e.g.: "th#thailand" (combined
+ * on rank 0)
+ */
+unordered_map<string, unsigned long>
+combine_lang_hashtags(LangHashtagCounts& counts, int rank, int size) {
+	unordered_map<string, unsigned long> keys(counts.counts.size());
+	counts.counts.for_each([&](uint64_t key, unsigned long count) {
+		keys.emplace(counts.langs.keys[key >> 32] +
+						 counts.hashtags.keys[(uint32_t)key],
+					 count);
+	});
+	counts = LangHashtagCounts();
+	combine_maps(keys, rank, size);
+	return keys;
+}
+
+/**
+ * Prints the top options.by_lang_top hashtags of each of the top
+ * options.by_lang languages (by number of tweets).
+ * @param keys combined map of <language + hashtag, count>
+ * @param lang_freq combined map of <language, count>
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+void report_lang_hashtags(
+	const unordered_map<string, unsigned long>& keys,
+	const unordered_map<string, unsigned long>& lang_freq,
+	const unordered_map<string, string>& lang_map) {
+	// Split the keys by language
+	unordered_map<string, unordered_map<string, unsigned long>> by_lang;
+	for (const auto& it : keys) {
+		size_t hash = it.first.rfind('#');
+		by_lang[it.first.substr(0, hash)].emplace(it.first.substr(hash),
+												  it.second);
+	}
+
+	// Top languages by number of tweets (then by code)
+	vector<pair<string, unsigned long>> langs(lang_freq.begin(),
+											  lang_freq.end());
+	std::sort(langs.begin(), langs.end(),
+			  [](const pair<string, unsigned long>& a,
+				 const pair<string, unsigned long>& b) {
+				  return a.second != b.second ? a.second > b.second
+											  : a.first < b.first;
+			  });
+	langs.resize(std::min(langs.size(), (size_t)options.by_lang));
+	for (const auto& lang : langs) {
+		std::cout << std::endl
+				  << "[*] Hashtag Freq Results, "
+				  << format_lang(lang_map, lang.first) << std::endl;
+		easy_print(
+			by_lang[lang.first], [](string key) { return key; },
+			options.by_lang_top);
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "cache.hpp"
+#include "freq_table.hpp"
+#include "pairs.hpp"
+
+/**
+ * Hashtags counted per language (with --by-lang), by the ids of the language
+ * (in the high half of a key) and the hashtag in dictionaries of the thread
+ * (or process).
+ */
+struct LangHashtagCounts {
+	CacheDictionary langs;
+	CacheDictionary hashtags;
+	PairTable counts;
+
+	void add(std::string_view lang, const KeyBatch& hashtag_batch,
+			 size_t first);
+	void merge(LangHashtagCounts& other);
+};
+
+/**
+ * Combines the hashtag counts per language of all processes, by language +
+ * hashtag keys (called by all processes).
+ */
+std::unordered_map<std::string, unsigned long>
+combine_lang_hashtags(LangHashtagCounts& counts, int rank, int size);
+
+/**
+ * Prints the top hashtags of the top languages.
+ */
+void report_lang_hashtags(
+	const std::unordered_map<std::string, unsigned long>& keys,
+	const std::unordered_map<std::string, unsigned long>& lang_freq,
+	const std::unordered_map<std::string, std::string>& lang_map);
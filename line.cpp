@@ -1,101 +1,128 @@
 // Processes and extracts information from individual lines
 
+#include <cstring>
 #include <iostream>
-#include <regex>
-#include <set>
-#include <unordered_map>
-#include "include/rapidjson/document.h"
+#include "freq_table.hpp"
+#include "perf_counters.hpp"
+#include "timing.hpp"
+#include "tweet.hpp"
+#include "unicode.hpp"
 
 using namespace std;
-using namespace rapidjson;
 
-// Function prototype
-string to_lower(string in);
+// Capacity of the per tweet set of hashtags (a tweet of 280 characters
+// cannot have more than 140 hashtags)
+static const size_t MAX_HASHTAGS = 160;
 
-// Pattern used to match hashtags
-string pattern = "#[\\d\\w]+";
-regex pattern_hashtag(pattern);
+// Entity hashtags up to this length are prefixed with "#" on the stack
+static const size_t MAX_HASHTAG_LENGTH = 1024;
+
+// Function prototypes
+size_t find_hashtag(const char* text, size_t length, const char** start);
+void add_hashtag(const char* hashtag, size_t length, KeyBatch& hashtag_batch,
+				 SmallKeySet<MAX_HASHTAGS>& unique_hashtags);
 
 /**
- * Extract language and hashtags from line, and calculate frequencies.
- * @param line line (string), e.g.: "This is a tweet!"
- * @param lang_freq_map frequency map of languages (unordered_map), e.g.:
+ * Extract language and hashtags from line, count the language and collect the
+ * hashtags into a batch to be counted.
+ * @param line line (string), e.g.: "This is a tweet!" (parsed in place)
+ * @param tweet fields of the line (reused from line to line)
+ * @param lang_freq_map frequency table of languages (FreqTable), e.g.:
  * lang_freq_map["en"] -> 42
- * @param hashtag_freq_map frequency map of hashtags (unordered_map), e.g.:
- * hashtag_freq_map["#hashtag"] -> 43
+ * @param hashtag_batch batch that the (unique) hashtags of the tweet are
+ * added to, e.g.: "#hashtag"
+ * @return whether the line is a valid tweet
  */
-void process_line(const string& line,
-				  unordered_map<string, unsigned long>& lang_freq_map,
-				  unordered_map<string, unsigned long>& hashtag_freq_map) {
-	try {
-		// Parse into JSON DOM
-		Document d;
-		d.Parse(line.c_str());
+bool process_line(string& line, Tweet& tweet, FreqTable& lang_freq_map,
+				  KeyBatch& hashtag_batch) {
+	// Parse, extracting only the fields that are counted
+	// (lines that are not valid JSON are skipped)
+	perf_line_start();
+	bool valid = extract_tweet(&line[0], line.length(), tweet);
+	stage_lap(PARSE);
+	perf_lap(PARSE);
+	if (!valid) {
+		return false;
+	}
 
-		// Extract hash tags
-		set<string> unique_hashtags;
-		smatch matched_strings;
+	// Extract hash tags
+	// They are lowercased straight into the batch, with duplicates removed
+	// by a set on the stack (tweets only have a few hashtags)
+	SmallKeySet<MAX_HASHTAGS> unique_hashtags(hashtag_batch.bytes);
 
-		// Extract hash tags from tweet text
-		string tweet_text;
-		tweet_text = d["doc"]["text"].GetString();
-		regex_search(tweet_text, matched_strings, pattern_hashtag);
-		for (auto matched : matched_strings) {
-			if (matched.length()) {
-				string matched_lower = to_lower(matched);
-				unique_hashtags.insert(matched_lower);
-			}
-		}
-
-		// Extract hash tags from doc->entities->hashtags
-		const Value& hashtags = d["doc"]["entities"]["hashtags"];
-		assert(hashtags.IsArray());
-		for (auto& v : hashtags.GetArray()) {
-			string hashtag = "#";
-			hashtag.append(v["text"].GetString());
-			regex_search(hashtag, matched_strings, pattern_hashtag);
-			for (auto filtered : matched_strings) {
-				if (filtered.length() == hashtag.length()) {
-					string filtered_lower = to_lower(filtered);
-					unique_hashtags.insert(filtered_lower);
-				}
-			}
-		}
+	// Extract hash tags from tweet text
+	const char* start;
+	size_t length = find_hashtag(tweet.text.data(), tweet.text.size(), &start);
+	if (length) {
+		add_hashtag(start, length, hashtag_batch, unique_hashtags);
+	}
 
-		// Count freq
-		for (const auto& unique_hashtag : unique_hashtags) {
-			// Whether contains key
-			if (hashtag_freq_map.end() !=
-				hashtag_freq_map.find(unique_hashtag)) {
-				hashtag_freq_map[unique_hashtag] += 1;
-			} else {
-				hashtag_freq_map[unique_hashtag] = 1;
-			}
+	// Extract hash tags from doc->entities->hashtags
+	// (only those that consist of word characters)
+	char hashtag[MAX_HASHTAG_LENGTH] = {'#'};
+	for (string_view tag : tweet.hashtags) {
+		length = tag.size();
+		if (length == 0 || word_run_length(tag.data(), length) != length) {
+			continue;
 		}
-
-		// Extract language
-		string lang = d["doc"]["lang"].GetString();
-		if (lang_freq_map.find(lang) != lang_freq_map.end()) {
-			lang_freq_map[lang] += 1;
+		if (length < MAX_HASHTAG_LENGTH) {
+			memcpy(hashtag + 1, tag.data(), length);
+			add_hashtag(hashtag, length + 1, hashtag_batch, unique_hashtags);
 		} else {
-			lang_freq_map[lang] = 1;
-		}
-	} catch (const std::regex_error& e) {
-		std::cout << "regex_error caught: " << e.what() << std::endl;
-		if (e.code() == std::regex_constants::error_brack) {
-			std::cout << "The code was error_brack" << std::endl;
+			string long_hashtag = "#";
+			long_hashtag.append(tag.data(), length);
+			add_hashtag(long_hashtag.data(), long_hashtag.length(),
+						hashtag_batch, unique_hashtags);
 		}
 	}
-};
+	unique_hashtags.for_each(
+		[&hashtag_batch](const BatchKey& key) { hashtag_batch.push(key); });
+	stage_lap(EXTRACT);
+	perf_lap(EXTRACT);
+
+	// Extract language
+	if (tweet.lang.data()) {
+		lang_freq_map.increment(tweet.lang.data(), tweet.lang.size());
+	}
+	stage_lap(COUNT);
+	perf_lap(COUNT);
+	return true;
+}
 
 /**
- * Transform string to lowercase.
- * @param in input string (string), e.g.: "#ANice_Day"
- * @return lower case equivalent of input string (string), e.g.: "#anice_day"
+ * Lowercases a hashtag into the batch, unless it is already in the set of
+ * hashtags of the tweet.
+ * @param hashtag hashtag, e.g.: "#Hashtag"
+ * @param length number of bytes in hashtag
+ * @param hashtag_batch batch the hashtag is lowercased into
+ * @param unique_hashtags hashtags of the tweet
  */
-string to_lower(string in) {
-	for (char& i : in)
-		if ('A' <= i && i <= 'Z')
-			i += 32;
-	return in;
+void add_hashtag(const char* hashtag, size_t length, KeyBatch& hashtag_batch,
+				 SmallKeySet<MAX_HASHTAGS>& unique_hashtags) {
+	BatchKey key = hashtag_batch.lower(hashtag, length);
+	if (!unique_hashtags.insert(key)) {
+		hashtag_batch.drop(key);
+	}
+}
+
+/**
+ * Finds the first hashtag in text: a "#" followed by one or more word
+ * characters (letters, marks, numbers and underscores, in any script).
+ * @param text tweet text (UTF-8), e.g.: "A #Café and #tea"
+ * @param length number of bytes in text
+ * @param start set to the start of the hashtag, e.g.: "#Café and #tea"
+ * @return number of bytes in the hashtag (0 if there is none), e.g.: 6
+ */
+size_t find_hashtag(const char* text, size_t length, const char** start) {
+	const char* end = text + length;
+	const char* p = text;
+	while (p < end && (p = (const char*)memchr(p, '#', end - p)) != nullptr) {
+		size_t n = word_run_length(p + 1, end - p - 1);
+		if (n) {
+			*start = p;
+			return n + 1;
+		}
+		p++;
+	}
+	return 0;
 }
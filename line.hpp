@@ -1,11 +1,17 @@
-#include <unordered_map>
+#include <string>
+#include "freq_table.hpp"
+#include "tweet.hpp"
 
 using std::string;
-using std::unordered_map;
 
 /**
- * Extract language and hashtags from line, and calculate frequencies.
+ * Extract language and hashtags from line, count the language and collect the
+ * hashtags into a batch to be counted.
  */
-void process_line(const string& line,
-				  unordered_map<string, unsigned long>& lang_freq_map,
-				  unordered_map<string, unsigned long>& hashtag_freq_map);
+bool process_line(string& line, Tweet& tweet, FreqTable& lang_freq_map,
+				  KeyBatch& hashtag_batch);
+
+/**
+ * Finds the first hashtag ("#" and a run of word characters) in a text.
+ */
+size_t find_hashtag(const char* text, size_t length, const char** start);
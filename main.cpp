@@ -16,10 +16,21 @@
 #include <omp.h>
 #include <sstream>
 #include <string>
+#include <string.h>
 #include <sys/stat.h>
 #include <unordered_map>
+#include "cache.hpp"
+#include "checkpoint.hpp"
 #include "combine.hpp"
+#include "groups.hpp"
+#include "options.hpp"
+#include "perf_counters.hpp"
+#include "progress.hpp"
+#include "recovery.hpp"
+#include "snapshot.hpp"
 #include "threading.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
 
 using std::pair;
 using std::string;
@@ -29,22 +40,66 @@ using std::unordered_map;
 long long get_file_length(const char* filename);
 void perform_work(const char* filename, long long file_length,
 				  unordered_map<string, string>& lang_map);
+void check_options(bool cache, int rank);
+pair<unordered_map<string, unsigned long>,
+	 unordered_map<string, unsigned long>>
+process_json(const char* filename, long long offset, long long end_offset,
+			 int rank, int size, TweetCounts* counts);
 unordered_map<string, string> read_lang_csv(const char* filename);
 
 int main(int argc, char** argv) {
+	parse_options(argc, argv);
+
+	// tp merge a.snap b.snap ... (no MPI, see snapshot.cpp)
+	if (argc >= 2 && strcmp(argv[1], "merge") == 0) {
+		struct stat sb {};
+		string lang_codes = options.lang_codes;
+		if (lang_codes.empty() && stat("lang.csv", &sb) == 0) {
+			lang_codes = "lang.csv";
+		}
+		unordered_map<string, string> lang_map;
+		if (!lang_codes.empty()) {
+			lang_map = read_lang_csv(lang_codes.c_str());
+		}
+		merge_snapshots(argc - 2, argv + 2, lang_map);
+		return 0;
+	}
+
 	if (argc < 3) {
 		std::cerr << "usage: " << argv[0] << " "
-				  << "input.json lang_codes.csv" << std::endl;
+				  << "[--extractor=sax|index|scan] [--verify=n] [--timing] "
+				  << "[--timing-json=file] [--perf[=n]] [--trace=prefix] "
+				  << "[--progress[=seconds]] [--progress-all] "
+				  << "[--compile[=path]] [--checkpoint=file] "
+				  << "[--snapshot=file] [--recovery=dir] "
+				  << "[--recovery-interval=seconds] [--buckets=hour|day] "
+				  << "[--bucket-top=n] [--trending[=buckets]] "
+				  << "[--trend-baseline=buckets] [--trend-min=n] [--pairs] "
+				  << "[--pair-cap=n] [--pairs-max=n] [--by-lang[=n]] "
+				  << "[--by-lang-top=n] [--group-by=dims[,dims...]] "
+				  << "[--group-top=n] "
+				  << "input.json lang_codes.csv"
+				  << std::endl
+				  << "       " << argv[0] << " merge [--snapshot=file] "
+				  << "[--lang-codes=file] a.snap [b.snap ...]" << std::endl;
 		std::exit(EXIT_FAILURE);
 	}
 
 	auto start_ts = std::chrono::system_clock::now();
+	timing_init();
 
 	// Init execution environment
-	MPI_Init(&argc, &argv);
+	// Progress of all processes is reduced by a thread besides the workers
+	int thread_level;
+	MPI_Init_thread(&argc, &argv,
+					options.progress_all ? MPI_THREAD_MULTIPLE
+										 : MPI_THREAD_SINGLE,
+					&thread_level);
 	int rank, size;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	trace_init(rank);
+	progress_init(rank, size, thread_level);
 
 	// Get number of bytes in file
 	long long file_length = get_file_length(argv[1]);
@@ -73,7 +128,7 @@ int main(int argc, char** argv) {
 
 /**
  * Splits and assigns work to each MPI process, joins and prints results.
- * @param filename path of twitter file
+ * @param filename path of twitter file (or of a cache of it)
  * @param file_length length of twitter file in bytes
  * @param lang_map map of <identifier, language> pairs
  */
@@ -92,14 +147,127 @@ void perform_work(const char* filename, const long long file_length,
 		std::cerr << m.str();
 	}
 
+	// A cache (from --compile) is split by row groups instead of bytes
+	pair<unordered_map<string, unsigned long>,
+		 unordered_map<string, unsigned long>>
+		results;
+	Checkpoint checkpoint;
+	bool cache = is_cache(filename);
+	check_options(cache, rank);
+	// Counts besides the languages and hashtags (see groups.cpp)
+	bool counting = init_counts();
+	TweetCounts counts;
+	if (cache) {
+		results = process_cache(filename, rank, size);
+	} else {
+		// With --checkpoint, only the lines after its offset are processed,
+		// and counted with its counts
+		long long end = file_length;
+		if (!options.checkpoint.empty()) {
+			load_checkpoint(filename, file_length, checkpoint, end);
+		}
+		results = process_json(filename, checkpoint.offset, end, rank, size,
+							   counting ? &counts : nullptr);
+		checkpoint.offset = end;
+		if (rank == 0) {
+			add_checkpoint_counts(checkpoint, results);
+		}
+	}
+
+	// Combine results from multiple processes and print
+	combine_results(results, rank, size, lang_map);
+	if (counting) {
+		report_counts(counts, results.first, results.second, rank, size,
+					  lang_map);
+	}
+	if (!options.snapshot.empty() && rank == 0) {
+		write_snapshot(options.snapshot, results);
+	}
+	if (!options.checkpoint.empty() && rank == 0) {
+		checkpoint.langs = std::move(results.first);
+		checkpoint.hashtags = std::move(results.second);
+		save_checkpoint(filename, checkpoint);
+	}
+	recovery_remove();
+	report_timing(rank, size);
+	report_perf(rank);
+	write_trace();
+}
+
+/**
+ * Exits if options that cannot be used together are given: those that keep
+ * counts besides the languages and hashtags (the cache and --checkpoint do
+ * not have them, and --recovery does not save them), or that read or write
+ * both a cache and a checkpoint.
+ * @param cache whether the input is a cache
+ * @param rank rank of the running process
+ */
+void check_options(bool cache, int rank) {
+	string conflict;
+	bool buckets = options.buckets != Buckets::NONE;
+	// Options that keep counts besides the languages and hashtags
+	const char* extra = nullptr;
+	if (buckets) {
+		extra = "--buckets";
+	} else if (options.pairs) {
+		extra = "--pairs";
+	} else if (options.by_lang) {
+		extra = "--by-lang";
+	} else if (!options.group_by.empty()) {
+		extra = "--group-by";
+	}
+	if (cache && (options.compile || !options.checkpoint.empty())) {
+		conflict = "a cache cannot be compiled or checkpointed";
+	} else if (cache && buckets) {
+		conflict = "a cache has no times (for --buckets)";
+	} else if (cache && extra) {
+		conflict = string(extra) + " cannot be used with a cache";
+	} else if (options.compile && !options.checkpoint.empty()) {
+		conflict = "--compile cannot be used with --checkpoint";
+	} else if (options.compile && !options.recovery.empty()) {
+		conflict = "--compile cannot be used with --recovery";
+	} else if (options.trending && !buckets) {
+		conflict = "--trending needs --buckets";
+	} else if (options.trending && !options.trend_baseline) {
+		conflict = "--trend-baseline must be at least 1";
+	} else if (extra && !options.checkpoint.empty()) {
+		conflict = string(extra) + " cannot be used with --checkpoint";
+	} else if (extra && !options.recovery.empty()) {
+		conflict = string(extra) + " cannot be used with --recovery";
+	}
+	if (!conflict.empty()) {
+		if (rank == 0) {
+			std::cerr << "[!] " << conflict << std::endl;
+		}
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Processes this process's section of the bytes [offset, end) of a twitter
+ * file (and writes the cache with --compile).
+ * @param filename path of twitter file
+ * @param offset first byte (the start of a line, or 0)
+ * @param end_offset end of the bytes (exclusive), e.g.: the length of the
+ * file
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param counts other counts (see groups.hpp), counted if not nullptr
+ * @return maps of <language, count> and <hashtag, count>
+ */
+pair<unordered_map<string, unsigned long>,
+	 unordered_map<string, unsigned long>>
+process_json(const char* filename, long long offset, long long end_offset,
+			 int rank, int size, TweetCounts* counts) {
 	// Divide file into chunks by bytes
 	// Each MPI process will be allocated with a chunk
 	// Start and end are inclusive
-	long long chunk = file_length / size + (file_length % size == 0 ? 0 : 1);
-	long long start = rank * chunk;
-	long long end = std::min(file_length, (rank + 1) * chunk - 1);
+	long long length = end_offset - offset;
+	long long chunk = length / size + (length % size == 0 ? 0 : 1);
+	long long start = offset + rank * chunk;
+	long long end = std::min(end_offset, offset + (rank + 1) * chunk) - 1;
 	if (rank == size - 1) {
-		end = file_length - 1;
+		end = end_offset - 1;
 	}
 
 #ifdef DEBUG
@@ -113,12 +281,17 @@ void perform_work(const char* filename, const long long file_length,
 	// For the current process, divide the work further (into threads)
 	// Though it's possible to have 1 MPI process for each core, use threads
 	// instead to reduce network communication overheads
+	CacheWriter cache;
+	progress_start(std::max(end - start + 1, 0LL));
 	pair<unordered_map<string, unsigned long>,
 		 unordered_map<string, unsigned long>>
-		results = process_section(filename, start, end);
-
-	// Combine results from multiple processes and print
-	combine_results(results, rank, size, lang_map);
+		results = process_section(filename, start, end,
+								  options.compile ? &cache : nullptr, counts);
+	progress_stop();
+	if (options.compile) {
+		write_cache(cache, cache_path(filename), end_offset);
+	}
+	return results;
 }
 
 /**
@@ -0,0 +1,195 @@
+// Command line options
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "options.hpp"
+
+using std::string;
+
+Options options;
+
+// Function prototypes
+static void set_option(const string& name, const string& value);
+static unsigned long parse_count(const string& name, const string& value);
+
+/**
+ * Reads the options (arguments starting with "--") from the command line and
+ * removes them from argv, leaving the positional arguments.
+ * @param argc number of arguments (updated)
+ * @param argv arguments, e.g.: {"tp", "--extractor=sax", "in.json", ...}
+ */
+void parse_options(int& argc, char** argv) {
+	int n = 1;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2) != 0) {
+			argv[n++] = argv[i];
+			continue;
+		}
+		string option = argv[i] + 2;
+		size_t eq = option.find('=');
+		if (eq == string::npos) {
+			set_option(option, "");
+		} else {
+			set_option(option.substr(0, eq), option.substr(eq + 1));
+		}
+	}
+	argc = n;
+	argv[n] = nullptr;
+}
+
+/**
+ * Sets an option, exiting on an unknown option or value.
+ * @param name option name, e.g.: "extractor"
+ * @param value option value, e.g.: "sax"
+ */
+static void set_option(const string& name, const string& value) {
+	if (name == "extractor") {
+		if (value == "sax") {
+			options.extractor = Extractor::SAX;
+			return;
+		}
+		if (value == "index") {
+			options.extractor = Extractor::INDEX;
+			return;
+		}
+		if (value == "scan") {
+			options.extractor = Extractor::SCAN;
+			return;
+		}
+		std::cerr << "Unknown extractor: " << value << " (sax, index or scan)"
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	if (name == "timing" && value.empty()) {
+		options.timing = true;
+		return;
+	}
+	if (name == "timing-json" && !value.empty()) {
+		options.timing = true;
+		options.timing_json = value;
+		return;
+	}
+	if (name == "perf") {
+		options.perf = value.empty() ? 100 : parse_count(name, value);
+		return;
+	}
+	if (name == "trace" && !value.empty()) {
+		options.trace = value;
+		return;
+	}
+	if (name == "progress") {
+		options.progress = value.empty() ? 5 : parse_count(name, value);
+		return;
+	}
+	if (name == "progress-all" && value.empty()) {
+		options.progress = options.progress ? options.progress : 5;
+		options.progress_all = true;
+		return;
+	}
+	if (name == "compile") {
+		options.compile = true;
+		options.compile_path = value;
+		return;
+	}
+	if (name == "checkpoint" && !value.empty()) {
+		options.checkpoint = value;
+		return;
+	}
+	if (name == "snapshot" && !value.empty()) {
+		options.snapshot = value;
+		return;
+	}
+	if (name == "recovery" && !value.empty()) {
+		options.recovery = value;
+		return;
+	}
+	if (name == "recovery-interval") {
+		options.recovery_interval = parse_count(name, value);
+		return;
+	}
+	if (name == "buckets") {
+		if (value == "hour") {
+			options.buckets = Buckets::HOUR;
+			return;
+		}
+		if (value == "day") {
+			options.buckets = Buckets::DAY;
+			return;
+		}
+		std::cerr << "Unknown buckets: " << value << " (hour or day)"
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	if (name == "bucket-top") {
+		options.bucket_top = parse_count(name, value);
+		return;
+	}
+	if (name == "trending") {
+		options.trending = value.empty() ? 3 : parse_count(name, value);
+		return;
+	}
+	if (name == "trend-baseline") {
+		options.trend_baseline = parse_count(name, value);
+		return;
+	}
+	if (name == "trend-min") {
+		options.trend_min = parse_count(name, value);
+		return;
+	}
+	if (name == "pairs" && value.empty()) {
+		options.pairs = true;
+		return;
+	}
+	if (name == "pair-cap") {
+		options.pair_cap = parse_count(name, value);
+		return;
+	}
+	if (name == "pairs-max") {
+		options.pairs_max = parse_count(name, value);
+		return;
+	}
+	if (name == "by-lang") {
+		options.by_lang = value.empty() ? 5 : parse_count(name, value);
+		return;
+	}
+	if (name == "by-lang-top") {
+		options.by_lang_top = parse_count(name, value);
+		return;
+	}
+	if (name == "group-by" && !value.empty()) {
+		options.group_by = value;
+		return;
+	}
+	if (name == "group-top") {
+		options.group_top = parse_count(name, value);
+		return;
+	}
+	if (name == "lang-codes" && !value.empty()) {
+		options.lang_codes = value;
+		return;
+	}
+	if (name == "verify") {
+		options.verify = parse_count(name, value);
+		return;
+	}
+	std::cerr << "Unknown option: --" << name << std::endl;
+	std::exit(EXIT_FAILURE);
+}
+
+/**
+ * Reads the value of a numeric option, exiting if it is not a number.
+ * @param name option name, e.g.: "verify"
+ * @param value option value, e.g.: "1000"
+ * @return value
+ */
+static unsigned long parse_count(const string& name, const string& value) {
+	char* end;
+	unsigned long n = strtoul(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0') {
+		std::cerr << "Invalid value for --" << name << ": " << value
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return n;
+}
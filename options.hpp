@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+
+/**
+ * How fields are extracted from lines.
+ */
+enum class Extractor {
+	SAX,   // rapidjson SAX parser with the path matcher (validating)
+	INDEX, // SIMD structural index and walker
+	SCAN,  // search for the keys, falling back to SAX for unusual lines
+};
+
+/**
+ * Time buckets that counts are also kept per (of created_at).
+ */
+enum class Buckets {
+	NONE,
+	HOUR,
+	DAY,
+};
+
+/**
+ * Options given on the command line (as --name=value, before the input
+ * files), the same on every process.
+ */
+struct Options {
+	Extractor extractor = Extractor::SAX;
+	// Every verify-th line is also parsed with SAX, and any difference in the
+	// fields is reported (0 for none)
+	unsigned long verify = 0;
+	// Time the stages of the work (see timing.hpp), and write the times to
+	// timing_json (if not empty)
+	bool timing = false;
+	std::string timing_json;
+	// Read the hardware performance counters around the stages of every
+	// perf-th line (see perf_counters.hpp, 0 for none)
+	unsigned long perf = 0;
+	// Write a timeline of chunks and combining to trace.<rank>.json (see
+	// trace.cpp, empty for none)
+	std::string trace;
+	// Print the rates, percent complete and ETA every progress seconds (see
+	// progress.cpp, 0 for none), of all processes together on rank 0 if
+	// progress_all
+	unsigned long progress = 0;
+	bool progress_all = false;
+	// Also write the fields that are counted to a columnar cache (see
+	// cache.cpp), at compile_path (if not empty) or next to the input
+	bool compile = false;
+	std::string compile_path;
+	// Process only the input appended since the checkpoint (see
+	// checkpoint.cpp), which is then updated (empty for none)
+	std::string checkpoint;
+	// Write the final tables to a snapshot (see snapshot.cpp), or the merged
+	// tables with tp merge (empty for none)
+	std::string snapshot;
+	// Save the counts of the chunks that are done to recovery (a directory,
+	// see recovery.cpp) every recovery_interval seconds, and skip the chunks
+	// saved by an earlier run of the job (empty for none)
+	std::string recovery;
+	unsigned long recovery_interval = 30;
+	// Also count per hour or day of created_at (see buckets.cpp), printing
+	// the top bucket_top of each bucket
+	Buckets buckets = Buckets::NONE;
+	unsigned long bucket_top = 10;
+	// Print the hashtags rising in a window of trending buckets against the
+	// trend_baseline buckets before it, counted at least trend_min times in
+	// the window (see trending.cpp, 0 for none)
+	unsigned long trending = 0;
+	unsigned long trend_baseline = 24;
+	unsigned long trend_min = 10;
+	// Also count the pairs of hashtags of each tweet, at most pair_cap of
+	// them per tweet (0 for no cap), keeping at most pairs_max pairs per
+	// table between prunings (see pairs.cpp, 0 for no limit)
+	bool pairs = false;
+	unsigned long pair_cap = 45;
+	unsigned long pairs_max = 0;
+	// Also count the hashtags of each language, printing the top by_lang_top
+	// hashtags of the top by_lang languages (see lang_hashtags.cpp, 0 for
+	// none)
+	unsigned long by_lang = 0;
+	unsigned long by_lang_top = 10;
+	// Groups of dimensions to also count, e.g.: "user,lang+hour", printing
+	// the top group_top keys of each (see groups.cpp, empty for none)
+	std::string group_by;
+	unsigned long group_top = 10;
+	// Language codes of tp merge (lang.csv, if there is one, when empty)
+	std::string lang_codes;
+};
+
+extern Options options;
+
+/**
+ * Reads the options from the command line and removes them from argv.
+ */
+void parse_options(int& argc, char** argv);
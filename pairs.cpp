@@ -0,0 +1,246 @@
+// Hashtag co-occurrence (--pairs)
+// Every two distinct hashtags of a tweet make an unordered pair, counted in a
+// table of its own keyed by the ids of the two hashtags (interned per thread,
+// so a pair is a single 64-bit key and no strings are built per pair). A
+// tweet counts at most options.pair_cap pairs. Thread tables are merged by
+// reinterning the hashtags of each thread, and pairs are combined across
+// processes as "#a #b" keys like the other counts
+//
+// With --pairs-max=n, a table that grows past 2n pairs is pruned back to at
+// most n (a Misra-Gries summary): the (n + 1)-th largest count is subtracted
+// from every count, dropping those that reach 0. Each count then stays below
+// its true count by at most the sum of what was subtracted, which is tracked
+// and printed with the results, and memory stays bounded whatever the input
+
+// References:
+// https://doi.org/10.1016/0167-6423(82)90012-0 (Misra and Gries)
+// https://doi.org/10.1145/2500128 (mergeable summaries)
+
+#define OMPI_SKIP_MPICXX
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <iostream>
+#include <mpi.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "combine.hpp"
+#include "options.hpp"
+#include "pairs.hpp"
+
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+// Function prototypes
+static uint64_t pack_pair(uint32_t a, uint32_t b);
+static uint64_t hash_pair(uint64_t pair);
+
+/**
+ * @param capacity number of pairs to make room for
+ */
+PairTable::PairTable(size_t capacity) : used(0), mask(0) {
+	reserve(capacity);
+}
+
+/**
+ * Adds to the frequency of a pair, inserting it if it is not present.
+ * @param pair pair of ids (pack_pair)
+ * @param by amount to add
+ */
+void PairTable::increment(uint64_t pair, unsigned long by) {
+	if (by == 0) {
+		return;
+	}
+	for (size_t i = hash_pair(pair) & mask;; i = (i + 1) & mask) {
+		Slot& s = slots[i];
+		if (s.count == 0) {
+			// Empty slot, insert pair
+			if ((used + 1) * 10 > slots.size() * 7) {
+				reserve(used + 1);
+				increment(pair, by);
+				return;
+			}
+			s.pair = pair;
+			s.count = by;
+			used++;
+			return;
+		}
+		if (s.pair == pair) {
+			s.count += by;
+			return;
+		}
+	}
+}
+
+/**
+ * Prunes the table to at most keep pairs, by subtracting the (keep + 1)-th
+ * largest count from every count and dropping the pairs left with none.
+ * @param keep number of pairs kept at most
+ * @return amount subtracted from every count (0 if the table was not
+ * pruned)
+ */
+unsigned long PairTable::prune(size_t keep) {
+	if (used <= keep) {
+		return 0;
+	}
+	std::vector<unsigned long> counts;
+	counts.reserve(used);
+	for_each([&counts](uint64_t, unsigned long count) {
+		counts.push_back(count);
+	});
+	std::nth_element(counts.begin(), counts.begin() + keep, counts.end(),
+					 std::greater<unsigned long>());
+	unsigned long cut = counts[keep];
+
+	std::vector<Slot> old;
+	old.swap(slots);
+	used = 0;
+	mask = 0;
+	reserve(keep);
+	for (const Slot& s : old) {
+		if (s.count > cut) {
+			increment(s.pair, s.count - cut);
+		}
+	}
+	return cut;
+}
+
+/**
+ * Grows the table (if needed) so that n pairs fit under the load factor.
+ * @param n number of pairs
+ */
+void PairTable::reserve(size_t n) {
+	size_t capacity = 16;
+	while (n * 10 > capacity * 7) {
+		capacity <<= 1;
+	}
+	if (capacity <= slots.size()) {
+		return;
+	}
+
+	// Reinsert existing slots
+	std::vector<Slot> old(capacity, Slot{0, 0});
+	old.swap(slots);
+	mask = capacity - 1;
+	for (const Slot& s : old) {
+		if (s.count) {
+			size_t i = hash_pair(s.pair) & mask;
+			while (slots[i].count) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = s;
+		}
+	}
+}
+
+/**
+ * Counts the pairs of the (unique) hashtags of a tweet, up to
+ * options.pair_cap of them (0 for no cap).
+ * @param hashtag_batch batch the hashtags of the tweet were added to
+ * @param first index of the first hashtag of the tweet in the batch
+ */
+void PairCounts::add(const KeyBatch& hashtag_batch, size_t first) {
+	size_t n = hashtag_batch.size() - first;
+	if (n < 2) {
+		return;
+	}
+	ids.clear();
+	for (size_t i = first; i < hashtag_batch.size(); i++) {
+		const BatchKey& k = hashtag_batch.keys[i];
+		ids.push_back(hashtags.intern(
+			string_view(hashtag_batch.bytes.data() + k.offset, k.length)));
+	}
+	unsigned long left = options.pair_cap ? options.pair_cap : ULONG_MAX;
+	for (size_t a = 0; a < n && left; a++) {
+		for (size_t b = a + 1; b < n && left; b++, left--) {
+			pairs.increment(pack_pair(ids[a], ids[b]));
+		}
+	}
+	if (options.pairs_max && pairs.size() > 2 * options.pairs_max) {
+		error += pairs.prune(options.pairs_max);
+	}
+}
+
+/**
+ * Adds the counts of another thread.
+ * @param other counts of the thread (left empty)
+ */
+void PairCounts::merge(PairCounts& other) {
+	vector<uint32_t> hashtag_ids;
+	for (const string& key : other.hashtags.keys) {
+		hashtag_ids.push_back(hashtags.intern(key));
+	}
+	other.pairs.for_each([this, &hashtag_ids](uint64_t pair,
+											  unsigned long count) {
+		pairs.increment(pack_pair(hashtag_ids[pair >> 32],
+								  hashtag_ids[(uint32_t)pair]),
+						count);
+	});
+	error += other.error;
+	if (options.pairs_max && pairs.size() > 2 * options.pairs_max) {
+		error += pairs.prune(options.pairs_max);
+	}
+	other = PairCounts();
+}
+
+/**
+ * Combines the pair counts of all processes and prints the top pairs, e.g.:
+ * "#covid19 #lockdown" (and how far below the true counts they may be, with
+ * --pairs-max), called by all processes.
+ * @param counts counts of this process
+ * @param rank rank of the running process
+ * @param size number of processes
+ */
+void report_pairs(PairCounts& counts, int rank, int size) {
+	if (options.pairs_max) {
+		counts.error += counts.pairs.prune(options.pairs_max);
+	}
+	unordered_map<string, unsigned long> pairs(counts.pairs.size());
+	counts.pairs.for_each([&](uint64_t pair, unsigned long count) {
+		const string& a = counts.hashtags.keys[pair >> 32];
+		const string& b = counts.hashtags.keys[(uint32_t)pair];
+		pairs.emplace(a < b ? a + " " + b : b + " " + a, count);
+	});
+	unsigned long error = 0;
+	MPI_Reduce(&counts.error, &error, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0,
+			   MPI_COMM_WORLD);
+	counts = PairCounts();
+	combine_maps(pairs, rank, size);
+	if (rank != 0) {
+		return;
+	}
+
+	std::cout << std::endl << "[*] Hashtag Pair Freq Results";
+	if (error) {
+		std::cout << " (counts may be up to "
+				  << format_number(std::to_string(error)) << " low)";
+	}
+	std::cout << std::endl;
+	easy_print(pairs, [](string key) { return key; });
+}
+
+/**
+ * Packs a pair of ids into a key, the same for either order.
+ * @param a id of one hashtag
+ * @param b id of the other
+ * @return pair, with the smaller id in the high half
+ */
+static uint64_t pack_pair(uint32_t a, uint32_t b) {
+	return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+
+/**
+ * Hashes a pair (the finalizer of MurmurHash3, which mixes every bit of the
+ * ids into the low bits used by the table).
+ */
+static uint64_t hash_pair(uint64_t pair) {
+	pair ^= pair >> 33;
+	pair *= 0xff51afd7ed558ccdULL;
+	pair ^= pair >> 33;
+	pair *= 0xc4ceb9fe1a85ec53ULL;
+	pair ^= pair >> 33;
+	return pair;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cache.hpp"
+#include "freq_table.hpp"
+
+/**
+ * Open addressing (linear probing) table of <pair, frequency> pairs, where a
+ * pair is two 32-bit ids packed into 64 bits (e.g.: of two hashtags, see
+ * pairs.cpp, or of a language and a hashtag, see lang_hashtags.cpp).
+ */
+class PairTable {
+  public:
+	explicit PairTable(size_t capacity = 64);
+
+	void increment(uint64_t pair, unsigned long by = 1);
+	unsigned long prune(size_t keep);
+
+	size_t size() const {
+		return used;
+	}
+
+	/**
+	 * Calls f(pair, frequency) for every pair in the table.
+	 */
+	template <typename F> void for_each(F f) const {
+		for (const Slot& s : slots) {
+			if (s.count) {
+				f(s.pair, s.count);
+			}
+		}
+	}
+
+  private:
+	struct Slot {
+		uint64_t pair;
+		unsigned long count;
+	};
+
+	std::vector<Slot> slots;
+	size_t used;
+	size_t mask;
+
+	void reserve(size_t n);
+};
+
+/**
+ * Hashtag pairs counted within tweets (with --pairs), by the ids of the
+ * hashtags in a dictionary of the thread (or process), and the most that a
+ * count may be below the true count (with --pairs-max, see pairs.cpp).
+ */
+struct PairCounts {
+	CacheDictionary hashtags;
+	PairTable pairs;
+	unsigned long error = 0;
+	std::vector<uint32_t> ids;
+
+	void add(const KeyBatch& hashtag_batch, size_t first);
+	void merge(PairCounts& other);
+};
+
+/**
+ * Combines the pair counts of all processes and prints the top pairs (called
+ * by all processes).
+ */
+void report_pairs(PairCounts& counts, int rank, int size);
@@ -0,0 +1,224 @@
+// Hardware performance counters per stage
+// Each thread opens a group of counters (cycles, instructions, LLC, branch and
+// dTLB misses) with perf_event_open, and reads them around the parse, extract
+// and count stages of every n-th line (a read is a system call, so only a
+// sample of lines is counted). Events that cannot be opened are reported as
+// unavailable, and if none can be, counting is turned off with a warning
+
+#define OMPI_SKIP_MPICXX
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mpi.h>
+#include <sstream>
+#include <string>
+#include "perf_counters.hpp"
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+
+thread_local PerfThread perf_thread = {};
+
+// Names of the counters
+static const char* const COUNTER_NAMES[N_PERF_COUNTERS] = {
+	"cycles", "instructions", "LLC misses", "branch misses", "dTLB misses"};
+
+// Stages that are counted (the others are not between counter reads)
+static const int N_COUNTED_STAGES = 3;
+static const int COUNTED_STAGES[N_COUNTED_STAGES] = {PARSE, EXTRACT, COUNT};
+static const char* const COUNTED_STAGE_NAMES[N_COUNTED_STAGES] = {
+	"parse", "extract", "count"};
+
+// Counts of the threads of this process that have finished, and whether each
+// counter could be opened by all of them
+static uint64_t process_totals[N_THREAD_STAGES][N_PERF_COUNTERS];
+static unsigned long process_sampled = 0;
+static int process_available[N_PERF_COUNTERS] = {1, 1, 1, 1, 1};
+static bool warned = false;
+
+#if defined(__linux__)
+// Largest read of a group: number of events, then their values
+static const int MAX_READ = 1 + N_PERF_COUNTERS;
+
+/**
+ * Opens an event of the calling thread in user space.
+ * @param type event type, e.g.: PERF_TYPE_HARDWARE
+ * @param config event, e.g.: PERF_COUNT_HW_CPU_CYCLES
+ * @param group group leader (-1 to open a leader)
+ * @return file descriptor, or -1 if it cannot be opened
+ */
+static int open_event(uint32_t type, uint64_t config, int group) {
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/**
+ * Opens the counters of the calling thread (when options.perf is set). The
+ * first thread that cannot open them warns, once per process.
+ */
+void perf_open_thread() {
+	perf_thread = PerfThread{};
+	if (!options.perf) {
+		return;
+	}
+#if defined(__linux__)
+	static const uint32_t types[N_PERF_COUNTERS] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+	static const uint64_t configs[N_PERF_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+			PERF_COUNT_HW_CACHE_RESULT_MISS << 16};
+	for (int c = 0; c < N_PERF_COUNTERS; c++) {
+		int fd = open_event(types[c], configs[c], perf_thread.leader);
+		if (fd == -1) {
+			perf_thread.slot[c] = -1;
+			if (c == CYCLES) {
+				break;
+			}
+			continue;
+		}
+		if (c == CYCLES) {
+			perf_thread.leader = fd;
+		}
+		perf_thread.fds[perf_thread.n_open] = fd;
+		perf_thread.slot[c] = perf_thread.n_open++;
+	}
+	if (perf_thread.leader != -1) {
+		ioctl(perf_thread.leader, PERF_EVENT_IOC_ENABLE,
+			  PERF_IOC_FLAG_GROUP);
+		return;
+	}
+	string reason = strerror(errno);
+#else
+	string reason = "not supported on this platform";
+#endif
+#pragma omp critical(perf)
+	{
+		if (!warned) {
+			std::cerr << "[!] Performance counters unavailable (" << reason
+					  << "), --perf ignored" << std::endl;
+			warned = true;
+		}
+		for (int c = 0; c < N_PERF_COUNTERS; c++) {
+			process_available[c] = 0;
+		}
+	}
+}
+
+/**
+ * Reads the counters of the calling thread (counters that are not open read
+ * as 0).
+ * @param counts counts of each counter (PerfCounter)
+ * @return whether the counters could be read
+ */
+bool read_perf_counters(uint64_t counts[N_PERF_COUNTERS]) {
+#if defined(__linux__)
+	uint64_t values[MAX_READ];
+	ssize_t n = read(perf_thread.leader, values, sizeof(values));
+	if (n < (ssize_t)sizeof(uint64_t) ||
+		values[0] != (uint64_t)perf_thread.n_open) {
+		return false;
+	}
+	for (int c = 0; c < N_PERF_COUNTERS; c++) {
+		int slot = perf_thread.slot[c];
+		counts[c] = slot == -1 ? 0 : values[1 + slot];
+	}
+	return true;
+#else
+	(void)counts;
+	return false;
+#endif
+}
+
+/**
+ * Keeps the counts of the calling thread for the report, and closes its
+ * counters.
+ */
+void perf_close_thread() {
+	if (perf_thread.leader == -1) {
+		return;
+	}
+#pragma omp critical(perf)
+	{
+		for (int s = 0; s < N_THREAD_STAGES; s++) {
+			for (int c = 0; c < N_PERF_COUNTERS; c++) {
+				process_totals[s][c] += perf_thread.totals[s][c];
+			}
+		}
+		process_sampled += perf_thread.n_sampled;
+		for (int c = 0; c < N_PERF_COUNTERS; c++) {
+			process_available[c] &= perf_thread.slot[c] != -1;
+		}
+	}
+#if defined(__linux__)
+	for (int i = 0; i < perf_thread.n_open; i++) {
+		close(perf_thread.fds[i]);
+	}
+#endif
+	perf_thread = PerfThread{};
+}
+
+/**
+ * Sums the counts of all threads and processes to rank 0, which prints IPC
+ * and counts per sampled tweet for each counted stage (counters that any
+ * thread could not open are shown as n/a).
+ * @param rank rank of the running process
+ */
+void report_perf(int rank) {
+	if (!options.perf) {
+		return;
+	}
+	uint64_t totals[N_THREAD_STAGES][N_PERF_COUNTERS];
+	unsigned long sampled;
+	int available[N_PERF_COUNTERS];
+	MPI_Reduce(process_totals, totals, N_THREAD_STAGES * N_PERF_COUNTERS,
+			   MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&process_sampled, &sampled, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0,
+			   MPI_COMM_WORLD);
+	MPI_Reduce(process_available, available, N_PERF_COUNTERS, MPI_INT,
+			   MPI_LAND, 0, MPI_COMM_WORLD);
+	if (rank != 0 || !sampled) {
+		return;
+	}
+
+	std::stringstream m;
+	m << std::endl
+	  << "[*] Performance counters (per tweet, over " << sampled
+	  << " sampled tweets)" << std::endl;
+	for (int i = 0; i < N_COUNTED_STAGES; i++) {
+		int s = COUNTED_STAGES[i];
+		m << "\t" << COUNTED_STAGE_NAMES[i] << ": IPC ";
+		if (available[CYCLES] && available[INSTRUCTIONS] &&
+			totals[s][CYCLES]) {
+			m << (double)totals[s][INSTRUCTIONS] / totals[s][CYCLES];
+		} else {
+			m << "n/a";
+		}
+		for (int c = 0; c < N_PERF_COUNTERS; c++) {
+			m << ", " << COUNTER_NAMES[c] << " ";
+			if (available[c]) {
+				m << (double)totals[s][c] / sampled;
+			} else {
+				m << "n/a";
+			}
+		}
+		m << std::endl;
+	}
+	std::cout << m.str();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include "options.hpp"
+#include "timing.hpp"
+
+/**
+ * Hardware events counted.
+ */
+enum PerfCounter {
+	CYCLES,
+	INSTRUCTIONS,
+	LLC_MISSES,
+	BRANCH_MISSES,
+	DTLB_MISSES,
+	N_PERF_COUNTERS
+};
+
+/**
+ * Hardware counters of a thread, and the counts of sampled lines per stage.
+ */
+struct PerfThread {
+	int leader = -1;                  // group leader (-1 if not counting)
+	int slot[N_PERF_COUNTERS];        // position in a group read (-1: none)
+	int fds[N_PERF_COUNTERS];         // descriptors of the events in the group
+	int n_open = 0;                   // number of events in the group
+	bool sampled = false;             // whether the current line is sampled
+	unsigned long n_lines = 0;        // lines seen
+	unsigned long n_sampled = 0;      // lines sampled
+	uint64_t last[N_PERF_COUNTERS];   // counts at the last lap
+	uint64_t totals[N_THREAD_STAGES][N_PERF_COUNTERS];
+};
+
+extern thread_local PerfThread perf_thread;
+
+/**
+ * Reads the counters of the calling thread.
+ */
+bool read_perf_counters(uint64_t counts[N_PERF_COUNTERS]);
+
+/**
+ * Starts a line, which is sampled every options.perf lines. A line stays
+ * sampled until the next one starts, so that a batch flushed after it is
+ * counted too (a sample of the flushes, as of the lines).
+ */
+inline void perf_line_start() {
+	if (perf_thread.leader >= 0) {
+		perf_thread.sampled =
+			perf_thread.n_lines++ % options.perf == 0 &&
+			read_perf_counters(perf_thread.last);
+		perf_thread.n_sampled += perf_thread.sampled;
+	}
+}
+
+/**
+ * Adds the counts since the last lap to a stage, if the line is sampled.
+ */
+inline void perf_lap(int stage) {
+	if (perf_thread.sampled) {
+		uint64_t now[N_PERF_COUNTERS];
+		if (read_perf_counters(now)) {
+			for (int c = 0; c < N_PERF_COUNTERS; c++) {
+				perf_thread.totals[stage][c] += now[c] - perf_thread.last[c];
+				perf_thread.last[c] = now[c];
+			}
+		}
+	}
+}
+
+/**
+ * Opens the counters of the calling thread (when options.perf is set).
+ */
+void perf_open_thread();
+
+/**
+ * Keeps the counts of the calling thread for the report and closes its
+ * counters.
+ */
+void perf_close_thread();
+
+/**
+ * Sums the counts of all threads to rank 0, which prints them per stage.
+ */
+void report_perf(int rank);
@@ -0,0 +1,272 @@
+// Live progress of long runs
+// Threads count the bytes and tweets they process, and a reporter thread on
+// each process wakes every options.progress seconds to print the rates,
+// percent complete and ETA to stderr. With --progress-all, the reporters of
+// all processes instead sum their counts to rank 0 with MPI_Iallreduce, which
+// is polled (rather than waited on, which spins in Open MPI) so reporters
+// cost nothing between reports
+
+#define OMPI_SKIP_MPICXX
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+#include <mutex>
+#include <omp.h>
+#include <sstream>
+#include <thread>
+#include "progress.hpp"
+
+using std::chrono::steady_clock;
+
+thread_local ProgressCounter* progress_counter = nullptr;
+
+// Counts summed over the threads (and processes), and whether they are done
+struct ProgressCounts {
+	uint64_t bytes;
+	uint64_t tweets;
+	uint64_t total;
+	uint64_t done;
+};
+
+// Function prototypes
+static void report_rank();
+static void report_all();
+static ProgressCounts count();
+static void print_progress(const char* name, const ProgressCounts& now,
+						   const ProgressCounts& last, double elapsed,
+						   double interval);
+static void print_done(const char* name, const ProgressCounts& now,
+					   double elapsed);
+
+static int progress_rank = 0;
+static int progress_size = 1;
+static bool aggregate = false;
+static uint64_t progress_total = 0;
+static std::unique_ptr<ProgressCounter[]> counters;
+static int n_counters = 0;
+static steady_clock::time_point started;
+
+// Reporter thread, and its stop signal
+static std::thread reporter;
+static std::mutex stop_mutex;
+static std::condition_variable stop_signal;
+static bool stopping = false;
+
+// Sleep between polls of a pending reduction
+static const std::chrono::milliseconds POLL_INTERVAL(10);
+
+/**
+ * Sets up reporting (when options.progress is set). --progress-all needs
+ * MPI_THREAD_MULTIPLE, as the reporter calls MPI while threads work;
+ * without it, each process reports its own progress.
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param thread_level thread support given by MPI_Init_thread
+ */
+void progress_init(int rank, int size, int thread_level) {
+	progress_rank = rank;
+	progress_size = size;
+	aggregate = options.progress && options.progress_all;
+	if (aggregate && thread_level < MPI_THREAD_MULTIPLE) {
+		if (rank == 0) {
+			std::cerr << "[!] MPI has no MPI_THREAD_MULTIPLE support, "
+					  << "--progress-all ignored" << std::endl;
+		}
+		aggregate = false;
+	}
+}
+
+/**
+ * Starts the reporter thread of this process (when options.progress is
+ * set).
+ * @param bytes bytes assigned to this process
+ */
+void progress_start(long long bytes) {
+	if (!options.progress) {
+		return;
+	}
+	n_counters = omp_get_max_threads();
+	counters.reset(new ProgressCounter[n_counters]);
+	progress_total = bytes;
+	stopping = false;
+	started = steady_clock::now();
+	reporter = std::thread(aggregate ? report_all : report_rank);
+}
+
+/**
+ * Points the calling (OpenMP) thread to its counter.
+ */
+void progress_thread_start() {
+	int thread = omp_get_thread_num();
+	progress_counter =
+		counters && thread < n_counters ? &counters[thread] : nullptr;
+}
+
+/**
+ * Stops the reporter thread, which prints the final rates. With
+ * --progress-all this waits for every process to be done.
+ */
+void progress_stop() {
+	if (!options.progress) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(stop_mutex);
+		stopping = true;
+	}
+	stop_signal.notify_all();
+	reporter.join();
+	counters.reset();
+	n_counters = 0;
+}
+
+/**
+ * Waits for the next report, or until the work is done.
+ * @return whether the work is done
+ */
+static bool wait_report() {
+	std::unique_lock<std::mutex> lock(stop_mutex);
+	return stop_signal.wait_for(lock, std::chrono::seconds(options.progress),
+								[] { return stopping; });
+}
+
+/**
+ * Whether the work of this process is done (without waiting).
+ */
+static bool is_stopping() {
+	std::lock_guard<std::mutex> lock(stop_mutex);
+	return stopping;
+}
+
+/**
+ * Seconds since the reporter started.
+ */
+static double seconds_elapsed() {
+	return std::chrono::duration<double>(steady_clock::now() - started)
+		.count();
+}
+
+/**
+ * Reporter of this process alone.
+ */
+static void report_rank() {
+	std::stringstream name;
+	name << "MPI " << progress_rank;
+	ProgressCounts last = {};
+	double last_elapsed = 0;
+	while (!wait_report()) {
+		ProgressCounts now = count();
+		double elapsed = seconds_elapsed();
+		print_progress(name.str().c_str(), now, last, elapsed,
+					   elapsed - last_elapsed);
+		last = now;
+		last_elapsed = elapsed;
+	}
+	print_done(name.str().c_str(), count(), seconds_elapsed());
+}
+
+/**
+ * Reporter of all processes together, printed by rank 0. Every process takes
+ * part in every reduction, so a process that is done keeps reducing (without
+ * waiting between them) until all are done.
+ */
+static void report_all() {
+	ProgressCounts last = {};
+	double last_elapsed = 0;
+	bool done = false;
+	while (true) {
+		if (!done) {
+			done = wait_report();
+		}
+		ProgressCounts local = count(), now;
+		local.done = done;
+		MPI_Request request;
+		MPI_Iallreduce(&local, &now, 4, MPI_UINT64_T, MPI_SUM,
+					   MPI_COMM_WORLD, &request);
+		int completed = 0;
+		MPI_Test(&request, &completed, MPI_STATUS_IGNORE);
+		while (!completed) {
+			std::this_thread::sleep_for(POLL_INTERVAL);
+			MPI_Test(&request, &completed, MPI_STATUS_IGNORE);
+		}
+		if (!done) {
+			done = is_stopping();
+		}
+
+		double elapsed = seconds_elapsed();
+		if (now.done == (uint64_t)progress_size) {
+			if (progress_rank == 0) {
+				print_done("All", now, elapsed);
+			}
+			return;
+		}
+		if (progress_rank == 0) {
+			print_progress("All", now, last, elapsed, elapsed - last_elapsed);
+		}
+		last = now;
+		last_elapsed = elapsed;
+	}
+}
+
+/**
+ * Sums the counters of the threads of this process.
+ */
+static ProgressCounts count() {
+	ProgressCounts counts = {0, 0, progress_total, 0};
+	for (int i = 0; i < n_counters; i++) {
+		counts.bytes += counters[i].bytes.load(std::memory_order_relaxed);
+		counts.tweets += counters[i].tweets.load(std::memory_order_relaxed);
+	}
+	return counts;
+}
+
+/**
+ * Prints a progress line, e.g.: "[*] MPI 0 progress: 42.1% of 1024.0 MB,
+ * 512.3 MB/s, 480123 tweets/s, ETA 1.2 s"
+ * @param name who the counts are of
+ * @param now counts now
+ * @param last counts at the previous report
+ * @param elapsed seconds since reporting started
+ * @param interval seconds since the previous report
+ */
+static void print_progress(const char* name, const ProgressCounts& now,
+						   const ProgressCounts& last, double elapsed,
+						   double interval) {
+	double fraction = now.total ? (double)now.bytes / now.total : 1;
+	// ETA at the average rate so far (rates of one interval are noisy)
+	double remaining = now.total > now.bytes ? now.total - now.bytes : 0;
+	double eta = now.bytes ? remaining * elapsed / now.bytes : 0;
+	std::stringstream m;
+	m << std::fixed << "[*] " << name << " progress: " << std::setprecision(1)
+	  << 100 * fraction << "% of " << now.total / 1e6 << " MB, "
+	  << (now.bytes - last.bytes) / 1e6 / interval << " MB/s, "
+	  << std::setprecision(0) << (now.tweets - last.tweets) / interval
+	  << " tweets/s, ETA ";
+	if (now.bytes) {
+		m << std::setprecision(1) << eta << " s";
+	} else {
+		m << "n/a";
+	}
+	m << std::endl;
+	std::cerr << m.str();
+}
+
+/**
+ * Prints the final counts and average rates.
+ * @param name who the counts are of
+ * @param now final counts
+ * @param elapsed seconds since reporting started
+ */
+static void print_done(const char* name, const ProgressCounts& now,
+					   double elapsed) {
+	std::stringstream m;
+	m << std::fixed << std::setprecision(1) << "[*] " << name
+	  << " processed " << now.bytes / 1e6 << " MB and " << now.tweets
+	  << " tweets in " << elapsed << " s (" << now.bytes / 1e6 / elapsed
+	  << " MB/s, " << std::setprecision(0) << now.tweets / elapsed
+	  << " tweets/s)" << std::endl;
+	std::cerr << m.str();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "options.hpp"
+
+/**
+ * Bytes and tweets processed by a thread, read by the reporter thread (on a
+ * cache line of its own, so threads do not share lines).
+ */
+struct alignas(64) ProgressCounter {
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> tweets{0};
+};
+
+// Counter of the calling thread (nullptr if not reporting)
+extern thread_local ProgressCounter* progress_counter;
+
+/**
+ * Adds work done to the counter of the calling thread. Only the thread
+ * writes its counter, so a relaxed load and store are enough (no locked
+ * add).
+ * @param bytes bytes processed, e.g.: of a line
+ * @param tweets tweets processed
+ */
+inline void progress_add(uint64_t bytes, uint64_t tweets) {
+	ProgressCounter* c = progress_counter;
+	if (c) {
+		c->bytes.store(c->bytes.load(std::memory_order_relaxed) + bytes,
+					   std::memory_order_relaxed);
+		c->tweets.store(c->tweets.load(std::memory_order_relaxed) + tweets,
+						std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Sets up reporting (when options.progress is set).
+ * @param rank rank of the running process
+ * @param size number of processes
+ * @param thread_level thread support given by MPI_Init_thread
+ */
+void progress_init(int rank, int size, int thread_level);
+
+/**
+ * Starts the reporter thread of this process.
+ * @param bytes bytes assigned to this process
+ */
+void progress_start(long long bytes);
+
+/**
+ * Points the calling (OpenMP) thread to its counter.
+ */
+void progress_thread_start();
+
+/**
+ * Stops the reporter thread, which prints the final rates.
+ */
+void progress_stop();
@@ -0,0 +1,344 @@
+// Recovery of jobs that are stopped (e.g.: by the time limit of job.slurm)
+// With --recovery=dir, each process counts every chunk of its section into
+// tables of its own and hands them to a saving thread, which adds them to the
+// counts of the chunks done so far and writes those (with the list of the
+// chunks) to dir every options.recovery_interval seconds. Workers only wait
+// to queue their tables. A run of the job after it was stopped reloads the
+// state, skips the chunks that were done and counts the others. A state is
+// written to a temporary file that is synced and renamed over the last, so
+// a process that is killed while writing leaves the previous state
+//
+// Format (text, one file per rank: dir/tp.<rank>.recovery):
+//   tp recovery 1
+//   <path of the input>
+//   <length> <mtime> <start> <end> <chunk size>  (of the input and section)
+//   chunks <n>
+//   <index of a chunk that is done>  (n lines)
+//   languages <n>
+//   <count> <language>  (n lines)
+//   hashtags <n>
+//   <count> <hashtag>   (n lines)
+
+#define OMPI_SKIP_MPICXX
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include "options.hpp"
+#include "recovery.hpp"
+
+using std::string;
+using std::vector;
+
+// First line of a state (of version 1 of the format)
+static const char* const RECOVERY_VERSION = "tp recovery 1";
+
+/**
+ * Counts of a chunk that are yet to be saved.
+ */
+struct DoneChunk {
+	long long chunk;
+	FreqTable langs;
+	FreqTable hashtags;
+};
+
+// Function prototypes
+static size_t load_state();
+static bool read_counts(std::istream& is, const string& section,
+						FreqTable& counts);
+static void save_loop();
+static bool collect();
+static bool write_state();
+static void write_counts(FILE* f, const string& section,
+						 const FreqTable& counts);
+
+static int recovery_rank = 0;
+static string state_path;
+// Input and section of the state, as its second and third lines
+static string identity;
+// Chunks done by an earlier run
+static vector<bool> reloaded;
+
+// Chunks that are done and their counts (owned by the saving thread)
+static vector<long long> saved_chunks;
+static FreqTable saved_langs, saved_hashtags;
+static bool write_failed = false;
+
+// Chunks handed over by the workers, and the saving thread's stop signal
+static std::mutex pending_mutex;
+static std::condition_variable stop_signal;
+static vector<DoneChunk> pending;
+static bool stopping = false;
+static std::thread saver;
+
+/**
+ * Loads the state of an earlier run of the job (if it is of the same input,
+ * unchanged, and of the same section and chunks) and starts the thread that
+ * saves the state of this one.
+ * @param filename path of twitter file
+ * @param start first byte of the section of this process
+ * @param end last byte of the section
+ * @param chunk_size bytes of a chunk
+ * @param n_chunks number of chunks of the section
+ */
+void recovery_start(const char* filename, long long start, long long end,
+					long long chunk_size, long long n_chunks) {
+	MPI_Comm_rank(MPI_COMM_WORLD, &recovery_rank);
+	state_path = options.recovery + "/tp." + std::to_string(recovery_rank) +
+				 ".recovery";
+	struct stat sb {};
+	stat(filename, &sb);
+	std::stringstream id;
+	id << filename << "\n"
+	   << sb.st_size << " " << sb.st_mtime << " " << start << " " << end
+	   << " " << chunk_size;
+	identity = id.str();
+
+	reloaded.assign(n_chunks, false);
+	saved_chunks.clear();
+	saved_langs = FreqTable();
+	saved_hashtags = FreqTable();
+	size_t n = load_state();
+	if (n) {
+		std::stringstream m;
+		m << "[*] MPI " << recovery_rank << " recovery: resuming with " << n
+		  << " of " << n_chunks << " chunks done" << std::endl;
+		std::cerr << m.str();
+	}
+
+	stopping = false;
+	write_failed = false;
+	saver = std::thread(save_loop);
+}
+
+/**
+ * Whether a chunk was done by an earlier run (its counts were reloaded).
+ * @param chunk index of the chunk in the section
+ */
+bool recovery_done(long long chunk) {
+	return reloaded[chunk];
+}
+
+/**
+ * Hands the counts of a chunk that is done to the saving thread, leaving
+ * the tables empty for the next chunk.
+ * @param chunk index of the chunk in the section
+ * @param lang_freq_map language frequency table of the chunk
+ * @param hashtag_freq_map hashtag frequency table of the chunk
+ */
+void recovery_add(long long chunk, FreqTable& lang_freq_map,
+				  FreqTable& hashtag_freq_map) {
+	DoneChunk done{chunk, std::move(lang_freq_map),
+				   std::move(hashtag_freq_map)};
+	lang_freq_map = FreqTable();
+	hashtag_freq_map = FreqTable();
+	std::lock_guard<std::mutex> lock(pending_mutex);
+	pending.push_back(std::move(done));
+}
+
+/**
+ * Stops the saving thread (which saves any chunks that are not yet) and
+ * adds the counts of every chunk, reloaded or not, to the tables.
+ * @param lang_freq_map language frequency table
+ * @param hashtag_freq_map hashtag frequency table
+ */
+void recovery_finish(FreqTable& lang_freq_map, FreqTable& hashtag_freq_map) {
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex);
+		stopping = true;
+	}
+	stop_signal.notify_all();
+	saver.join();
+	lang_freq_map.merge(saved_langs);
+	hashtag_freq_map.merge(saved_hashtags);
+	saved_langs = FreqTable();
+	saved_hashtags = FreqTable();
+}
+
+/**
+ * Removes the state, once the results of the job are out (so that the next
+ * job starts over).
+ */
+void recovery_remove() {
+	if (!state_path.empty()) {
+		unlink(state_path.c_str());
+	}
+}
+
+/**
+ * Reads the state of an earlier run into the saved chunks and counts, unless
+ * it is of another input or section (or cannot be read), in which case the
+ * run starts over.
+ * @return number of chunks done by the earlier run
+ */
+static size_t load_state() {
+	std::ifstream is(state_path, std::ifstream::binary);
+	if (!is.is_open()) {
+		return 0;
+	}
+	string line, input, section, word;
+	getline(is, line);
+	getline(is, input);
+	getline(is, section);
+	if (line != RECOVERY_VERSION || input + "\n" + section != identity) {
+		std::stringstream m;
+		m << "[!] MPI " << recovery_rank << " recovery: " << state_path
+		  << " is of another input or section, starting over" << std::endl;
+		std::cerr << m.str();
+		return 0;
+	}
+
+	// Read into new tables, kept only if the whole state is valid
+	vector<long long> chunks;
+	FreqTable langs, hashtags;
+	size_t n = 0;
+	bool valid = (bool)(is >> word >> n) && word == "chunks";
+	for (size_t i = 0; valid && i < n; i++) {
+		long long chunk;
+		valid = (bool)(is >> chunk) && chunk >= 0 &&
+				chunk < (long long)reloaded.size() && !reloaded[chunk];
+		if (valid) {
+			reloaded[chunk] = true;
+			chunks.push_back(chunk);
+		}
+	}
+	getline(is, line);
+	valid = valid && read_counts(is, "languages", langs) &&
+			read_counts(is, "hashtags", hashtags);
+	if (!valid) {
+		std::stringstream m;
+		m << "[!] MPI " << recovery_rank << " recovery: " << state_path
+		  << " is not valid, starting over" << std::endl;
+		std::cerr << m.str();
+		reloaded.assign(reloaded.size(), false);
+		return 0;
+	}
+	saved_chunks = std::move(chunks);
+	saved_langs = std::move(langs);
+	saved_hashtags = std::move(hashtags);
+	return saved_chunks.size();
+}
+
+/**
+ * Reads a section of counts of a state.
+ * @param is state
+ * @param section name of the section, e.g.: "languages"
+ * @param counts table the counts are added to
+ * @return whether the section is valid
+ */
+static bool read_counts(std::istream& is, const string& section,
+						FreqTable& counts) {
+	string word, line;
+	unsigned long n = 0;
+	is >> word >> n;
+	getline(is, line);
+	if (word != section || !is) {
+		return false;
+	}
+	for (unsigned long i = 0; i < n; i++) {
+		getline(is, line);
+		size_t space = line.find(' ');
+		char* end;
+		unsigned long count = strtoul(line.c_str(), &end, 10);
+		if (!is || space == string::npos || end != line.c_str() + space ||
+			count == 0) {
+			return false;
+		}
+		counts.increment(line.c_str() + space + 1, line.size() - space - 1,
+						 count);
+	}
+	return true;
+}
+
+/**
+ * Saving thread: every options.recovery_interval seconds (and once the work
+ * is done), adds the chunks handed over since the last time to the saved
+ * ones and writes the state.
+ */
+static void save_loop() {
+	bool done = false;
+	while (!done) {
+		{
+			std::unique_lock<std::mutex> lock(pending_mutex);
+			done = stop_signal.wait_for(
+				lock, std::chrono::seconds(options.recovery_interval),
+				[] { return stopping; });
+		}
+		if (collect() && !write_state() && !write_failed) {
+			std::stringstream m;
+			m << "[!] MPI " << recovery_rank << " recovery: cannot write "
+			  << state_path << " (" << strerror(errno) << ")" << std::endl;
+			std::cerr << m.str();
+			write_failed = true;
+		}
+	}
+}
+
+/**
+ * Adds the chunks handed over by the workers to the saved ones.
+ * @return whether there were any
+ */
+static bool collect() {
+	vector<DoneChunk> done;
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex);
+		done.swap(pending);
+	}
+	for (DoneChunk& d : done) {
+		saved_chunks.push_back(d.chunk);
+		saved_langs.merge(d.langs);
+		saved_hashtags.merge(d.hashtags);
+	}
+	return !done.empty();
+}
+
+/**
+ * Writes the saved chunks and counts to a temporary file, syncs it and
+ * renames it over the state.
+ * @return whether the state was written
+ */
+static bool write_state() {
+	string temporary = state_path + ".tmp";
+	FILE* f = fopen(temporary.c_str(), "w");
+	if (f == nullptr) {
+		return false;
+	}
+	fprintf(f, "%s\n%s\nchunks %zu\n", RECOVERY_VERSION, identity.c_str(),
+			saved_chunks.size());
+	for (long long chunk : saved_chunks) {
+		fprintf(f, "%lld\n", chunk);
+	}
+	write_counts(f, "languages", saved_langs);
+	write_counts(f, "hashtags", saved_hashtags);
+	bool written = fflush(f) == 0 && !ferror(f) && fsync(fileno(f)) == 0;
+	written = fclose(f) == 0 && written;
+	return written && rename(temporary.c_str(), state_path.c_str()) == 0;
+}
+
+/**
+ * Writes a section of counts of a state.
+ * @param f state
+ * @param section name of the section, e.g.: "languages"
+ * @param counts counts
+ */
+static void write_counts(FILE* f, const string& section,
+						 const FreqTable& counts) {
+	fprintf(f, "%s %zu\n", section.c_str(), counts.size());
+	counts.for_each([f](const char* key, size_t length, unsigned long count) {
+		fprintf(f, "%lu ", count);
+		fwrite(key, 1, length, f);
+		fputc('\n', f);
+	});
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "freq_table.hpp"
+
+/**
+ * Loads the state of an earlier run of the job (if it is of the same input
+ * and section) and starts the thread that saves the state of this one.
+ */
+void recovery_start(const char* filename, long long start, long long end,
+					long long chunk_size, long long n_chunks);
+
+/**
+ * Whether a chunk was done by an earlier run (its counts were reloaded).
+ */
+bool recovery_done(long long chunk);
+
+/**
+ * Hands the counts of a chunk that is done to the saving thread.
+ */
+void recovery_add(long long chunk, FreqTable& lang_freq_map,
+				  FreqTable& hashtag_freq_map);
+
+/**
+ * Stops the saving thread (after a last save) and adds the counts of every
+ * chunk, reloaded or not, to the tables.
+ */
+void recovery_finish(FreqTable& lang_freq_map, FreqTable& hashtag_freq_map);
+
+/**
+ * Removes the state, once the results of the job are out.
+ */
+void recovery_remove();
@@ -0,0 +1,637 @@
+// Extracts the fields of a tweet by finding their keys in the line
+// Rows from CouchDB are {"id":..,"key":..,"value":..,"doc":{..}}, with the
+// tweet last, so the keys after "doc" are found in one pass (a SIMD search
+// for the end of every key, a quote followed by a colon) and only the values
+// of the fields are looked at (the arrays of the entities are read element
+// by element for the key wanted in each object). The brackets of the doc are
+// then found in a second SIMD pass, which ends it and tells its own keys
+// from those nested in its values (e.g.: the lang of its user). A line that
+// looks any different (a key found twice, a retweeted or quoted status, no
+// "doc") is left to the parser
+
+// References:
+// http://0x80.pl/articles/simd-strfind.html (substring search)
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "json_string.hpp"
+#include "scan.hpp"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using std::string_view;
+using std::vector;
+
+// Texts that can be found in a tweet (its own, and those of hashtags and
+// symbols in its entities)
+static const size_t MAX_TEXTS = 64;
+
+// Times and languages that can be found in a tweet (its own, and its
+// user's)
+static const size_t MAX_CREATED_AT = 4;
+static const size_t MAX_LANGS = 4;
+
+// Objects and arrays that can be values of the keys of the doc
+static const size_t MAX_NESTED = 64;
+
+/**
+ * Keys found in a tweet (the quote ending the key, nullptr if not found).
+ */
+struct TweetKeys {
+	const char* doc = nullptr;
+	const char* entities = nullptr;
+	const char* hashtags = nullptr;
+	const char* user_mentions = nullptr; // only with the other entities
+	const char* urls = nullptr;          // only with the other entities
+	const char* texts[MAX_TEXTS];
+	size_t n_texts = 0;
+	const char* created_at[MAX_CREATED_AT];
+	size_t n_created_at = 0;
+	const char* langs[MAX_LANGS];
+	size_t n_langs = 0;
+	bool other_entities = false; // whether mentions and URLs are wanted
+};
+
+/**
+ * Objects and arrays that are values of the keys of the doc (the brackets
+ * opening and closing them, in order), so that the keys of the doc can be
+ * told from those nested in its values.
+ */
+struct NestedValues {
+	const char* begin[MAX_NESTED];
+	const char* end[MAX_NESTED];
+	size_t n = 0;
+	bool overflow = false; // whether there were more than MAX_NESTED
+
+	void open(const char* p) {
+		if (n == MAX_NESTED) {
+			overflow = true;
+		} else {
+			begin[n] = p;
+		}
+	}
+	void close(const char* p) {
+		if (!overflow) {
+			end[n++] = p;
+		}
+	}
+};
+
+// Function prototypes
+static bool find_keys(const char* line, const char* end, TweetKeys& keys);
+static bool doc_key(const char* const* found, size_t n, const char* doc_end,
+					const NestedValues& nested, const char*& key);
+static bool is_doc_key(const char* key, const char* doc_end,
+					   const NestedValues& nested);
+static const char* string_end(const char* p, const char* end);
+static const char* skip_value(const char* p, const char* end);
+static const char* skip_container(const char* p, const char* end,
+								  NestedValues* nested);
+static const char* skip_whitespace(const char* p, const char* end);
+static bool scan_entities(const char* key, const char* entities,
+						  const char* entities_end, string_view name,
+						  vector<string_view>& values);
+static const char* scan_entity(const char* p, const char* end,
+							   string_view name, vector<string_view>& values);
+static bool decode(std::string_view& value);
+static bool decode_all(vector<string_view>& values);
+
+/**
+ * Extracts the language, text, entity hashtags and created_at of a line by
+ * finding their keys (and the screen names of the entity mentions and the
+ * expanded URLs of the entity URLs, if entities). Nothing is written to the
+ * line (strings are unescaped in place) until the layout has been
+ * recognised.
+ * @param line line (null terminated JSON)
+ * @param length number of bytes in line
+ * @param entities whether the mentions and URLs are extracted
+ * @param tweet set to the fields of the line (when FOUND)
+ * @return FOUND, UNUSUAL (the line is unchanged, and should be parsed) or
+ * INVALID
+ */
+ScanResult scan_tweet(char* line, size_t length, bool entities,
+					  Tweet& tweet) {
+	const char* end = line + length;
+	TweetKeys keys;
+	keys.other_entities = entities;
+	if (!find_keys(line, end, keys) || !keys.doc || keys.doc[2] != '{') {
+		return ScanResult::UNUSUAL;
+	}
+
+	// The doc and the values nested in it: only the keys of the doc itself
+	// are its fields (not those of its user, its entities or after it), as
+	// for SAX
+	NestedValues nested;
+	const char* doc_end = skip_container(keys.doc + 2, end, &nested);
+	if (!doc_end || nested.overflow) {
+		return ScanResult::UNUSUAL;
+	}
+
+	// Hashtags, mentions and URLs, within the entities
+	const char* entities_end = nullptr;
+	if (keys.entities && !is_doc_key(keys.entities, doc_end, nested)) {
+		keys.entities = nullptr;
+	}
+	if (keys.entities) {
+		if (keys.entities[2] != '{' ||
+			!(entities_end = skip_value(keys.entities + 2, end))) {
+			return ScanResult::UNUSUAL;
+		}
+	}
+	if (!scan_entities(keys.hashtags, keys.entities, entities_end, "text",
+					   tweet.hashtags) ||
+		!scan_entities(keys.user_mentions, keys.entities, entities_end,
+					   "screen_name", tweet.mentions) ||
+		!scan_entities(keys.urls, keys.entities, entities_end,
+					   "expanded_url", tweet.urls)) {
+		return ScanResult::UNUSUAL;
+	}
+
+	// Text, language and time
+	const char* text = nullptr;
+	const char* lang = nullptr;
+	const char* created_at = nullptr;
+	if (!doc_key(keys.texts, keys.n_texts, doc_end, nested, text) ||
+		!doc_key(keys.langs, keys.n_langs, doc_end, nested, lang) ||
+		!doc_key(keys.created_at, keys.n_created_at, doc_end, nested,
+				 created_at)) {
+		return ScanResult::UNUSUAL;
+	}
+
+	// The values (strings right after the colon, other values are ignored as
+	// SAX does)
+	const char* text_end = nullptr;
+	const char* lang_end = nullptr;
+	const char* created_at_end = nullptr;
+	for (const char** key : {&text, &lang, &created_at}) {
+		if (!*key) {
+			continue;
+		}
+		char c = (*key)[2];
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			return ScanResult::UNUSUAL;
+		}
+		if (c != '"') {
+			*key = nullptr;
+		}
+	}
+	if ((text && !(text_end = string_end(text + 3, end))) ||
+		(lang && !(lang_end = string_end(lang + 3, end))) ||
+		(created_at && !(created_at_end = string_end(created_at + 3, end)))) {
+		return ScanResult::UNUSUAL;
+	}
+
+	// Unescape the values, now that nothing else is searched for
+	if (text) {
+		tweet.text = string_view(text + 3, text_end - text - 3);
+		if (!decode(tweet.text)) {
+			return ScanResult::INVALID;
+		}
+	}
+	if (lang) {
+		tweet.lang = string_view(lang + 3, lang_end - lang - 3);
+		if (!decode(tweet.lang)) {
+			return ScanResult::INVALID;
+		}
+	}
+	if (created_at) {
+		tweet.created_at =
+			string_view(created_at + 3, created_at_end - created_at - 3);
+		if (!decode(tweet.created_at)) {
+			return ScanResult::INVALID;
+		}
+	}
+	if (!decode_all(tweet.hashtags) || !decode_all(tweet.mentions) ||
+		!decode_all(tweet.urls)) {
+		return ScanResult::INVALID;
+	}
+	return ScanResult::FOUND;
+}
+
+/**
+ * Whether the quote at p is escaped (preceded by an odd number of
+ * backslashes, after begin).
+ */
+static inline bool is_escaped(const char* begin, const char* p) {
+	const char* q = p;
+	while (q > begin && q[-1] == '\\') {
+		q--;
+	}
+	return (p - q) & 1;
+}
+
+/**
+ * Whether the key ending at quote (the closing quote of the key) is name.
+ */
+static inline bool key_is(const char* line, const char* quote,
+						  string_view name) {
+	const char* open = quote - name.size() - 1;
+	return open >= line && *open == '"' &&
+		   memcmp(open + 1, name.data(), name.size()) == 0 &&
+		   !is_escaped(line, open);
+}
+
+/**
+ * Records a key (the quote ending it, at p) if it is one of the keys of the
+ * fields.
+ * @return false if the key makes the line unusual (a repeated key, or a
+ * status nested in the tweet)
+ */
+static inline bool add_key(const char* line, const char* p, TweetKeys& keys) {
+	if (p == line) {
+		return true;
+	}
+	const char** key = nullptr;
+	switch (p[-1]) {
+	case 'c':
+		if (key_is(line, p, "doc")) {
+			key = &keys.doc;
+		}
+		break;
+	case 'g':
+		if (keys.doc && key_is(line, p, "lang")) {
+			if (keys.n_langs == MAX_LANGS) {
+				return false;
+			}
+			keys.langs[keys.n_langs++] = p;
+		}
+		return true;
+	case 't':
+		if (keys.doc && key_is(line, p, "text")) {
+			if (keys.n_texts == MAX_TEXTS) {
+				return false;
+			}
+			keys.texts[keys.n_texts++] = p;
+		} else if (keys.doc && key_is(line, p, "created_at")) {
+			if (keys.n_created_at == MAX_CREATED_AT) {
+				return false;
+			}
+			keys.created_at[keys.n_created_at++] = p;
+		}
+		return true;
+	case 's':
+		if (!keys.doc) {
+			return true;
+		}
+		if (key_is(line, p, "entities")) {
+			key = &keys.entities;
+		} else if (key_is(line, p, "hashtags")) {
+			key = &keys.hashtags;
+		} else if (keys.other_entities && key_is(line, p, "user_mentions")) {
+			key = &keys.user_mentions;
+		} else if (keys.other_entities && key_is(line, p, "urls")) {
+			key = &keys.urls;
+		} else if (key_is(line, p, "retweeted_status") ||
+				   key_is(line, p, "quoted_status")) {
+			return false;
+		}
+		break;
+	}
+	if (!key) {
+		return true;
+	}
+	if (*key) {
+		return false;
+	}
+	*key = p;
+	return true;
+}
+
+/**
+ * Finds the keys of the fields, in one pass over the line: the end of every
+ * key (a quote followed by a colon, with the quote not escaped) is found 16
+ * bytes at a time, and compared with the keys of the fields.
+ * @param line line
+ * @param end end of the line
+ * @param keys set to the keys found
+ * @return false if the line is unusual
+ */
+static bool find_keys(const char* line, const char* end, TweetKeys& keys) {
+	const char* p = line;
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i colon = _mm_set1_epi8(':');
+	for (; p + 17 <= end; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+		unsigned mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(a, quote), _mm_cmpeq_epi8(b, colon)));
+		while (mask) {
+			const char* q = p + __builtin_ctz(mask);
+			if (!is_escaped(line, q) && !add_key(line, q, keys)) {
+				return false;
+			}
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; p + 1 < end; p++) {
+		if (p[0] == '"' && p[1] == ':' && !is_escaped(line, p) &&
+			!add_key(line, p, keys)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Finds the key of the doc among the keys found with a name.
+ * @param found keys found (in the doc, in its values or after it)
+ * @param n number of keys found
+ * @param doc_end first byte after the doc
+ * @param nested values nested in the doc
+ * @param key set to the key of the doc (nullptr if it has none)
+ * @return false if the doc has the key more than once
+ */
+static bool doc_key(const char* const* found, size_t n, const char* doc_end,
+					const NestedValues& nested, const char*& key) {
+	for (size_t i = 0; i < n; i++) {
+		if (!is_doc_key(found[i], doc_end, nested)) {
+			continue;
+		}
+		if (key) {
+			return false;
+		}
+		key = found[i];
+	}
+	return true;
+}
+
+/**
+ * Whether a key found after "doc" is a key of the doc (before its end, and
+ * not within any of its values).
+ * @param key key (the quote ending it)
+ * @param doc_end first byte after the doc
+ * @param nested values nested in the doc
+ */
+static bool is_doc_key(const char* key, const char* doc_end,
+					   const NestedValues& nested) {
+	if (key >= doc_end) {
+		return false;
+	}
+	size_t i = std::upper_bound(nested.begin, nested.begin + nested.n, key) -
+			   nested.begin;
+	return i == 0 || key > nested.end[i - 1];
+}
+
+/**
+ * Finds the closing quote of a string.
+ * @param p first byte of the string (after its opening quote)
+ * @param end end of the line
+ * @return closing quote (nullptr if there is none)
+ */
+static const char* string_end(const char* p, const char* end) {
+	const char* begin = p;
+	while ((p = (const char*)memchr(p, '"', end - p)) != nullptr) {
+		if (!is_escaped(begin, p)) {
+			return p;
+		}
+		p++;
+	}
+	return nullptr;
+}
+
+/**
+ * Skips a value (a string, an object or array with its strings, or the
+ * characters of a scalar).
+ * @param p start of the value
+ * @param end end of the line
+ * @return first byte after the value (nullptr if the line ends first)
+ */
+static const char* skip_value(const char* p, const char* end) {
+	if (p >= end) {
+		return nullptr;
+	}
+	if (*p == '"') {
+		p = string_end(p + 1, end);
+		return p ? p + 1 : nullptr;
+	}
+	if (*p == '{' || *p == '[') {
+		return skip_container(p, end, nullptr);
+	}
+	const char* start = p;
+	while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+		   skip_whitespace(p, end) == p) {
+		p++;
+	}
+	return p == start ? nullptr : p;
+}
+
+/**
+ * Skips an object or array: its brackets are found 16 bytes at a time,
+ * passing over those within strings (the bytes between unescaped quotes).
+ * @param p opening bracket
+ * @param end end of the line
+ * @param nested set to the objects and arrays that are its values (if not
+ * nullptr)
+ * @return first byte after it (nullptr if the line ends first)
+ */
+static const char* skip_container(const char* p, const char* end,
+								  NestedValues* nested) {
+	const char* begin = p;
+	size_t depth = 0;
+	bool in_string = false;
+#if defined(__SSE2__)
+	// '{' and '[' are both 0x7b with the 0x20 bit set, '}' and ']' 0x7d
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i open = _mm_set1_epi8('{');
+	const __m128i close = _mm_set1_epi8('}');
+	const __m128i bit = _mm_set1_epi8(0x20);
+	for (; p + 16 <= end; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_or_si128(a, bit);
+		unsigned quotes = _mm_movemask_epi8(_mm_cmpeq_epi8(a, quote));
+		unsigned brackets = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(b, open), _mm_cmpeq_epi8(b, close)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, backslash)) ||
+			(p > begin && p[-1] == '\\')) {
+			// Some quotes may be escaped: drop those
+			for (unsigned m = quotes; m; m &= m - 1) {
+				if (is_escaped(begin, p + __builtin_ctz(m))) {
+					quotes &= ~(m & -m);
+				}
+			}
+		}
+
+		// Bytes within strings (from an opening quote up to its closing
+		// quote), by a prefix xor of the quotes
+		unsigned strings = quotes;
+		strings ^= strings << 1;
+		strings ^= strings << 2;
+		strings ^= strings << 4;
+		strings ^= strings << 8;
+		strings = (in_string ? ~strings : strings) & 0xffff;
+		in_string = strings >> 15;
+
+		for (unsigned m = brackets & ~strings; m; m &= m - 1) {
+			const char* q = p + __builtin_ctz(m);
+			if ((*q | 0x20) == '{') {
+				if (++depth == 2 && nested) {
+					nested->open(q);
+				}
+			} else if (--depth == 0) {
+				return q + 1;
+			} else if (depth == 1 && nested) {
+				nested->close(q);
+			}
+		}
+	}
+#endif
+	for (; p < end; p++) {
+		if (*p == '"') {
+			in_string = !in_string || is_escaped(begin, p);
+		} else if (in_string) {
+			continue;
+		} else if (*p == '{' || *p == '[') {
+			if (++depth == 2 && nested) {
+				nested->open(p);
+			}
+		} else if (*p == '}' || *p == ']') {
+			if (--depth == 0) {
+				return p + 1;
+			}
+			if (depth == 1 && nested) {
+				nested->close(p);
+			}
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Skips JSON whitespace.
+ */
+static const char* skip_whitespace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+		p++;
+	}
+	return p;
+}
+
+/**
+ * Adds the values (still escaped) of a key in the objects of an array of the
+ * entities, e.g.: the "text" of each of "hashtags":[{"text":"tag"}]
+ * @param key key of the array (the quote ending it, nullptr if not found)
+ * @param entities key of the entities (nullptr if not found)
+ * @param entities_end end of the entities
+ * @param name key of the values in the objects, e.g.: "text"
+ * @param values values, added to
+ * @return false if the array is not in the entities, or is malformed
+ */
+static bool scan_entities(const char* key, const char* entities,
+						  const char* entities_end, string_view name,
+						  vector<string_view>& values) {
+	if (!key) {
+		return true;
+	}
+	if (!entities || key < entities || key > entities_end || key[2] != '[') {
+		return false;
+	}
+	const char* p = skip_whitespace(key + 3, entities_end);
+	const char* end = entities_end;
+	if (p < end && *p == ']') {
+		return true;
+	}
+	while (true) {
+		p = skip_whitespace(p, end);
+		if (p < end && *p == '{') {
+			p = scan_entity(p + 1, end, name, values);
+		} else {
+			p = skip_value(p, end);
+		}
+		if (!p) {
+			return false;
+		}
+		p = skip_whitespace(p, end);
+		if (p < end && *p == ']') {
+			return true;
+		}
+		if (p >= end || *p != ',') {
+			return false;
+		}
+		p++;
+	}
+}
+
+/**
+ * Adds the value (still escaped) of a key in an object of the entities, if it
+ * is a string, e.g.: {"text":"tag","indices":[1,4]}
+ * @param p first byte in the object (after its "{")
+ * @param end end of the entities
+ * @param name key of the value, e.g.: "text"
+ * @param values values, added to
+ * @return first byte after the object (nullptr if it is malformed)
+ */
+static const char* scan_entity(const char* p, const char* end,
+							   string_view name, vector<string_view>& values) {
+	p = skip_whitespace(p, end);
+	if (p < end && *p == '}') {
+		return p + 1;
+	}
+	while (true) {
+		p = skip_whitespace(p, end);
+		if (p >= end || *p != '"') {
+			return nullptr;
+		}
+		const char* key = p + 1;
+		const char* key_end = string_end(key, end);
+		if (!key_end) {
+			return nullptr;
+		}
+		p = skip_whitespace(key_end + 1, end);
+		if (p >= end || *p != ':') {
+			return nullptr;
+		}
+		p = skip_whitespace(p + 1, end);
+		if (string_view(key, key_end - key) == name && p < end && *p == '"') {
+			const char* value_end = string_end(p + 1, end);
+			if (!value_end) {
+				return nullptr;
+			}
+			values.emplace_back(p + 1, value_end - p - 1);
+			p = value_end + 1;
+		} else if (!(p = skip_value(p, end))) {
+			return nullptr;
+		}
+		p = skip_whitespace(p, end);
+		if (p < end && *p == '}') {
+			return p + 1;
+		}
+		if (p >= end || *p != ',') {
+			return nullptr;
+		}
+		p++;
+	}
+}
+
+/**
+ * Unescapes a value in place (the line is writable, the view is not).
+ * @param value value, set to the unescaped value
+ * @return false for an invalid escape
+ */
+static bool decode(string_view& value) {
+	char* str = (char*)value.data();
+	size_t length = unescape_json_string(str, value.size());
+	if (length == INVALID_JSON_STRING) {
+		return false;
+	}
+	value = string_view(str, length);
+	return true;
+}
+
+/**
+ * Unescapes values in place (see decode).
+ * @return false for an invalid escape
+ */
+static bool decode_all(vector<string_view>& values) {
+	for (string_view& value : values) {
+		if (!decode(value)) {
+			return false;
+		}
+	}
+	return true;
+}
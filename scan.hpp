@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include "tweet.hpp"
+
+/**
+ * Result of scanning a line.
+ */
+enum class ScanResult {
+	FOUND,   // fields extracted
+	UNUSUAL, // layout not recognised (line left unchanged, to be parsed)
+	INVALID, // invalid string escape
+};
+
+/**
+ * Extracts the fields of a line in the usual CouchDB layout by searching for
+ * their keys (with the mentions and URLs of the entities if asked for).
+ */
+ScanResult scan_tweet(char* line, size_t length, bool entities, Tweet& tweet);
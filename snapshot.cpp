@@ -0,0 +1,406 @@
+// Result snapshots
+// --snapshot=file writes the final language and hashtag tables of a run to a
+// snapshot, and "tp merge a.snap b.snap ..." merges any number of snapshots
+// (e.g.: of independent jobs over parts of a corpus, or of the days of a
+// feed) and prints the usual report. Keys are sorted, so snapshots are
+// merged in one streaming pass, holding one key per snapshot and the top
+// keys of each table (and writing the merged snapshot as it goes, with
+// --snapshot)
+//
+// Format:
+//   magic "TPSNAP01"
+//   languages, then hashtags: entries in increasing (byte) order of key,
+//     each a varint count (> 0), a varint number of bytes shared with the
+//     previous key, a varint suffix length and the suffix; then a varint 0
+//   checksum: FNV-1a (64 bit, little endian) of every byte before it
+// Varints are LEB128 (7 bits per byte, least significant first)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include "combine.hpp"
+#include "options.hpp"
+#include "snapshot.hpp"
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// First bytes of a snapshot (of version 1 of the format)
+static const char SNAPSHOT_MAGIC[8] = {'T', 'P', 'S', 'N', 'A', 'P', '0', '1'};
+
+// FNV-1a (64 bit)
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// Number of tables in a snapshot (languages and hashtags)
+static const int N_TABLES = 2;
+
+/**
+ * Writes a snapshot, one table at a time, from keys given in increasing
+ * order.
+ */
+class SnapshotWriter {
+  public:
+	/**
+	 * @param path path of the snapshot (exits if it cannot be written)
+	 */
+	explicit SnapshotWriter(const string& path)
+		: os(path, std::ofstream::binary), path(path) {
+		if (!os.is_open()) {
+			fail("cannot be written");
+		}
+		put(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	}
+
+	/**
+	 * Adds a key of the current table (greater than the previous one).
+	 */
+	void add(const string& key, unsigned long count) {
+		size_t shared = 0;
+		size_t n = std::min(key.size(), previous.size());
+		while (shared < n && key[shared] == previous[shared]) {
+			shared++;
+		}
+		put_varint(count);
+		put_varint(shared);
+		put_varint(key.size() - shared);
+		put(key.data() + shared, key.size() - shared);
+		previous = key;
+	}
+
+	/**
+	 * Ends the current table.
+	 */
+	void end_table() {
+		put_varint(0);
+		previous.clear();
+	}
+
+	/**
+	 * Writes the checksum and closes the snapshot.
+	 */
+	void close() {
+		char bytes[8];
+		for (int i = 0; i < 8; i++) {
+			bytes[i] = (char)(checksum >> (8 * i));
+		}
+		os.write(bytes, sizeof(bytes));
+		os.close();
+		if (os.fail()) {
+			fail("cannot be written");
+		}
+	}
+
+  private:
+	std::ofstream os;
+	string path;
+	string previous;
+	uint64_t checksum = FNV_OFFSET;
+
+	void put(const char* bytes, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			checksum = (checksum ^ (unsigned char)bytes[i]) * FNV_PRIME;
+		}
+		os.write(bytes, n);
+	}
+
+	void put_varint(uint64_t value) {
+		char bytes[10];
+		size_t n = 0;
+		do {
+			bytes[n++] = (char)((value & 0x7F) | (value >= 0x80 ? 0x80 : 0));
+			value >>= 7;
+		} while (value);
+		put(bytes, n);
+	}
+
+	void fail(const char* reason) {
+		std::cerr << "[!] Snapshot " << path << " " << reason << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+};
+
+/**
+ * Reads a snapshot, one entry at a time, checking it as it goes (keys in
+ * increasing order, and the checksum at the end).
+ */
+class SnapshotReader {
+  public:
+	/**
+	 * @param path path of the snapshot (exits if it cannot be read)
+	 */
+	explicit SnapshotReader(const string& path)
+		: is(path, std::ifstream::binary), path(path) {
+		if (!is.is_open()) {
+			std::cerr << "[!] Cannot read snapshot " << path << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		char magic[sizeof(SNAPSHOT_MAGIC)];
+		for (char& c : magic) {
+			c = get();
+		}
+		if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+			fail("not a snapshot (or of another version)");
+		}
+	}
+
+	/**
+	 * Reads the next entry of the current table.
+	 * @return whether there is one (false at the end of the table, after
+	 * which the next call reads the next table)
+	 */
+	bool next() {
+		current_count = get_varint();
+		if (current_count == 0) {
+			current_key.clear();
+			first = true;
+			return false;
+		}
+		uint64_t shared = get_varint();
+		uint64_t suffix = get_varint();
+		if (shared > current_key.size() || suffix > MAX_KEY) {
+			fail("invalid key");
+		}
+		previous.swap(current_key);
+		current_key.assign(previous, 0, shared);
+		for (uint64_t i = 0; i < suffix; i++) {
+			current_key += get();
+		}
+		if (!first && current_key <= previous) {
+			fail("keys out of order");
+		}
+		first = false;
+		return true;
+	}
+
+	const string& key() const {
+		return current_key;
+	}
+
+	unsigned long count() const {
+		return current_count;
+	}
+
+	/**
+	 * Reads and checks the checksum (after the last table).
+	 */
+	void finish() {
+		uint64_t expected = checksum;
+		uint64_t stored = 0;
+		for (int i = 0; i < 8; i++) {
+			stored |= (uint64_t)(unsigned char)get() << (8 * i);
+		}
+		if (stored != expected || is.peek() != EOF) {
+			fail("checksum mismatch");
+		}
+	}
+
+  private:
+	// Longest key accepted (a guard against corrupt lengths)
+	static const uint64_t MAX_KEY = 1 << 24;
+
+	std::ifstream is;
+	string path;
+	string current_key;
+	string previous;
+	unsigned long current_count = 0;
+	bool first = true;
+	uint64_t checksum = FNV_OFFSET;
+
+	char get() {
+		int c = is.get();
+		if (c == EOF) {
+			fail("truncated");
+		}
+		checksum = (checksum ^ (unsigned char)c) * FNV_PRIME;
+		return (char)c;
+	}
+
+	uint64_t get_varint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			unsigned char c = get();
+			value |= (uint64_t)(c & 0x7F) << shift;
+			if (!(c & 0x80)) {
+				return value;
+			}
+		}
+		fail("invalid varint");
+		return 0;
+	}
+
+	void fail(const char* reason) {
+		std::cerr << "[!] Corrupt snapshot " << path << ": " << reason
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+};
+
+/**
+ * The keys of the TOP_K highest counts of a table, with any ties of the
+ * TOP_K-th (as printed by the report).
+ */
+class TopKeys {
+  public:
+	void add(const string& key, unsigned long count) {
+		if (entries.size() >= TOP_K && count < threshold) {
+			return;
+		}
+		entries.emplace(count, key);
+		if (entries.size() > TOP_K) {
+			threshold = std::prev(entries.end(), TOP_K)->first;
+			entries.erase(entries.begin(), entries.lower_bound(threshold));
+		}
+	}
+
+	unordered_map<string, unsigned long> to_map() const {
+		unordered_map<string, unsigned long> map;
+		for (const auto& it : entries) {
+			map.emplace(it.second, it.first);
+		}
+		return map;
+	}
+
+  private:
+	std::multimap<unsigned long, string> entries;
+	unsigned long threshold = 0;
+};
+
+// Function prototypes
+static void write_table(SnapshotWriter& writer,
+						const unordered_map<string, unsigned long>& table);
+static void merge_table(vector<std::unique_ptr<SnapshotReader>>& readers,
+						TopKeys& top, SnapshotWriter* writer);
+
+/**
+ * Writes the language and hashtag tables of a run to a snapshot.
+ * @param path path of the snapshot
+ * @param results pair of lang_freq_map and hashtag_freq_map
+ */
+void write_snapshot(
+	const string& path,
+	const pair<unordered_map<string, unsigned long>,
+			   unordered_map<string, unsigned long>>& results) {
+	SnapshotWriter writer(path);
+	write_table(writer, results.first);
+	write_table(writer, results.second);
+	writer.close();
+}
+
+/**
+ * Writes a table, sorted by key.
+ * @param writer snapshot
+ * @param table map of <key, count>
+ */
+static void write_table(SnapshotWriter& writer,
+						const unordered_map<string, unsigned long>& table) {
+	vector<const pair<const string, unsigned long>*> entries;
+	entries.reserve(table.size());
+	for (const auto& it : table) {
+		entries.push_back(&it);
+	}
+	std::sort(entries.begin(), entries.end(),
+			  [](const pair<const string, unsigned long>* a,
+				 const pair<const string, unsigned long>* b) {
+				  return a->first < b->first;
+			  });
+	for (const auto* it : entries) {
+		writer.add(it->first, it->second);
+	}
+	writer.end_table();
+}
+
+/**
+ * Merges snapshots and prints the report of the merged tables, writing them
+ * to a snapshot too with --snapshot.
+ * @param n number of snapshots
+ * @param paths paths of the snapshots
+ * @param lang_map language identifier map e.g.: lang_map["en"] -> "English"
+ */
+void merge_snapshots(int n, char** paths,
+					 const unordered_map<string, string>& lang_map) {
+	if (n < 1) {
+		std::cerr << "usage: tp merge [--snapshot=file] [--lang-codes=file] "
+				  << "a.snap [b.snap ...]" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	vector<std::unique_ptr<SnapshotReader>> readers;
+	for (int i = 0; i < n; i++) {
+		readers.emplace_back(new SnapshotReader(paths[i]));
+	}
+	std::unique_ptr<SnapshotWriter> writer;
+	if (!options.snapshot.empty()) {
+		writer.reset(new SnapshotWriter(options.snapshot));
+	}
+
+	TopKeys top[N_TABLES];
+	for (int t = 0; t < N_TABLES; t++) {
+		merge_table(readers, top[t], writer.get());
+	}
+	for (auto& reader : readers) {
+		reader->finish();
+	}
+	if (writer) {
+		writer->close();
+	}
+
+	unordered_map<string, unsigned long> langs = top[0].to_map();
+	unordered_map<string, unsigned long> hashtags = top[1].to_map();
+	print_results(langs, hashtags, lang_map);
+}
+
+/**
+ * Merges a table of every snapshot (a k-way merge, by a heap of the
+ * snapshots ordered by their current key).
+ * @param readers snapshots, at the start of the table
+ * @param top set to the top keys of the merged table
+ * @param writer merged snapshot (nullptr for none)
+ */
+static void merge_table(vector<std::unique_ptr<SnapshotReader>>& readers,
+						TopKeys& top, SnapshotWriter* writer) {
+	auto greater = [&readers](size_t a, size_t b) {
+		return readers[a]->key() > readers[b]->key();
+	};
+	std::priority_queue<size_t, vector<size_t>, decltype(greater)> heap(
+		greater);
+	for (size_t i = 0; i < readers.size(); i++) {
+		if (readers[i]->next()) {
+			heap.push(i);
+		}
+	}
+	while (!heap.empty()) {
+		// Sum the counts of the smallest key over the snapshots
+		size_t i = heap.top();
+		heap.pop();
+		string key = readers[i]->key();
+		unsigned long count = readers[i]->count();
+		if (readers[i]->next()) {
+			heap.push(i);
+		}
+		while (!heap.empty() && readers[heap.top()]->key() == key) {
+			i = heap.top();
+			heap.pop();
+			count += readers[i]->count();
+			if (readers[i]->next()) {
+				heap.push(i);
+			}
+		}
+		top.add(key, count);
+		if (writer) {
+			writer->add(key, count);
+		}
+	}
+	if (writer) {
+		writer->end_table();
+	}
+}
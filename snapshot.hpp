@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Writes the language and hashtag tables of a run to a snapshot.
+ */
+void write_snapshot(
+	const std::string& path,
+	const std::pair<std::unordered_map<std::string, unsigned long>,
+					std::unordered_map<std::string, unsigned long>>& results);
+
+/**
+ * Merges snapshots and prints the report of the merged tables (tp merge).
+ */
+void merge_snapshots(
+	int n, char** paths,
+	const std::unordered_map<std::string, std::string>& lang_map);
@@ -0,0 +1,197 @@
+// Stage 1 of parsing a line with a structural index (as in simdjson): the
+// line is classified 64 bytes at a time into bitmasks of quotes, backslashes
+// and structural characters, strings are masked out with a prefix xor of the
+// quotes (a carry-less multiply), and the remaining bits become the index
+// that the walker (structural.hpp) jumps through
+
+// References:
+// https://arxiv.org/abs/1902.08318 (Parsing Gigabytes of JSON per Second)
+// https://github.com/simdjson/simdjson (escape and string masks)
+
+#include <cstring>
+#include "structural.hpp"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Bytes classified at a time
+static const size_t BLOCK_SIZE = 64;
+
+/**
+ * Bitmasks of a block (bit i is byte i).
+ */
+struct BlockMasks {
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t op;
+};
+
+#if defined(__AVX2__)
+/**
+ * Bitmasks of 32 bytes, shifted to offset.
+ */
+static inline void classify32(const char* p, int offset, BlockMasks& m) {
+	__m256i x = _mm256_loadu_si256((const __m256i*)p);
+	// "[" and "]" differ from "{" and "}" only by 0x20
+	__m256i folded = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+	__m256i op = _mm256_or_si256(
+		_mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+						_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+		_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(':')),
+						_mm256_cmpeq_epi8(x, _mm256_set1_epi8(','))));
+	m.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+				   _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')))
+			   << offset;
+	m.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+					   _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')))
+				   << offset;
+	m.op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << offset;
+}
+#elif defined(__SSE2__)
+/**
+ * Bitmasks of 16 bytes, shifted to offset.
+ */
+static inline void classify16(const char* p, int offset, BlockMasks& m) {
+	__m128i x = _mm_loadu_si128((const __m128i*)p);
+	// "[" and "]" differ from "{" and "}" only by 0x20
+	__m128i folded = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	__m128i op = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+					 _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+		_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(':')),
+					 _mm_cmpeq_epi8(x, _mm_set1_epi8(','))));
+	m.quote |=
+		(uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')))
+		<< offset;
+	m.backslash |=
+		(uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\\')))
+		<< offset;
+	m.op |= (uint64_t)_mm_movemask_epi8(op) << offset;
+}
+#endif
+
+/**
+ * Classifies a block of 64 bytes.
+ */
+static inline BlockMasks classify(const char* p) {
+	BlockMasks m = {0, 0, 0};
+#if defined(__AVX2__)
+	classify32(p, 0, m);
+	classify32(p + 32, 32, m);
+#elif defined(__SSE2__)
+	classify16(p, 0, m);
+	classify16(p + 16, 16, m);
+	classify16(p + 32, 32, m);
+	classify16(p + 48, 48, m);
+#else
+	for (size_t i = 0; i < BLOCK_SIZE; i++) {
+		uint64_t bit = 1ULL << i;
+		switch (p[i]) {
+		case '"':
+			m.quote |= bit;
+			break;
+		case '\\':
+			m.backslash |= bit;
+			break;
+		case '{':
+		case '}':
+		case '[':
+		case ']':
+		case ':':
+		case ',':
+			m.op |= bit;
+			break;
+		}
+	}
+#endif
+	return m;
+}
+
+/**
+ * Bit i of the result is the xor of bits 0 to i of x (so for a mask of
+ * quotes, the bits from each opening quote up to its closing quote).
+ */
+static inline uint64_t prefix_xor(uint64_t x) {
+#if defined(__PCLMUL__)
+	return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(
+		_mm_set_epi64x(0, (long long)x), _mm_set1_epi8((char)0xFF), 0));
+#else
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+#endif
+}
+
+/**
+ * Mask of the characters escaped by backslashes (the character after each
+ * odd length run of backslashes), carrying a run over into the next block.
+ * @param backslash mask of backslashes
+ * @param prev_escaped whether the first character of the block is escaped
+ * (set for the next block)
+ * @return mask of escaped characters
+ */
+static inline uint64_t find_escaped(uint64_t backslash,
+									uint64_t& prev_escaped) {
+	const uint64_t even_bits = 0x5555555555555555ULL;
+	backslash &= ~prev_escaped;
+	uint64_t follows_escape = backslash << 1 | prev_escaped;
+	// Runs starting on odd bits carry through to the bit after the run
+	uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+	uint64_t sequences_on_even;
+	prev_escaped =
+		__builtin_add_overflow(odd_starts, backslash, &sequences_on_even);
+	uint64_t invert_mask = sequences_on_even << 1;
+	return (even_bits ^ invert_mask) & follows_escape;
+}
+
+/**
+ * Builds the structural index of a line.
+ * @param line line (null terminated)
+ * @param length number of bytes in line (less than 4GB)
+ * @param index set to the positions of the structurals, followed by
+ * STRUCTURAL_PADDING entries of length (only grown, so it can be reused)
+ * @return number of structurals
+ */
+size_t index_structurals(const char* line, size_t length,
+						 std::vector<uint32_t>& index) {
+	if (index.size() < length + BLOCK_SIZE + STRUCTURAL_PADDING) {
+		index.resize(length + BLOCK_SIZE + STRUCTURAL_PADDING);
+	}
+	uint32_t* out = index.data();
+	uint64_t prev_escaped = 0;
+	uint64_t prev_in_string = 0;
+	char last[BLOCK_SIZE];
+
+	for (size_t base = 0; base < length; base += BLOCK_SIZE) {
+		const char* block = line + base;
+		if (length - base < BLOCK_SIZE) {
+			// Pad the last block with spaces
+			memset(last, ' ', BLOCK_SIZE);
+			memcpy(last, block, length - base);
+			block = last;
+		}
+		BlockMasks m = classify(block);
+
+		// Unescaped quotes, and the bits inside strings (from each opening
+		// quote up to its closing quote)
+		uint64_t quote = m.quote & ~find_escaped(m.backslash, prev_escaped);
+		uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+		prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+		uint64_t bits = (m.op & ~in_string) | quote;
+		while (bits) {
+			*out++ = (uint32_t)(base + __builtin_ctzll(bits));
+			bits &= bits - 1;
+		}
+	}
+
+	size_t n = out - index.data();
+	for (size_t i = 0; i < STRUCTURAL_PADDING; i++) {
+		*out++ = (uint32_t)length;
+	}
+	return n;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "json_paths.hpp"
+#include "json_string.hpp"
+
+// Number of entries after the end of a structural index pointing at the
+// terminating null of the line (so the walker can look ahead without bounds
+// checks)
+static const size_t STRUCTURAL_PADDING = 8;
+
+/**
+ * Builds the structural index of a line (positions of its unescaped quotes
+ * and of the brackets, colons and commas outside strings), followed by
+ * STRUCTURAL_PADDING entries pointing at line[length].
+ */
+size_t index_structurals(const char* line, size_t length,
+						 std::vector<uint32_t>& index);
+
+/**
+ * Walks the structural index of a line (stage 2), passing the strings found
+ * at PATHS (an array of paths, see build_path_trie) to sink.field(field,
+ * string, length), after unescaping them in place.
+ * Only structurals are visited: values off the paths are skipped by bracket
+ * depth, and scalars are not looked at beyond checking they are there.
+ */
+template <const auto& PATHS, typename Sink> class StructuralWalker {
+  public:
+	StructuralWalker(char* line, const uint32_t* index, size_t n, Sink& sink)
+		: line(line), index(index), n(n), sink(sink) {}
+
+	/**
+	 * Walks the line.
+	 * @return whether the line is a single object with valid structure
+	 */
+	bool walk() {
+		return at(0) == '{' && walk_object(0, 0) == n;
+	}
+
+  private:
+	using Matcher = PathMatcher<PATHS>;
+	static constexpr const PathTrie& TRIE = Matcher::TRIE;
+	static constexpr size_t NONE = Matcher::NONE;
+	static constexpr size_t ERROR = (size_t)-1;
+
+	char* line;
+	const uint32_t* index;
+	size_t n;
+	Sink& sink;
+
+	/**
+	 * Character at structural i.
+	 */
+	inline char at(size_t i) const {
+		return line[index[i]];
+	}
+
+	/**
+	 * Walks the object starting at structural i, matching its keys against
+	 * the children of node.
+	 * @return structural after the object (ERROR if it is malformed)
+	 */
+	size_t walk_object(size_t node, size_t i) {
+		i++;
+		if (at(i) == '}') {
+			return i + 1;
+		}
+		while (true) {
+			if (at(i) != '"' || at(i + 1) != '"' || at(i + 2) != ':') {
+				return ERROR;
+			}
+			size_t child = Matcher::match(node, line + index[i] + 1,
+										  index[i + 1] - index[i] - 1);
+			i = walk_value(child, false, i + 3);
+			if (i == ERROR) {
+				return ERROR;
+			}
+			if (at(i) == '}') {
+				return i + 1;
+			}
+			if (at(i) != ',') {
+				return ERROR;
+			}
+			i++;
+		}
+	}
+
+	/**
+	 * Walks the elements of the array starting at structural i, which is
+	 * the value of node.
+	 * @return structural after the array (ERROR if it is malformed)
+	 */
+	size_t walk_array(size_t node, size_t i) {
+		i++;
+		if (at(i) == ']') {
+			return i + 1;
+		}
+		while (true) {
+			i = walk_value(node, true, i);
+			if (i == ERROR) {
+				return ERROR;
+			}
+			if (at(i) == ']') {
+				return i + 1;
+			}
+			if (at(i) != ',') {
+				return ERROR;
+			}
+			i++;
+		}
+	}
+
+	/**
+	 * Walks the value starting at structural i (or the scalar ending there).
+	 * @param node node matched by the key of the value (NONE if none), or
+	 * of the array it is an element of
+	 * @param element whether the value is an element of node's array
+	 * @return structural after the value (ERROR if it is malformed)
+	 */
+	size_t walk_value(size_t node, bool element, size_t i) {
+		switch (at(i)) {
+		case '{':
+			if (node != NONE && (element || !TRIE.nodes[node].array)) {
+				return walk_object(node, i);
+			}
+			return skip(i);
+		case '[':
+			if (node != NONE && !element && TRIE.nodes[node].array) {
+				return walk_array(node, i);
+			}
+			return skip(i);
+		case '"':
+			if (at(i + 1) != '"') {
+				return ERROR;
+			}
+			if (node != NONE && TRIE.nodes[node].field >= 0 &&
+				element == TRIE.nodes[node].array) {
+				char* str = line + index[i] + 1;
+				size_t length =
+					unescape_json_string(str, index[i + 1] - index[i] - 1);
+				if (length == INVALID_JSON_STRING) {
+					return ERROR;
+				}
+				sink.field(TRIE.nodes[node].field, str, length);
+			}
+			return i + 2;
+		case ',':
+		case '}':
+		case ']':
+			return scalar(i);
+		default:
+			return ERROR;
+		}
+	}
+
+	/**
+	 * Skips the object or array starting at structural i (counting
+	 * brackets without branching on them).
+	 * @return structural after it (ERROR if the line ends first)
+	 */
+	size_t skip(size_t i) const {
+		long depth = 0;
+		do {
+			char c = at(i++);
+			depth += (c == '{') + (c == '[') - (c == '}') - (c == ']');
+		} while (depth > 0 && i < n);
+		return depth ? ERROR : i;
+	}
+
+	/**
+	 * Checks there is a scalar before structural i (after structural i - 1).
+	 * @return i (ERROR if there is only whitespace)
+	 */
+	size_t scalar(size_t i) const {
+		const char* p = line + index[i - 1] + 1;
+		while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+			p++;
+		}
+		return p == line + index[i] ? ERROR : i;
+	}
+};
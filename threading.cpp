@@ -6,6 +6,7 @@
 // https://stackoverflow.com/questions/823479
 
 #define OMPI_SKIP_MPICXX
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <mpi.h>
@@ -14,7 +15,16 @@
 #include <string.h>
 #include <unordered_map>
 #include <utility>
+#include "cache.hpp"
+#include "freq_table.hpp"
+#include "groups.hpp"
 #include "line.hpp"
+#include "options.hpp"
+#include "perf_counters.hpp"
+#include "progress.hpp"
+#include "recovery.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
 
 using std::ifstream;
 using std::pair;
@@ -22,43 +32,59 @@ using std::string;
 using std::unordered_map;
 
 // Prototypes
-void process_section_thread(
-	ifstream& is, long long start, long long end,
-	unordered_map<string, unsigned long>& lang_freq_map,
-	unordered_map<string, unsigned long>& hashtag_freq_map);
+unsigned long process_section_thread(
+	ifstream& is, long long start, long long end, FreqTable& lang_freq_map,
+	FreqTable& hashtag_freq_map, CacheWriter* cache, TweetCounts* counts);
 
 // Work size (maximum length of file processed by thread at one time)
 static const long long CHUNK_SIZE = 1000 * 1000 * 200;
 
+// Number of hashtags collected from tweets before they are counted together
+static const size_t HASHTAG_BATCH_SIZE = 256;
+
 /**
  * Further subdivides the section [start, end], assigns them to threads and
  * combines results.
  * @param filename path of twitter file
  * @param start start byte
  * @param end end byte
+ * @param cache rows of the cache, collected if not nullptr (--compile)
+ * @param counts other counts (see groups.hpp), counted if not nullptr
  */
 pair<unordered_map<string, unsigned long>,
 	 unordered_map<string, unsigned long>>
-process_section(const char* filename, long long start, long long end) {
+process_section(const char* filename, long long start, long long end,
+				CacheWriter* cache, TweetCounts* counts) {
 	// Final combined results for process
-	unordered_map<string, unsigned long> combined_lang_freq,
-		combined_hashtag_freq;
+	FreqTable combined_lang_freq, combined_hashtag_freq;
 
 	// Further subdivide into chunks of CHUNK_SIZE
 	// Note that CHUNK_SIZE cannot be less than length of shortest line
-	long long total = (end - start) + 1;
+	long long total = std::max(end - start + 1, 0LL);
 	long long n_chunks =
 		total / CHUNK_SIZE + (total % CHUNK_SIZE == 0 ? 0 : 1);
 
+	// With --recovery, chunks done by an earlier run of the job are skipped,
+	// and the counts of each chunk are handed to the saving thread as it is
+	// done (see recovery.cpp)
+	bool recovering = !options.recovery.empty();
+	if (recovering) {
+		recovery_start(filename, start, end, CHUNK_SIZE, n_chunks);
+	}
+
 #pragma omp parallel default(none)                                            \
 	shared(filename, n_chunks, start, end, combined_lang_freq,                \
-		   combined_hashtag_freq, std::cerr, ompi_mpi_comm_world)
+		   combined_hashtag_freq, cache, counts, recovering, std::cerr,       \
+		   ompi_mpi_comm_world)
 	{
-		// Init maps (for each thread)
-		unordered_map<string, unsigned long> lang_freq_map({}),
-			hashtag_freq_map({});
+		// Init tables (for each thread)
+		FreqTable lang_freq_map, hashtag_freq_map;
+		CacheWriter thread_cache;
+		TweetCounts thread_counts;
 		// Open file (for each thread)
 		ifstream is(filename, std::ifstream::in);
+		perf_open_thread();
+		progress_thread_start();
 
 		// File reading failure
 		if (is.fail() || !is.is_open()) {
@@ -80,60 +106,71 @@ process_section(const char* filename, long long start, long long end) {
 			if (inner_end > end) {
 				inner_end = end;
 			}
+			if (recovering && recovery_done(i)) {
+				progress_add(inner_end - inner_start + 1, 0);
+				continue;
+			}
 
 			// Pass work to thread
-			process_section_thread(is, inner_start, inner_end, lang_freq_map,
-								   hashtag_freq_map);
+			double chunk_start = trace_now();
+			unsigned long tweets =
+				process_section_thread(is, inner_start, inner_end,
+									   lang_freq_map, hashtag_freq_map,
+									   cache ? &thread_cache : nullptr,
+									   counts ? &thread_counts : nullptr);
+			trace_chunk(chunk_start, inner_end - inner_start + 1, tweets);
+			if (recovering) {
+				recovery_add(i, lang_freq_map, hashtag_freq_map);
+			}
 		}
 		is.close();
 
 		// Combine together thread by thread (i.e. not concurrently)
 #pragma omp critical
 		{
-			unordered_map<string, unsigned long>::iterator j;
-
-			// Hashtag
-			for (j = hashtag_freq_map.begin(); j != hashtag_freq_map.end();
-				 j++) {
-				if (combined_hashtag_freq.end() !=
-					combined_hashtag_freq.find(j->first)) {
-					combined_hashtag_freq[j->first] += j->second;
-				} else {
-					combined_hashtag_freq[j->first] = j->second;
-				}
+			stage_start();
+			combined_hashtag_freq.merge(hashtag_freq_map);
+			combined_lang_freq.merge(lang_freq_map);
+			if (cache) {
+				cache->merge(thread_cache);
 			}
-
-			// Lang
-			for (j = lang_freq_map.begin(); j != lang_freq_map.end(); j++) {
-				if (combined_lang_freq.end() !=
-					combined_lang_freq.find(j->first)) {
-					combined_lang_freq[j->first] += j->second;
-				} else {
-					combined_lang_freq[j->first] = j->second;
-				}
+			if (counts) {
+				counts->merge(thread_counts);
 			}
+			stage_lap(THREAD_MERGE);
 		}
+		timing_end_thread();
+		perf_close_thread();
+	}
+	if (recovering) {
+		recovery_finish(combined_lang_freq, combined_hashtag_freq);
 	}
 
 	return pair<unordered_map<string, unsigned long>,
-				unordered_map<string, unsigned long>>(combined_lang_freq,
-													  combined_hashtag_freq);
+				unordered_map<string, unsigned long>>(
+		combined_lang_freq.to_map(), combined_hashtag_freq.to_map());
 }
 
 /**
  * Within each thread, process the section [start, end] by reading line
  * by line and passing each line to the process_line function.
- * process_line then mutates the maps (passed by reference).
+ * process_line then counts the language and collects hashtags into a batch,
+ * which is counted every HASHTAG_BATCH_SIZE hashtags.
  * @param is input stream
- * @param lang_freq_map language frequency map
- * @param hashtag_freq_map hashtag frequency map
+ * @param lang_freq_map language frequency table
+ * @param hashtag_freq_map hashtag frequency table
+ * @param cache rows of the cache of the thread (nullptr for none)
+ * @param counts other counts of the thread (nullptr for none)
+ * @return number of lines processed
  */
-void process_section_thread(
-	std::ifstream& is, long long start, long long end,
-	unordered_map<string, unsigned long>& lang_freq_map,
-	unordered_map<string, unsigned long>& hashtag_freq_map) {
+unsigned long process_section_thread(
+	ifstream& is, long long start, long long end, FreqTable& lang_freq_map,
+	FreqTable& hashtag_freq_map, CacheWriter* cache, TweetCounts* counts) {
 	char c;
 	string line;
+	KeyBatch hashtag_batch;
+	Tweet tweet;
+	unsigned long n_lines = 0;
 
 #ifdef DEBUG
 	// Print start offset & end offset
@@ -145,54 +182,70 @@ void process_section_thread(
 	std::cerr << m.str();
 #endif
 
-	// Seek to start
-	is.seekg(start);
-
-	// Current position
-	long long current = start;
-
-	// Skip first 'line'
+	// Lines are processed by the section they start in, so skip to the first
+	// line that starts at or after start: the one after the first '\n' at or
+	// after start - 1 (a section that starts at 0 skips the first line,
+	// which is the header of the file and not a tweet)
+	stage_start();
+	long long current = start > 0 ? start - 1 : 0;
+	is.clear();
+	is.seekg(current);
 	while (is.good()) {
 		c = is.get();
-		if (c == '\r') {
-			c = is.get();
-			if (c == '\n') {
-				current += 2;
-				break;
-			}
-		}
 		current++;
+		if (c == '\n') {
+			break;
+		}
 	}
+	stage_lap(SPLIT);
 
 	while (is.good() && current <= end) {
 		// Read line
 		getline(is, line);
+		stage_lap(READ);
 
-		if (line.length() == 0 && current == end) {
-			// At a \n|{"id boundary, need to read/process next line
-			// since the thread for next chunk will skip the first line
-			continue;
-		}
+		// Increment current by line_length and 1 for '\n'
 		size_t line_length = line.length();
+		current += line_length + 1;
 
 		// When applicable, remove 2 characters to trim to valid json
 		// Assumption made that each line ends with r',?\r$'
-		if (line[line.length() - 1] == '\r') {
+		if (!line.empty() && line.back() == '\r') {
 			line.pop_back();
 		}
 		// First branch should be taken 99.9% of the time
 		// Only exception should be last 2 lines
-		if (line[line.length() - 1] == ',') {
+		if (!line.empty() && line.back() == ',') {
 			line.pop_back();
 		} else if (line.length() <= 2) {
-			// The very last line
-			break;
+			// The very last line (or a blank one)
+			continue;
 		}
 
 		// Process the line
-		process_line(line, lang_freq_map, hashtag_freq_map);
-
-		// Increment current by line_length and 1 for '\n'
-		current += line_length + 1;
+		stage_lap(SPLIT);
+		size_t first_hashtag = hashtag_batch.size();
+		bool valid = process_line(line, tweet, lang_freq_map, hashtag_batch);
+		n_lines++;
+		if (cache && valid) {
+			cache->add_row(tweet.lang, hashtag_batch, first_hashtag);
+		}
+		if (counts && valid) {
+			counts->add(tweet, hashtag_batch, first_hashtag);
+			stage_lap(COUNT);
+		}
+		if (hashtag_batch.size() >= HASHTAG_BATCH_SIZE) {
+			hashtag_freq_map.increment_batch(hashtag_batch);
+			hashtag_batch.clear();
+			stage_lap(COUNT);
+			perf_lap(COUNT);
+		}
+		progress_add(line_length + 1, 1);
 	}
+
+	// Count what is left in the batch
+	hashtag_freq_map.increment_batch(hashtag_batch);
+	stage_lap(COUNT);
+	perf_lap(COUNT);
+	return n_lines;
 }
@@ -1,5 +1,7 @@
 #include <unordered_map>
 #include <utility>
+#include "cache.hpp"
+#include "groups.hpp"
 
 /*
  * Further subdivides the section [start, end], assigns them to threads and
@@ -7,4 +9,5 @@
  */
 std::pair<std::unordered_map<std::string, unsigned long>,
 		  std::unordered_map<std::string, unsigned long>>
-process_section(const char* filename, long long start, long long end);
+process_section(const char* filename, long long start, long long end,
+				CacheWriter* cache, TweetCounts* counts);
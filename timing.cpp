@@ -0,0 +1,226 @@
+// Per stage timing of threads and processes
+// Each thread times its stages as laps of a thread local clock (time stamp
+// counter reads, a few nanoseconds each); at the end rank 0 gathers the times
+// of every thread and process and prints min/median/max per stage
+
+#define OMPI_SKIP_MPICXX
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "timing.hpp"
+
+using std::string;
+using std::vector;
+
+thread_local StageClock stage_clock = {};
+
+// Names of the stages timed per thread
+static const char* const THREAD_STAGE_NAMES[N_THREAD_STAGES] = {
+	"read", "split", "parse", "extract", "count", "thread merge"};
+
+/**
+ * Time spent in a stage by one thread (or process).
+ */
+struct StageSample {
+	int rank;
+	int thread;
+	double seconds;
+};
+
+// Function prototypes
+static void print_timing(const vector<string>& names,
+						 const vector<vector<StageSample>>& stages,
+						 int n_threads, int size);
+static void write_timing_json(const vector<string>& names,
+							  const vector<vector<StageSample>>& stages);
+
+// Start of calibration of ticks against the steady clock
+static uint64_t start_ticks;
+static std::chrono::steady_clock::time_point start_time;
+
+// Stage times of the threads of this process that have finished
+static vector<StageClock> thread_clocks;
+
+/**
+ * Starts calibrating ticks against the steady clock (the calibration covers
+ * the whole run, so it is accurate enough).
+ */
+void timing_init() {
+	start_ticks = timing_ticks();
+	start_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * Keeps the stage times of the calling thread for the report, and resets
+ * them (so that the calling thread can time per process stages after).
+ */
+void timing_end_thread() {
+	if (!options.timing) {
+		return;
+	}
+#pragma omp critical(timing)
+	thread_clocks.push_back(stage_clock);
+	stage_clock = StageClock{};
+}
+
+/**
+ * Gathers the stage times of all threads (and the combine_maps levels of all
+ * processes) to rank 0, which prints min/median/max per stage, and writes
+ * every time to options.timing_json if it is set.
+ * @param rank rank of the running process
+ * @param size number of processes
+ */
+void report_timing(int rank, int size) {
+	if (!options.timing) {
+		return;
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start_time;
+	double seconds_per_tick =
+		elapsed.count() / (double)(timing_ticks() - start_ticks);
+
+	// Times of this process: per thread stages of each thread, then the
+	// levels of combine_maps
+	vector<double> times;
+	for (const StageClock& clock : thread_clocks) {
+		for (int s = 0; s < N_THREAD_STAGES; s++) {
+			times.push_back(clock.ticks[s] * seconds_per_tick);
+		}
+	}
+	for (int l = 0; l < MAX_COMBINE_LEVELS; l++) {
+		times.push_back(stage_clock.ticks[COMBINE + l] * seconds_per_tick);
+	}
+
+	// Gather to rank 0
+	int count = (int)times.size();
+	vector<int> counts(size), displacements(size);
+	MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0,
+			   MPI_COMM_WORLD);
+	vector<double> all;
+	if (rank == 0) {
+		int total = 0;
+		for (int r = 0; r < size; r++) {
+			displacements[r] = total;
+			total += counts[r];
+		}
+		all.resize(total);
+	}
+	MPI_Gatherv(times.data(), count, MPI_DOUBLE, all.data(), counts.data(),
+				displacements.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	if (rank != 0) {
+		return;
+	}
+
+	// Levels of combine_maps used
+	int levels = 0;
+	for (int s = 1; s < size && levels < MAX_COMBINE_LEVELS; s <<= 1) {
+		levels++;
+	}
+
+	// Samples of each stage
+	vector<string> names(THREAD_STAGE_NAMES,
+						 THREAD_STAGE_NAMES + N_THREAD_STAGES);
+	for (int l = 0; l < levels; l++) {
+		names.push_back("combine level " + std::to_string(l));
+	}
+	vector<vector<StageSample>> stages(names.size());
+	int n_threads = 0;
+	for (int r = 0; r < size; r++) {
+		const double* t = all.data() + displacements[r];
+		int threads = (counts[r] - MAX_COMBINE_LEVELS) / N_THREAD_STAGES;
+		for (int i = 0; i < threads; i++) {
+			for (int s = 0; s < N_THREAD_STAGES; s++) {
+				stages[s].push_back(
+					StageSample{r, i, t[i * N_THREAD_STAGES + s]});
+			}
+		}
+		for (int l = 0; l < levels; l++) {
+			stages[N_THREAD_STAGES + l].push_back(
+				StageSample{r, -1, t[threads * N_THREAD_STAGES + l]});
+		}
+		n_threads += threads;
+	}
+
+	print_timing(names, stages, n_threads, size);
+	if (!options.timing_json.empty()) {
+		write_timing_json(names, stages);
+	}
+}
+
+/**
+ * Min, median and max of the times of a stage.
+ */
+static void summarise(const vector<StageSample>& samples, double& min,
+					  double& median, double& max) {
+	vector<double> seconds;
+	for (const StageSample& sample : samples) {
+		seconds.push_back(sample.seconds);
+	}
+	std::sort(seconds.begin(), seconds.end());
+	size_t n = seconds.size();
+	min = n ? seconds[0] : 0;
+	max = n ? seconds[n - 1] : 0;
+	median = n ? (seconds[(n - 1) / 2] + seconds[n / 2]) / 2 : 0;
+}
+
+/**
+ * Prints min/median/max per stage.
+ * @param names stage names
+ * @param stages samples of each stage
+ * @param n_threads number of threads (over all processes)
+ * @param size number of processes
+ */
+static void print_timing(const vector<string>& names,
+						 const vector<vector<StageSample>>& stages,
+						 int n_threads, int size) {
+	std::stringstream m;
+	m << std::endl
+	  << "[*] Stage timing (seconds, min / median / max over " << n_threads
+	  << " threads or " << size << " processes)" << std::endl;
+	for (size_t s = 0; s < stages.size(); s++) {
+		double min, median, max;
+		summarise(stages[s], min, median, max);
+		m << "\t" << names[s] << ": " << min << " / " << median << " / "
+		  << max << std::endl;
+	}
+	std::cout << m.str();
+}
+
+/**
+ * Writes every time, and min/median/max per stage, as JSON, e.g.:
+ * {"stages":[{"name":"read","min":0.1,"median":0.2,"max":0.3,
+ * "samples":[{"rank":0,"thread":0,"seconds":0.2}, ...]}, ...]}
+ * (the thread of per process stages is -1).
+ * @param names stage names
+ * @param stages samples of each stage
+ */
+static void write_timing_json(const vector<string>& names,
+							  const vector<vector<StageSample>>& stages) {
+	std::ofstream os(options.timing_json);
+	if (os.fail()) {
+		std::cerr << "Cannot write timing file " << options.timing_json
+				  << std::endl;
+		return;
+	}
+	os << "{\"stages\":[";
+	for (size_t s = 0; s < stages.size(); s++) {
+		double min, median, max;
+		summarise(stages[s], min, median, max);
+		os << (s ? "," : "") << "\n{\"name\":\"" << names[s]
+		   << "\",\"min\":" << min << ",\"median\":" << median
+		   << ",\"max\":" << max << ",\"samples\":[";
+		for (size_t i = 0; i < stages[s].size(); i++) {
+			const StageSample& sample = stages[s][i];
+			os << (i ? "," : "") << "{\"rank\":" << sample.rank
+			   << ",\"thread\":" << sample.thread
+			   << ",\"seconds\":" << sample.seconds << "}";
+		}
+		os << "]}";
+	}
+	os << "\n]}" << std::endl;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include "options.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Maximum number of levels of combine_maps that are timed
+static const int MAX_COMBINE_LEVELS = 16;
+
+/**
+ * Stages of the work that are timed. The stages up to N_THREAD_STAGES are
+ * timed per thread, the levels of combine_maps per process.
+ */
+enum Stage {
+	READ,         // reading lines from the file (including waiting for it)
+	SPLIT,        // trimming lines and finding chunk boundaries
+	PARSE,        // extracting the fields of tweets
+	EXTRACT,      // finding and lowercasing hashtags
+	COUNT,        // counting languages and hashtags
+	THREAD_MERGE, // merging the tables of threads in process_section
+	N_THREAD_STAGES,
+	COMBINE = N_THREAD_STAGES, // first level of combine_maps
+	N_STAGES = COMBINE + MAX_COMBINE_LEVELS
+};
+
+/**
+ * Current time in ticks (of the time stamp counter where there is one).
+ */
+inline uint64_t timing_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+#endif
+}
+
+/**
+ * Ticks spent in each stage by a thread. Stages are timed as laps: each lap
+ * ends the stage that started at the end of the previous one.
+ */
+struct StageClock {
+	uint64_t ticks[N_STAGES];
+	uint64_t last;
+
+	inline void start() {
+		last = timing_ticks();
+	}
+
+	inline void lap(int stage) {
+		uint64_t now = timing_ticks();
+		ticks[stage] += now - last;
+		last = now;
+	}
+};
+
+extern thread_local StageClock stage_clock;
+
+/**
+ * Starts timing (of the thread) from now, when timing is enabled.
+ */
+inline void stage_start() {
+	if (options.timing) {
+		stage_clock.start();
+	}
+}
+
+/**
+ * Adds the time since the last lap (or start) to a stage, when timing is
+ * enabled.
+ */
+inline void stage_lap(int stage) {
+	if (options.timing) {
+		stage_clock.lap(stage);
+	}
+}
+
+/**
+ * Starts calibrating ticks against the steady clock.
+ */
+void timing_init();
+
+/**
+ * Keeps the stage times of the calling thread for the report, and resets
+ * them.
+ */
+void timing_end_thread();
+
+/**
+ * Gathers the stage times of all threads and processes to rank 0, which
+ * prints them.
+ */
+void report_timing(int rank, int size);
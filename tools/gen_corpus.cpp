@@ -0,0 +1,835 @@
+// Generates a synthetic tweet corpus in the layout of a CouchDB dump (a
+// header line, one {"id":..,"doc":{..}} row per line ending in ",\r\n", and
+// a footer), for benchmarking without the real data
+// Rows are generated in blocks of BLOCK_ROWS, each from a random number
+// generator seeded with the seed and the number of the block, so the output
+// only depends on the options (not on the number of threads)
+// Usage: gen_corpus [--name=value ...] output.json (see print_usage)
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::string;
+using std::vector;
+
+// Rows per block (the unit of work of a thread, and of random seeding)
+static const size_t BLOCK_ROWS = 4096;
+
+// Longest tweet text, in code points
+static const unsigned MAX_TEXT_LENGTH = 280;
+
+// First tweet id, and first created_at (2020-03-01 00:00:00 UTC)
+static const uint64_t FIRST_TWEET_ID = 1234000000000000000ULL;
+static const time_t FIRST_TIME = 1583020800;
+
+/**
+ * Options of the corpus.
+ */
+struct CorpusOptions {
+	uint64_t size = 100ULL << 20; // approximate size in bytes
+	uint64_t tweets = 0;          // number of tweets (overrides size)
+	uint64_t seed = 1;
+	vector<pair<string, double>> langs = {
+		{"en", 45}, {"und", 10}, {"es", 6}, {"pt", 5}, {"ja", 5}, {"in", 4},
+		{"th", 3},  {"fr", 3},   {"ar", 3}, {"tl", 3}, {"ko", 2}, {"de", 2},
+		{"it", 2},  {"ru", 2},   {"tr", 2}, {"hi", 1}, {"zh", 1}, {"nl", 1}};
+	uint64_t hashtags = 100000;      // distinct hashtags
+	double zipf = 1.0;               // exponent of hashtag (and word) ranks
+	double hashtags_per_tweet = 0.6; // mean
+	uint64_t vocabulary = 20000;     // distinct words of texts
+	double words_per_tweet = 14;     // mean
+	double unicode = 0.1;  // share of words and hashtags that are not ASCII
+	double escapes = 0.05; // share of texts with escapes (\n, \", …)
+	double retweets = 0.2; // share of retweets
+	uint64_t users = 100000;
+	unsigned days = 30; // days spanned by created_at
+};
+
+/**
+ * Random number generator (splitmix64: fast, and good enough for data).
+ */
+struct Random {
+	uint64_t state;
+
+	inline uint64_t next() {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	// Uniform in [0, 1)
+	inline double uniform() {
+		return (double)(next() >> 11) * 0x1.0p-53;
+	}
+
+	// Uniform in [0, n)
+	inline uint64_t below(uint64_t n) {
+		return next() % n;
+	}
+
+	inline bool chance(double p) {
+		return uniform() < p;
+	}
+
+	// Geometric (number of failures before a success) with the given mean
+	inline unsigned geometric(double mean) {
+		if (mean <= 0) {
+			return 0;
+		}
+		return (unsigned)(std::log(1 - uniform()) /
+						  std::log(mean / (1 + mean)));
+	}
+};
+
+/**
+ * Zipfian distribution of ranks in [0, n).
+ */
+class Zipf {
+	vector<double> cdf;
+
+  public:
+	Zipf(uint64_t n, double s) : cdf(n) {
+		double sum = 0;
+		for (uint64_t i = 0; i < n; i++) {
+			sum += 1 / std::pow((double)(i + 1), s);
+			cdf[i] = sum;
+		}
+	}
+
+	uint64_t operator()(Random& random) const {
+		double u = random.uniform() * cdf.back();
+		return std::min(
+			(uint64_t)(std::upper_bound(cdf.begin(), cdf.end(), u) -
+					   cdf.begin()),
+			(uint64_t)cdf.size() - 1);
+	}
+};
+
+// Alphabets of names: each letter is a (UTF-8) syllable or character, and
+// each is as long as the others (in code points)
+static const size_t ALPHABET_SIZE = 20;
+static const char* const ALPHABETS[][ALPHABET_SIZE] = {
+	// ASCII
+	{"ka", "ki", "ko", "ma", "mi", "mo", "na", "ni", "no", "ra", "ri", "ro",
+	 "sa", "si", "so", "ta", "ti", "to", "ba", "de"},
+	// Latin with accents
+	{"cà", "fé", "lü", "ño", "çi", "ré", "mà", "tö", "bè", "gô", "hé", "jï",
+	 "kë", "lù", "mé", "nâ", "pî", "qü", "sé", "tó"},
+	// Cyrillic
+	{"а", "б", "в", "г", "д", "е", "ж", "з", "и", "к", "л", "м", "н", "о",
+	 "п", "р", "с", "т", "у", "ф"},
+	// Greek
+	{"α", "β", "γ", "δ", "ε", "ζ", "η", "θ", "ι", "κ", "λ", "μ", "ν", "ξ",
+	 "ο", "π", "ρ", "σ", "τ", "υ"},
+	// Thai
+	{"ก", "ข", "ค", "ง", "จ", "ฉ", "ช", "ซ", "ญ", "ด", "ต", "ถ", "ท", "น",
+	 "บ", "ป", "ผ", "พ", "ฟ", "ม"},
+	// Hiragana
+	{"あ", "い", "う", "え", "お", "か", "き", "く", "け", "こ", "さ", "し",
+	 "す", "せ", "そ", "た", "ち", "つ", "て", "と"},
+	// Arabic
+	{"ا", "ب", "ت", "ث", "ج", "ح", "خ", "د", "ذ", "ر", "ز", "س", "ش", "ص",
+	 "ض", "ط", "ظ", "ع", "غ", "ف"}};
+static const size_t N_ALPHABETS = sizeof(ALPHABETS) / sizeof(ALPHABETS[0]);
+// Code points per letter of each alphabet
+static const unsigned LETTER_LENGTHS[N_ALPHABETS] = {2, 2, 1, 1, 1, 1, 1};
+
+// Salts of the kinds of names (so that a hashtag and a word of the same rank
+// differ)
+enum NameKind { HASHTAG_NAME, WORD_NAME, USER_NAME, DOMAIN_NAME };
+
+// Top level domains of URLs
+static const char* const TLDS[] = {".com", ".org", ".net", ".com.au",
+								   ".co.uk"};
+
+/**
+ * A hashtag, mention or URL of a text.
+ */
+struct Entity {
+	uint64_t rank;  // rank of the hashtag, user or domain
+	bool capital;   // whether a hashtag starts with a capital letter
+	unsigned start; // position in the text (in code points)
+	unsigned end;
+};
+
+/**
+ * Text of a tweet (JSON escaped), and its entities.
+ */
+struct Status {
+	string text;
+	unsigned length = 0; // in code points
+	vector<Entity> hashtags, mentions, urls;
+
+	void clear() {
+		text.clear();
+		length = 0;
+		hashtags.clear();
+		mentions.clear();
+		urls.clear();
+	}
+};
+
+/**
+ * Generates the rows of a corpus.
+ */
+class Generator {
+	const CorpusOptions& options;
+	uint64_t n_tweets;
+	Zipf hashtag_ranks, word_ranks, user_ranks, domain_ranks;
+	vector<double> lang_weights; // cumulative
+	Random random;
+	Status status, retweeted;
+
+  public:
+	Generator(const CorpusOptions& options, uint64_t n_tweets);
+	void block(uint64_t b, string& out);
+
+  private:
+	void row(uint64_t i, string& out);
+	void text(Status& s, unsigned max_length);
+	void tweet(string& out, const Status& s, uint64_t id, time_t time,
+			   uint64_t user);
+	void entities(string& out, const Status& s);
+	const string& lang();
+	void add_name(string& out, uint64_t rank, NameKind kind, bool capital,
+				  unsigned& length) const;
+	void add_word(Status& s);
+	void add_hashtag(Status& s);
+	void add_mention(Status& s, uint64_t user);
+	void add_url(Status& s);
+	void add_user(string& out, uint64_t user) const;
+};
+
+// Function prototypes
+static void print_usage(const char* program);
+static void set_option(CorpusOptions& options, const string& name,
+					   const string& value);
+static void append_link(string& out, const Entity& e);
+static void append_number(string& out, uint64_t n);
+static uint64_t mix(uint64_t a, uint64_t b);
+
+int main(int argc, char** argv) {
+	CorpusOptions options;
+	const char* output = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2) != 0) {
+			if (output) {
+				print_usage(argv[0]);
+			}
+			output = argv[i];
+			continue;
+		}
+		string option = argv[i] + 2;
+		size_t eq = option.find('=');
+		if (eq == string::npos) {
+			print_usage(argv[0]);
+		}
+		set_option(options, option.substr(0, eq), option.substr(eq + 1));
+	}
+	if (!output) {
+		print_usage(argv[0]);
+	}
+
+	// Number of tweets: given, or estimated from the size of a sample block
+	uint64_t n_tweets = options.tweets;
+	if (!n_tweets) {
+		string sample;
+		Generator(options, BLOCK_ROWS + 1).block(0, sample);
+		n_tweets = std::max<uint64_t>(1, options.size * BLOCK_ROWS /
+											 sample.length());
+	}
+
+	FILE* os = fopen(output, "wb");
+	if (!os) {
+		std::cerr << "Cannot write " << output << ": " << strerror(errno)
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	string header = "{\"total_rows\":" + std::to_string(n_tweets) +
+					",\"offset\":0,\"rows\":[\r\n";
+	fwrite(header.data(), 1, header.length(), os);
+
+	uint64_t n_blocks = (n_tweets + BLOCK_ROWS - 1) / BLOCK_ROWS;
+#pragma omp parallel
+	{
+		Generator generator(options, n_tweets);
+		string out;
+#pragma omp for ordered schedule(dynamic)
+		for (uint64_t b = 0; b < n_blocks; b++) {
+			out.clear();
+			generator.block(b, out);
+#pragma omp ordered
+			fwrite(out.data(), 1, out.length(), os);
+		}
+	}
+
+	fputs("]}\r\n", os);
+	if (fclose(os) != 0) {
+		std::cerr << "Cannot write " << output << ": " << strerror(errno)
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+/**
+ * Prints the usage and exits.
+ * @param program name of the program
+ */
+static void print_usage(const char* program) {
+	std::cerr
+		<< "usage: " << program << " [options] output.json\n"
+		<< "\t--size=n          approximate size, in bytes (or with K, M or "
+		   "G; default 100M)\n"
+		<< "\t--tweets=n        number of tweets (instead of a size)\n"
+		<< "\t--seed=n          seed (the same options give the same "
+		   "output; default 1)\n"
+		<< "\t--langs=l:w,...   languages and their weights (default "
+		   "en:45,und:10,es:6,...)\n"
+		<< "\t--hashtags=n      distinct hashtags (default 100000)\n"
+		<< "\t--zipf=s          exponent of the Zipfian distribution of "
+		   "hashtags and words (default 1)\n"
+		<< "\t--hashtags-per-tweet=x  mean (default 0.6)\n"
+		<< "\t--vocabulary=n    distinct words (default 20000)\n"
+		<< "\t--words-per-tweet=x     mean (default 14, texts are cut at 280 "
+		   "characters)\n"
+		<< "\t--unicode=p       share of words and hashtags that are not "
+		   "ASCII (default 0.1)\n"
+		<< "\t--escapes=p       share of texts with escapes (default 0.05)\n"
+		<< "\t--retweets=p      share of retweets (default 0.2)\n"
+		<< "\t--users=n         distinct users (default 100000)\n"
+		<< "\t--days=n          days spanned by the tweets (default 30)"
+		<< std::endl;
+	std::exit(EXIT_FAILURE);
+}
+
+/**
+ * Reads a number, exiting if it is not one.
+ * @param name option name, e.g.: "seed"
+ * @param value option value, e.g.: "42" (or "10G" if suffixed)
+ * @param suffixed whether K, M or G (powers of 1024) may follow
+ * @return value
+ */
+static uint64_t parse_count(const string& name, const string& value,
+							bool suffixed = false) {
+	char* end;
+	uint64_t n = strtoull(value.c_str(), &end, 10);
+	if (suffixed && *end) {
+		const char* suffixes = "KMG";
+		const char* suffix = strchr(suffixes, *end);
+		if (suffix && end[1] == '\0') {
+			n <<= 10 * (suffix - suffixes + 1);
+			end++;
+		}
+	}
+	if (value.empty() || *end != '\0') {
+		std::cerr << "Invalid value for --" << name << ": " << value
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return n;
+}
+
+/**
+ * Reads a non negative number (or a share, at most 1), exiting if it is not
+ * one.
+ * @param name option name, e.g.: "unicode"
+ * @param value option value, e.g.: "0.1"
+ * @param share whether the value is a share
+ * @return value
+ */
+static double parse_real(const string& name, const string& value,
+						 bool share = false) {
+	char* end;
+	double x = strtod(value.c_str(), &end);
+	if (value.empty() || *end != '\0' || !(x >= 0) || (share && x > 1)) {
+		std::cerr << "Invalid value for --" << name << ": " << value
+				  << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	return x;
+}
+
+/**
+ * Sets an option, exiting on an unknown option or value.
+ * @param options options of the corpus
+ * @param name option name, e.g.: "langs"
+ * @param value option value, e.g.: "en:3,ja:1"
+ */
+static void set_option(CorpusOptions& options, const string& name,
+					   const string& value) {
+	if (name == "size") {
+		options.size = parse_count(name, value, true);
+	} else if (name == "tweets") {
+		options.tweets = parse_count(name, value);
+	} else if (name == "seed") {
+		options.seed = parse_count(name, value);
+	} else if (name == "langs") {
+		options.langs.clear();
+		size_t start = 0;
+		while (start < value.length()) {
+			size_t end = value.find(',', start);
+			if (end == string::npos) {
+				end = value.length();
+			}
+			string lang = value.substr(start, end - start);
+			size_t colon = lang.find(':');
+			double weight = 1;
+			if (colon != string::npos) {
+				weight = parse_real(name, lang.substr(colon + 1));
+				lang.resize(colon);
+			}
+			options.langs.emplace_back(lang, weight);
+			start = end + 1;
+		}
+		if (options.langs.empty()) {
+			std::cerr << "No languages given" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+	} else if (name == "hashtags") {
+		options.hashtags = std::max<uint64_t>(1, parse_count(name, value));
+	} else if (name == "zipf") {
+		options.zipf = parse_real(name, value);
+	} else if (name == "hashtags-per-tweet") {
+		options.hashtags_per_tweet = parse_real(name, value);
+	} else if (name == "vocabulary") {
+		options.vocabulary = std::max<uint64_t>(1, parse_count(name, value));
+	} else if (name == "words-per-tweet") {
+		options.words_per_tweet = parse_real(name, value);
+	} else if (name == "unicode") {
+		options.unicode = parse_real(name, value, true);
+	} else if (name == "escapes") {
+		options.escapes = parse_real(name, value, true);
+	} else if (name == "retweets") {
+		options.retweets = parse_real(name, value, true);
+	} else if (name == "users") {
+		options.users = std::max<uint64_t>(1, parse_count(name, value));
+	} else if (name == "days") {
+		options.days = (unsigned)parse_count(name, value);
+	} else {
+		std::cerr << "Unknown option: --" << name << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+Generator::Generator(const CorpusOptions& options, uint64_t n_tweets)
+	: options(options), n_tweets(n_tweets),
+	  hashtag_ranks(options.hashtags, options.zipf),
+	  word_ranks(options.vocabulary, options.zipf),
+	  user_ranks(options.users, 1.0), domain_ranks(1000, 1.0), random{0} {
+	double sum = 0;
+	for (const auto& lang : options.langs) {
+		sum += lang.second;
+		lang_weights.push_back(sum);
+	}
+}
+
+/**
+ * Appends the rows of a block.
+ * @param b number of the block
+ * @param out output
+ */
+void Generator::block(uint64_t b, string& out) {
+	random.state = mix(options.seed, b);
+	uint64_t end = std::min(n_tweets, (b + 1) * BLOCK_ROWS);
+	for (uint64_t i = b * BLOCK_ROWS; i < end; i++) {
+		row(i, out);
+		out += i + 1 < n_tweets ? ",\r\n" : "\r\n";
+	}
+}
+
+/**
+ * Appends a row (without the separator), e.g.:
+ * {"id":"..","key":"..","value":{"rev":".."},"doc":{"_id":"..",..tweet..}}
+ * @param i number of the row
+ * @param out output
+ */
+void Generator::row(uint64_t i, string& out) {
+	uint64_t id = FIRST_TWEET_ID + i * 64 + random.below(64);
+	time_t time = FIRST_TIME +
+				  (time_t)((double)i / n_tweets * options.days * 86400) +
+				  (time_t)random.below(60);
+	uint64_t user = user_ranks(random);
+	const string& tweet_lang = lang();
+
+	out += "{\"id\":\"";
+	append_number(out, id);
+	out += "\",\"key\":\"";
+	append_number(out, id);
+	out += "\",\"value\":{\"rev\":\"1-";
+	char rev[17];
+	snprintf(rev, sizeof(rev), "%016llx", (unsigned long long)random.next());
+	out += rev;
+	out += "\"},\"doc\":{\"_id\":\"";
+	append_number(out, id);
+	out += "\",\"_rev\":\"1-";
+	out += rev;
+	out += "\",";
+
+	if (random.chance(options.retweets)) {
+		// The text of a retweet is "RT @user: " and the retweeted text, with
+		// the same hashtags
+		uint64_t original_user = user_ranks(random);
+		retweeted.clear();
+		text(retweeted, MAX_TEXT_LENGTH);
+		status.clear();
+		status.text = "RT ";
+		status.length = 3;
+		add_mention(status, original_user);
+		status.text += ": ";
+		status.length += 2;
+		for (Entity hashtag : retweeted.hashtags) {
+			hashtag.start += status.length;
+			hashtag.end += status.length;
+			status.hashtags.push_back(hashtag);
+		}
+		status.text += retweeted.text;
+		status.length += retweeted.length;
+
+		tweet(out, status, id, time, user);
+		out += ",\"retweeted_status\":{";
+		tweet(out, retweeted, id - 64 * (1 + random.below(1000000)),
+			  time - (time_t)random.below(3 * 86400), original_user);
+		out += ",\"lang\":\"";
+		out += tweet_lang;
+		out += "\"}";
+	} else {
+		status.clear();
+		text(status, MAX_TEXT_LENGTH);
+		tweet(out, status, id, time, user);
+	}
+	out += ",\"is_quote_status\":false,\"retweet_count\":";
+	append_number(out, random.geometric(2));
+	out += ",\"favorite_count\":";
+	append_number(out, random.geometric(4));
+	out += ",\"favorited\":false,\"retweeted\":false,\"lang\":\"";
+	out += tweet_lang;
+	out += "\",\"metadata\":{\"iso_language_code\":\"";
+	out += tweet_lang;
+	out += "\",\"result_type\":\"recent\"}}}";
+}
+
+/**
+ * Generates a text: an optional mention, words with hashtags among them, and
+ * an optional URL.
+ * @param s status (empty)
+ * @param max_length longest text, in code points
+ */
+void Generator::text(Status& s, unsigned max_length) {
+	if (random.chance(0.2)) {
+		add_mention(s, user_ranks(random));
+		s.text += ' ';
+		s.length++;
+	}
+	unsigned n_words = 1 + random.geometric(options.words_per_tweet - 1);
+	unsigned n_hashtags = random.geometric(options.hashtags_per_tweet);
+	bool escapes = random.chance(options.escapes);
+	bool url = random.chance(0.25);
+	// Room left for a URL (23 code points, as t.co links are)
+	unsigned room = max_length - (url ? 24 : 0);
+
+	for (unsigned w = 0; w < n_words + n_hashtags; w++) {
+		size_t before = s.text.length();
+		unsigned length = s.length;
+		if (w) {
+			if (escapes && random.chance(0.1)) {
+				s.text += "\\n";
+			} else {
+				s.text += ' ';
+			}
+			s.length++;
+		}
+		// Hashtags are spread among the words (more at the end)
+		bool hashtag =
+			n_hashtags && random.below(n_words + n_hashtags - w) < n_hashtags;
+		if (hashtag) {
+			add_hashtag(s);
+			n_hashtags--;
+		} else if (escapes && random.chance(0.1)) {
+			s.text += "\\\"";
+			add_word(s);
+			s.text += "\\\"";
+			s.length += 2;
+		} else {
+			add_word(s);
+		}
+		if (s.length > room) {
+			s.text.resize(before);
+			s.length = length;
+			if (hashtag) {
+				s.hashtags.pop_back();
+			}
+			break;
+		}
+	}
+	if (escapes && s.length < room) {
+		s.text += "\\u2026";
+		s.length++;
+	}
+	if (url) {
+		s.text += ' ';
+		s.length++;
+		add_url(s);
+	}
+}
+
+/**
+ * Appends the fields of a tweet (without braces), from created_at to place.
+ * @param out output
+ * @param s text and entities
+ * @param id tweet id
+ * @param time time the tweet was created
+ * @param user rank of the user
+ */
+void Generator::tweet(string& out, const Status& s, uint64_t id, time_t time,
+					  uint64_t user) {
+	char created_at[64];
+	struct tm tm;
+	gmtime_r(&time, &tm);
+	strftime(created_at, sizeof(created_at), "%a %b %d %H:%M:%S +0000 %Y",
+			 &tm);
+	out += "\"created_at\":\"";
+	out += created_at;
+	out += "\",\"id\":";
+	append_number(out, id);
+	out += ",\"id_str\":\"";
+	append_number(out, id);
+	out += "\",\"text\":\"";
+	out += s.text;
+	out += "\",\"truncated\":false,\"entities\":{";
+	entities(out, s);
+	out += "},\"source\":\"<a href=\\\"https://mobile.twitter.com\\\" "
+		   "rel=\\\"nofollow\\\">Twitter Web App</a>\",\"user\":{";
+	add_user(out, user);
+	out += "},\"geo\":null,\"coordinates\":null,\"place\":null";
+}
+
+/**
+ * Appends the entities of a text (without braces).
+ * @param out output
+ * @param s text and entities
+ */
+void Generator::entities(string& out, const Status& s) {
+	unsigned length;
+	out += "\"hashtags\":[";
+	for (size_t i = 0; i < s.hashtags.size(); i++) {
+		const Entity& e = s.hashtags[i];
+		out += i ? ",{\"text\":\"" : "{\"text\":\"";
+		add_name(out, e.rank, HASHTAG_NAME, e.capital, length);
+		out += "\",\"indices\":[";
+		append_number(out, e.start);
+		out += ',';
+		append_number(out, e.end);
+		out += "]}";
+	}
+	out += "],\"symbols\":[],\"user_mentions\":[";
+	for (size_t i = 0; i < s.mentions.size(); i++) {
+		const Entity& e = s.mentions[i];
+		out += i ? "," : "";
+		out += "{\"screen_name\":\"";
+		add_name(out, e.rank, USER_NAME, false, length);
+		out += "\",\"name\":\"";
+		add_name(out, e.rank, USER_NAME, true, length);
+		out += "\",\"id\":";
+		append_number(out, 1000000 + e.rank);
+		out += ",\"id_str\":\"";
+		append_number(out, 1000000 + e.rank);
+		out += "\",\"indices\":[";
+		append_number(out, e.start);
+		out += ',';
+		append_number(out, e.end);
+		out += "]}";
+	}
+	out += "],\"urls\":[";
+	for (size_t i = 0; i < s.urls.size(); i++) {
+		const Entity& e = s.urls[i];
+		string domain;
+		add_name(domain, e.rank, DOMAIN_NAME, false, length);
+		domain += TLDS[e.rank % (sizeof(TLDS) / sizeof(TLDS[0]))];
+		out += i ? "," : "";
+		out += "{\"url\":\"";
+		append_link(out, e);
+		out += "\",\"expanded_url\":\"https://www.";
+		out += domain;
+		out += "/";
+		append_number(out, e.start * 7919 + e.rank);
+		out += "\",\"display_url\":\"";
+		out += domain;
+		out += "/\\u2026\",\"indices\":[";
+		append_number(out, e.start);
+		out += ',';
+		append_number(out, e.end);
+		out += "]}";
+	}
+	out += "]";
+}
+
+/**
+ * Picks a language (by weight).
+ * @return language code, e.g.: "en"
+ */
+const string& Generator::lang() {
+	double u = random.uniform() * lang_weights.back();
+	size_t i = std::upper_bound(lang_weights.begin(), lang_weights.end(), u) -
+			   lang_weights.begin();
+	return options.langs[std::min(i, options.langs.size() - 1)].first;
+}
+
+/**
+ * Appends the name of a hashtag, word, user or domain of a rank: the rank
+ * written with the letters of an alphabet (so that names of different ranks
+ * differ). A share of hashtags and words (options.unicode, chosen by
+ * rank) are written in other alphabets than ASCII.
+ * @param out output
+ * @param rank rank of the name
+ * @param kind kind of the name
+ * @param capital whether to start with a capital letter (ASCII only)
+ * @param length set to the length of the name, in code points
+ */
+void Generator::add_name(string& out, uint64_t rank, NameKind kind,
+						 bool capital, unsigned& length) const {
+	uint64_t hash = mix(options.seed ^ kind, rank);
+	size_t alphabet = 0;
+	if ((kind == HASHTAG_NAME || kind == WORD_NAME) &&
+		(double)(hash >> 11) * 0x1.0p-53 < options.unicode) {
+		alphabet = 1 + hash % (N_ALPHABETS - 1);
+	}
+	// At least two letters (three for single code point letters)
+	uint64_t n = rank + (LETTER_LENGTHS[alphabet] == 2
+							 ? ALPHABET_SIZE
+							 : ALPHABET_SIZE * ALPHABET_SIZE);
+	size_t start = out.length();
+	length = 0;
+	do {
+		out += ALPHABETS[alphabet][n % ALPHABET_SIZE];
+		length += LETTER_LENGTHS[alphabet];
+		n /= ALPHABET_SIZE;
+	} while (n);
+	if (capital && alphabet == 0) {
+		out[start] = (char)(out[start] - 'a' + 'A');
+	}
+}
+
+/**
+ * Adds a word to a text.
+ * @param s status
+ */
+void Generator::add_word(Status& s) {
+	unsigned length;
+	add_name(s.text, word_ranks(random), WORD_NAME, random.chance(0.1),
+			 length);
+	s.length += length;
+}
+
+/**
+ * Adds a hashtag to a text (a tenth of hashtags start with a capital).
+ * @param s status
+ */
+void Generator::add_hashtag(Status& s) {
+	Entity e = {hashtag_ranks(random), random.chance(0.1), s.length, 0};
+	unsigned length;
+	s.text += '#';
+	add_name(s.text, e.rank, HASHTAG_NAME, e.capital, length);
+	s.length += 1 + length;
+	e.end = s.length;
+	s.hashtags.push_back(e);
+}
+
+/**
+ * Adds a mention of a user to a text.
+ * @param s status
+ * @param user rank of the user
+ */
+void Generator::add_mention(Status& s, uint64_t user) {
+	Entity e = {user, false, s.length, 0};
+	unsigned length;
+	s.text += '@';
+	add_name(s.text, user, USER_NAME, false, length);
+	s.length += 1 + length;
+	e.end = s.length;
+	s.mentions.push_back(e);
+}
+
+/**
+ * Adds a t.co link (of 23 code points) to a text.
+ * @param s status
+ */
+void Generator::add_url(Status& s) {
+	Entity e = {domain_ranks(random), false, s.length, s.length + 23};
+	append_link(s.text, e);
+	s.length += 23;
+	s.urls.push_back(e);
+}
+
+/**
+ * Appends the t.co link of a URL (made from its domain and position).
+ * @param out output
+ * @param e URL
+ */
+static void append_link(string& out, const Entity& e) {
+	static const char* const CHARACTERS =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	uint64_t hash = mix(e.rank, e.start);
+	out += "https://t.co/";
+	for (int i = 0; i < 10; i++) {
+		out += CHARACTERS[hash % 62];
+		hash /= 62;
+	}
+}
+
+/**
+ * Appends the fields of a user (without braces).
+ * @param out output
+ * @param user rank of the user
+ */
+void Generator::add_user(string& out, uint64_t user) const {
+	unsigned length;
+	out += "\"id\":";
+	append_number(out, 1000000 + user);
+	out += ",\"id_str\":\"";
+	append_number(out, 1000000 + user);
+	out += "\",\"name\":\"";
+	add_name(out, user, USER_NAME, true, length);
+	out += "\",\"screen_name\":\"";
+	add_name(out, user, USER_NAME, false, length);
+	out += "\",\"location\":\"\",\"followers_count\":";
+	append_number(out, mix(options.seed, user) % 10000);
+}
+
+/**
+ * Appends a number in decimal.
+ * @param out output
+ * @param n number
+ */
+static void append_number(string& out, uint64_t n) {
+	char digits[20];
+	int i = 20;
+	do {
+		digits[--i] = (char)('0' + n % 10);
+		n /= 10;
+	} while (n);
+	out.append(digits + i, 20 - i);
+}
+
+/**
+ * Mixes two numbers into a seed (splitmix64 finaliser).
+ * @param a first number
+ * @param b second number
+ * @return mixed number
+ */
+static uint64_t mix(uint64_t a, uint64_t b) {
+	Random random = {a * 0x9E3779B97F4A7C15ULL ^ b};
+	return random.next();
+}
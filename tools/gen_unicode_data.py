@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# Generates unicode_data.hpp (ranges of word characters and simple case
+# folding runs) from the Unicode database bundled with Python.
+# The ranges are expanded into lookup tables at compile time (unicode.cpp).
+# Usage: python3 tools/gen_unicode_data.py > unicode_data.hpp
+
+import sys
+import unicodedata
+
+MAX_CODE_POINT = 0x10FFFF
+
+
+def is_surrogate(c):
+    return 0xD800 <= c <= 0xDFFF
+
+
+def is_word(c):
+    """Word characters (as in UTS #18 \\w): letters, marks, decimal and letter
+    numbers, connector punctuation and the join controls."""
+    if is_surrogate(c):
+        return False
+    category = unicodedata.category(chr(c))
+    return (category[0] in "LM" or category in ("Nd", "Nl", "Pc")
+            or c in (0x200C, 0x200D))
+
+
+def simple_fold(c):
+    """Simple case folding (CaseFolding.txt statuses C and S): the full
+    folding when it is a single code point, otherwise the lowercase mapping
+    when that is a single code point."""
+    if is_surrogate(c):
+        return c
+    ch = chr(c)
+    for mapped in (ch.casefold(), ch.lower()):
+        if len(mapped) == 1:
+            return ord(mapped)
+    return c
+
+
+def word_ranges():
+    ranges = []
+    start = None
+    for c in range(MAX_CODE_POINT + 2):
+        word = c <= MAX_CODE_POINT and is_word(c)
+        if word and start is None:
+            start = c
+        elif not word and start is not None:
+            ranges.append((start, c - 1))
+            start = None
+    return ranges
+
+
+def fold_runs():
+    folds = [(c, simple_fold(c) - c) for c in range(MAX_CODE_POINT + 1)
+             if simple_fold(c) != c]
+    deltas = sorted(set(delta for _, delta in folds))
+    runs = []
+    for c, delta in folds:
+        if runs:
+            first, last, stride, run_delta = runs[-1]
+            if run_delta == delta and (
+                    (first == last and c - last <= 2) or c - last == stride):
+                runs[-1] = (first, c, c - last, delta)
+                continue
+        runs.append((c, c, 1, delta))
+    return deltas, runs
+
+
+def main():
+    out = sys.stdout
+    deltas, runs = fold_runs()
+    ranges = word_ranges()
+
+    out.write("// Generated by tools/gen_unicode_data.py from Unicode %s, "
+              "do not edit\n" % unicodedata.unidata_version)
+    out.write("#pragma once\n\n#include <cstdint>\n\n")
+
+    out.write("// Ranges [first, last] of word characters\n")
+    out.write("static constexpr uint32_t WORD_RANGES[][2] = {\n")
+    for first, last in ranges:
+        out.write("\t{0x%X, 0x%X},\n" % (first, last))
+    out.write("};\n\n")
+
+    out.write("// Differences between code points and their simple case "
+              "folding\n")
+    out.write("static constexpr int32_t FOLD_DELTAS[] = {\n")
+    for i in range(0, len(deltas), 8):
+        out.write("\t" + ", ".join(str(d) for d in deltas[i:i + 8]) + ",\n")
+    out.write("};\n\n")
+
+    out.write("// Runs {first, last, stride, delta}: code points first, "
+              "first + stride, ...,\n// last fold to c + "
+              "FOLD_DELTAS[delta]\n")
+    out.write("static constexpr uint32_t FOLD_RUNS[][4] = {\n")
+    for first, last, stride, delta in runs:
+        out.write("\t{0x%X, 0x%X, %d, %d},\n"
+                  % (first, last, stride, deltas.index(delta)))
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
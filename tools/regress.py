@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# Regression gate of tp: correctness against golden results, and throughput
+# against a stored baseline.
+# The golden corpus (made by gen_corpus, the same on every machine) is run
+# with every extractor, with one and with several ranks and threads, and the
+# language and hashtag tables must be those of tools/regress/golden.txt. The
+# edge corpus (tools/regress/edge.json, lines written by hand whose layout
+# could mislead an extractor, e.g. a language only in the user) is run with
+# every extractor too, against tools/regress/edge_golden.txt. The throughput
+# corpus is then run --repeat times, and the best MB/s and tweets/s per core
+# must be within --tolerance of tools/regress/baseline.json (which is machine
+# specific: record it with --update-baseline).
+# Usage: python3 tools/regress.py [options] (run from the repository, after
+# make tp gen_corpus; see --help)
+
+import argparse
+import difflib
+import json
+import os
+import re
+import sys
+import tempfile
+
+from scaling import corpus, parse_size, run_tp
+
+REGRESS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           "regress")
+GOLDEN = os.path.join(REGRESS_DIR, "golden.txt")
+EDGE = os.path.join(REGRESS_DIR, "edge.json")
+EDGE_GOLDEN = os.path.join(REGRESS_DIR, "edge_golden.txt")
+BASELINE = os.path.join(REGRESS_DIR, "baseline.json")
+
+# Size of the golden corpus, and the (extractor, ranks, threads) it is run
+# with
+GOLDEN_SIZE = "16M"
+GOLDEN_RUNS = [(extractor, ranks, threads)
+               for extractor in ("sax", "index", "scan")
+               for ranks, threads in ((1, 1), (3, 2))]
+EDGE_RUNS = [(extractor, 1, 1) for extractor in ("sax", "index", "scan")]
+
+# Throughput run when there is no baseline to take it from
+THROUGHPUT_RUN = {"size": "128M", "ranks": 1, "threads": 1}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Regression gate of tp (golden results and throughput)")
+    parser.add_argument("--size",
+                        help="size of the throughput corpus (default: that "
+                             "of the baseline, else 128M)")
+    parser.add_argument("--ranks", type=int,
+                        help="processes of the throughput runs (default: "
+                             "those of the baseline, else 1)")
+    parser.add_argument("--threads", type=int,
+                        help="threads per process of the throughput runs "
+                             "(default: those of the baseline, else 1)")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="throughput runs; the best is used (default 3)")
+    parser.add_argument("--tolerance", type=float, default=0.1,
+                        help="largest allowed drop in throughput "
+                             "(default 0.1, i.e. 10%%)")
+    parser.add_argument("--update-golden", action="store_true",
+                        help="write the results of the golden and edge "
+                             "corpora to golden.txt and edge_golden.txt "
+                             "(after checking them by hand)")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="write the throughput to baseline.json")
+    parser.add_argument("--workdir", default=tempfile.gettempdir(),
+                        help="directory of the generated corpora")
+    parser.add_argument("--tp", default="./tp")
+    parser.add_argument("--gen-corpus", default="./gen_corpus")
+    parser.add_argument("--lang", default="lang.csv")
+    parser.add_argument("--mpirun", default="mpirun",
+                        help="mpirun command (Open MPI)")
+    args = parser.parse_args()
+    # The throughput run defaults to that of the baseline, so that the rates
+    # per core compare
+    run = dict(THROUGHPUT_RUN)
+    if os.path.exists(BASELINE):
+        with open(BASELINE) as f:
+            baseline = json.load(f)
+        run.update((k, baseline[k]) for k in run)
+    for key, value in run.items():
+        if getattr(args, key) is None:
+            setattr(args, key, value)
+    # Options of scaling.run_tp and scaling.corpus
+    args.seed = "1"
+    args.cores = os.cpu_count()
+    args.tp_args = ""
+    return args
+
+
+def tables(results):
+    """Language and hashtag tables of the output of tp, with ties in any
+    order (the order of keys of the same count is not defined)."""
+    lines = []
+    for line in results.splitlines():
+        if line.startswith("[*]"):
+            lines.append(line)
+        elif line.strip():
+            lines.append(re.sub(r"^\d+\. ", "", line))
+    # Sort the rows of each table, keeping the table headers in place
+    out, rows = [], []
+    for line in lines + ["[*]"]:
+        if line.startswith("[*]"):
+            out += sorted(rows)
+            rows = []
+            out.append(line)
+        else:
+            rows.append(line)
+    return "\n".join(out[:-1]) + "\n"
+
+
+def check_golden(args, path, golden_path, runs):
+    """Runs a corpus with each of runs, returning whether every run matches
+    its golden results (or writing them, from the first run)."""
+    passed = True
+    update = args.update_golden
+    for extractor, ranks, threads in runs:
+        args.tp_args = "--extractor=" + extractor
+        results = tables(run_tp(args, ranks, threads, path)[3])
+        args.tp_args = ""
+        name = "%s, %s, %d x %d" % (os.path.basename(path), extractor, ranks,
+                                    threads)
+        if update:
+            with open(golden_path, "w") as f:
+                f.write(results)
+            print("[*] Golden results written to %s (%s)" % (golden_path,
+                                                            name))
+            update = False
+            continue
+        with open(golden_path) as f:
+            golden = f.read()
+        if results == golden:
+            print("[*] Golden results: %s passed" % name)
+            continue
+        passed = False
+        print("[!] Golden results: %s FAILED" % name)
+        sys.stdout.writelines(difflib.unified_diff(
+            golden.splitlines(True), results.splitlines(True), "golden",
+            name))
+    return passed
+
+
+def check_throughput(args):
+    """Times the throughput corpus, returning whether it is within the
+    tolerance of the baseline."""
+    size = parse_size(args.size)
+    path = corpus(args, size)
+    with open(path) as f:
+        tweets = int(re.search(r'"total_rows":(\d+)', f.readline()).group(1))
+    seconds = min(run_tp(args, args.ranks, args.threads, path)[1]
+                  for _ in range(args.repeat))
+    cores = args.ranks * args.threads
+    measured = {
+        "size": args.size, "ranks": args.ranks, "threads": args.threads,
+        "mb_per_s_per_core": size / 1e6 / seconds / cores,
+        "tweets_per_s_per_core": tweets / seconds / cores}
+    print("[*] Throughput (%s, %d x %d, best of %d): %.1f MB/s and %.0f "
+          "tweets/s per core" % (args.size, args.ranks, args.threads,
+                                 args.repeat, measured["mb_per_s_per_core"],
+                                 measured["tweets_per_s_per_core"]))
+    if args.update_baseline:
+        with open(BASELINE, "w") as f:
+            json.dump(measured, f, indent=4)
+            f.write("\n")
+        print("[*] Baseline written to %s" % BASELINE)
+        return True
+
+    if not os.path.exists(BASELINE):
+        print("[!] No baseline (record one with --update-baseline)")
+        return False
+    with open(BASELINE) as f:
+        baseline = json.load(f)
+    if any(baseline[k] != measured[k] for k in ("size", "ranks", "threads")):
+        print("[!] The baseline was recorded with %s, %d x %d: per core "
+              "rates may not compare" % (baseline["size"], baseline["ranks"],
+                                         baseline["threads"]))
+    passed = True
+    for key in ("mb_per_s_per_core", "tweets_per_s_per_core"):
+        change = measured[key] / baseline[key] - 1
+        ok = change >= -args.tolerance
+        passed &= ok
+        print("[%s] %s: %.1f against %.1f (%+.1f%%)" % (
+            "*" if ok else "!", key, measured[key], baseline[key],
+            100 * change))
+    return passed
+
+
+def main():
+    args = parse_args()
+    for program in (args.tp, args.gen_corpus):
+        if not os.path.exists(program):
+            sys.exit("%s not found (make tp gen_corpus)" % program)
+    passed = check_golden(args, corpus(args, parse_size(GOLDEN_SIZE)), GOLDEN,
+                          GOLDEN_RUNS)
+    passed &= check_golden(args, EDGE, EDGE_GOLDEN, EDGE_RUNS)
+    passed &= check_throughput(args)
+    print("[*] Regression gate passed" if passed
+          else "[!] Regression gate FAILED")
+    sys.exit(0 if passed else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+# Strong and weak scaling study of tp on one machine (with mpirun, no Slurm).
+# Runs tp over a grid of ranks x threads, on a corpus of a fixed size (strong
+# scaling) and on a corpus whose size grows with the cores used (weak
+# scaling), both generated with gen_corpus. Prints the time, speedup and
+# efficiency of each configuration with the slowest thread's stage times
+# (from --timing-json), and writes every run to a CSV file.
+# Usage: python3 tools/scaling.py [options] (run from the repository, after
+# make tp gen_corpus; see --help)
+
+import argparse
+import csv
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+STAGES = ["read", "split", "parse", "extract", "count", "thread merge"]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Strong and weak scaling study of tp with mpirun")
+    parser.add_argument("--ranks", default="1,2,4",
+                        help="numbers of MPI processes (default 1,2,4)")
+    parser.add_argument("--threads", default="1,2,4",
+                        help="numbers of OpenMP threads per process "
+                             "(default 1,2,4)")
+    parser.add_argument("--mode", choices=["strong", "weak", "both"],
+                        default="both")
+    parser.add_argument("--size", default="512M",
+                        help="corpus size for strong scaling (default 512M)")
+    parser.add_argument("--size-per-core", default="128M",
+                        help="corpus size per core for weak scaling "
+                             "(default 128M)")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="runs per configuration; the median is used "
+                             "(default 3)")
+    parser.add_argument("--oversubscribe", action="store_true",
+                        help="also run configurations with more ranks x "
+                             "threads than cores")
+    parser.add_argument("--cores", type=int, default=os.cpu_count(),
+                        help="cores of the machine (default: all)")
+    parser.add_argument("--csv", default="scaling.csv",
+                        help="file every run is written to "
+                             "(default scaling.csv)")
+    parser.add_argument("--workdir", default=tempfile.gettempdir(),
+                        help="directory of the generated corpora")
+    parser.add_argument("--seed", default="1", help="seed of the corpora")
+    parser.add_argument("--tp", default="./tp")
+    parser.add_argument("--gen-corpus", default="./gen_corpus")
+    parser.add_argument("--lang", default="lang.csv")
+    parser.add_argument("--mpirun", default="mpirun",
+                        help="mpirun command (Open MPI)")
+    parser.add_argument("--tp-args", default="",
+                        help="extra options of tp, e.g. --extractor=scan")
+    return parser.parse_args()
+
+
+def parse_size(size):
+    """Bytes of a size such as 512M (K, M and G are powers of 1024)."""
+    match = re.fullmatch(r"(\d+)([KMG]?)", size)
+    if not match:
+        sys.exit("Invalid size: " + size)
+    return int(match.group(1)) << (10 * " KMG".index(match.group(2) or " "))
+
+
+def corpus(args, size):
+    """Path of a corpus of about size bytes, generated if it is not there
+    (the same options always give the same corpus)."""
+    path = os.path.join(args.workdir,
+                        "scaling-%s-%d.json" % (args.seed, size))
+    if not os.path.exists(path):
+        print("[*] Generating %s" % path, flush=True)
+        subprocess.run([args.gen_corpus, "--size=%d" % size,
+                        "--seed=" + args.seed, path], check=True)
+    return path
+
+
+def run_tp(args, ranks, threads, path):
+    """Runs tp once, returning its wall time, its built in time, the slowest
+    thread's time in each stage, and its results (to compare runs)."""
+    command = [args.mpirun, "-np", str(ranks), "--bind-to", "none",
+               "-x", "OMP_NUM_THREADS"]
+    if ranks > args.cores:
+        command.append("--oversubscribe")
+    if hasattr(os, "geteuid") and os.geteuid() == 0:
+        command.append("--allow-run-as-root")
+    with tempfile.NamedTemporaryFile(suffix=".json") as timing:
+        command += [args.tp, "--timing-json=" + timing.name]
+        command += args.tp_args.split() + [path, args.lang]
+        env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+        start = time.monotonic()
+        result = subprocess.run(command, env=env, stdout=subprocess.PIPE,
+                                stderr=subprocess.PIPE, text=True)
+        wall = time.monotonic() - start
+        if result.returncode != 0:
+            sys.exit("tp failed (%s):\n%s" % (" ".join(command),
+                                              result.stderr))
+        with open(timing.name) as f:
+            stages = {stage["name"]: stage["max"]
+                      for stage in json.load(f)["stages"]}
+
+    # Built in time, and the results (the lines before the timings)
+    match = re.search(r"Time cost \(built-in\)\s+([\d.e+-]+) seconds",
+                      result.stdout)
+    seconds = float(match.group(1)) if match else wall
+    results = result.stdout.split("[*] Stage timing")[0].strip()
+    combine = sum(seconds for name, seconds in stages.items()
+                  if name.startswith("combine"))
+    return wall, seconds, [stages.get(s, 0) for s in STAGES] + [combine], \
+        results
+
+
+def configurations(args):
+    """(ranks, threads) of the grid, without oversubscribed ones unless
+    asked for."""
+    grid = []
+    for ranks in [int(r) for r in args.ranks.split(",")]:
+        for threads in [int(t) for t in args.threads.split(",")]:
+            if ranks * threads > args.cores and not args.oversubscribe:
+                print("[!] Skipping %d x %d (more than %d cores, see "
+                      "--oversubscribe)" % (ranks, threads, args.cores))
+                continue
+            grid.append((ranks, threads))
+    return sorted(grid, key=lambda c: (c[0] * c[1], c))
+
+
+def study(args, mode, writer):
+    """Runs a strong or weak scaling study, printing its table."""
+    grid = configurations(args)
+    if not grid:
+        return
+    base_size = parse_size(args.size if mode == "strong"
+                           else args.size_per_core)
+    print()
+    print("[*] %s scaling (%s%s)" % (
+        mode.capitalize(), args.size if mode == "strong"
+        else args.size_per_core, "" if mode == "strong" else " per core"))
+    header = "%6s %8s %6s %10s %8s %10s" % (
+        "ranks", "threads", "cores", "seconds", "speedup", "efficiency")
+    print(header + "".join(" %9s" % s.split()[-1]
+                           for s in STAGES + ["combine"]))
+
+    baseline = None
+    reference = {}
+    for ranks, threads in grid:
+        cores = ranks * threads
+        size = base_size if mode == "strong" else base_size * cores
+        path = corpus(args, size)
+        runs = []
+        for run in range(args.repeat):
+            wall, seconds, stages, results = run_tp(args, ranks, threads,
+                                                    path)
+            if reference.setdefault(size, results) != results:
+                print("[!] %d x %d gives different results from the first "
+                      "run on the same corpus" % (ranks, threads))
+            runs.append((seconds, stages))
+            writer.writerow([mode, ranks, threads, cores, size, run,
+                             "%.6f" % wall, "%.6f" % seconds]
+                            + ["%.6f" % s for s in stages])
+
+        seconds = statistics.median(s for s, _ in runs)
+        stages = [statistics.median(s[i] for _, s in runs)
+                  for i in range(len(STAGES) + 1)]
+        if baseline is None:
+            baseline = (seconds, cores)
+        # Strong: speedup T1 / Tp, efficiency speedup / p; weak: the work
+        # grows with p, so speedup is p T1 / Tp and efficiency T1 / Tp
+        if mode == "strong":
+            speedup = baseline[0] / seconds * baseline[1]
+        else:
+            speedup = baseline[0] / seconds * cores
+        efficiency = speedup / cores
+        print("%6d %8d %6d %10.3f %8.2f %10.2f" % (
+            ranks, threads, cores, seconds, speedup, efficiency)
+            + "".join(" %9.3f" % s for s in stages), flush=True)
+
+
+def main():
+    args = parse_args()
+    for program in (args.tp, args.gen_corpus):
+        if not os.path.exists(program):
+            sys.exit("%s not found (make tp gen_corpus)" % program)
+    modes = ["strong", "weak"] if args.mode == "both" else [args.mode]
+    with open(args.csv, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["mode", "ranks", "threads", "cores", "bytes", "run",
+                         "wall_seconds", "seconds"]
+                        + [s.replace(" ", "_") + "_seconds"
+                           for s in STAGES + ["combine"]])
+        for mode in modes:
+            study(args, mode, writer)
+    print()
+    print("[*] Every run written to %s" % args.csv)
+
+
+if __name__ == "__main__":
+    main()
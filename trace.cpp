@@ -0,0 +1,140 @@
+// Timeline of chunks and combining in Chrome Trace Event format
+// Each process writes its spans to <options.trace>.<rank>.json, with the rank
+// as the process id and the OpenMP thread as the thread id. The file of rank
+// 0 opens the JSON array and no file closes it (which the format allows), so
+// the files of all ranks can be concatenated into one trace:
+//     cat trace.*.json > trace.json
+// and opened in chrome://tracing or https://ui.perfetto.dev
+
+#define OMPI_SKIP_MPICXX
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <omp.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+using std::string;
+using std::vector;
+
+// Start of tracing (MPI_Wtime), and rank of this process
+static double start_time;
+static int trace_rank;
+
+// Spans of this process, as trace events
+static vector<string> events;
+
+// Function prototypes
+static void add_span(const string& name, const char* category, double start,
+					 int thread, const string& args);
+
+/**
+ * Time since tracing started on this process, in microseconds.
+ * @return time
+ */
+double trace_now() {
+	return (MPI_Wtime() - start_time) * 1e6;
+}
+
+/**
+ * Starts tracing on every process (when options.trace is set). Processes
+ * wait for each other first, so that their times line up.
+ * @param rank rank of the running process
+ */
+void trace_init(int rank) {
+	if (options.trace.empty()) {
+		return;
+	}
+	trace_rank = rank;
+	MPI_Barrier(MPI_COMM_WORLD);
+	start_time = MPI_Wtime();
+}
+
+/**
+ * Adds a span of a chunk processed by the calling thread, ending now.
+ * @param start start time (trace_now)
+ * @param bytes bytes of the chunk
+ * @param tweets lines processed in the chunk
+ */
+void trace_chunk(double start, long long bytes, unsigned long tweets) {
+	if (options.trace.empty()) {
+		return;
+	}
+	std::stringstream args;
+	args << "{\"bytes\":" << bytes << ",\"tweets\":" << tweets << "}";
+	add_span("chunk", "chunk", start, omp_get_thread_num(), args.str());
+}
+
+/**
+ * Adds a span of a phase of combine_maps, ending now.
+ * @param phase phase, e.g.: "send", "recv" or "barrier"
+ * @param start start time (trace_now)
+ * @param level level of combine_maps
+ * @param peer rank sent to or received from (-1 for none)
+ */
+void trace_combine(const char* phase, double start, int level, int peer) {
+	if (options.trace.empty()) {
+		return;
+	}
+	std::stringstream args;
+	args << "{\"level\":" << level;
+	if (peer != -1) {
+		args << ",\"peer\":" << peer;
+	}
+	args << "}";
+	add_span(phase, "combine", start, 0, args.str());
+}
+
+/**
+ * Adds a complete event ("X") ending now.
+ * @param name name of the span, e.g.: "chunk"
+ * @param category category of the span, e.g.: "combine"
+ * @param start start time (trace_now)
+ * @param thread thread id
+ * @param args arguments of the span (JSON object)
+ */
+static void add_span(const string& name, const char* category, double start,
+					 int thread, const string& args) {
+	double end = trace_now();
+	std::stringstream event;
+	event.precision(3);
+	event << std::fixed << "{\"name\":\"" << name << "\",\"cat\":\""
+		  << category << "\",\"ph\":\"X\",\"ts\":" << start
+		  << ",\"dur\":" << end - start << ",\"pid\":" << trace_rank
+		  << ",\"tid\":" << thread
+		  << ",\"args\":" << args << "}";
+#pragma omp critical(trace)
+	events.push_back(event.str());
+}
+
+/**
+ * Writes the spans of this process to <options.trace>.<rank>.json, after the
+ * names of the process and its threads.
+ */
+void write_trace() {
+	if (options.trace.empty()) {
+		return;
+	}
+	string pid = std::to_string(trace_rank);
+	string filename = options.trace + "." + pid + ".json";
+	std::ofstream os(filename);
+	if (os.fail()) {
+		std::cerr << "Cannot write trace file " << filename << std::endl;
+		return;
+	}
+	if (trace_rank == 0) {
+		os << "[" << std::endl;
+	}
+	os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+	   << ",\"args\":{\"name\":\"rank " << pid << "\"}}," << std::endl;
+	for (int t = 0; t < omp_get_max_threads(); t++) {
+		os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+		   << ",\"tid\":" << t << ",\"args\":{\"name\":\"thread " << t
+		   << "\"}}," << std::endl;
+	}
+	for (const string& event : events) {
+		os << event << "," << std::endl;
+	}
+}
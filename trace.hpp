@@ -0,0 +1,36 @@
+#pragma once
+
+#include "options.hpp"
+
+/**
+ * Time since tracing started on this process, in microseconds (processes
+ * start together, after a barrier).
+ */
+double trace_now();
+
+/**
+ * Starts tracing on every process (when options.trace is set).
+ */
+void trace_init(int rank);
+
+/**
+ * Adds a span of a chunk processed by the calling thread.
+ * @param start start time (trace_now)
+ * @param bytes bytes of the chunk
+ * @param tweets lines processed in the chunk
+ */
+void trace_chunk(double start, long long bytes, unsigned long tweets);
+
+/**
+ * Adds a span of a phase of combine_maps.
+ * @param phase phase, e.g.: "send", "recv" or "barrier"
+ * @param start start time (trace_now)
+ * @param level level of combine_maps
+ * @param peer rank sent to or received from (-1 for none)
+ */
+void trace_combine(const char* phase, double start, int level, int peer);
+
+/**
+ * Writes the spans of this process to its trace file.
+ */
+void write_trace();
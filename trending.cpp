@@ -0,0 +1,155 @@
+// Trending hashtags, from the counts per time bucket (--trending)
+// A window of the last options.trending buckets is compared with a baseline
+// of the options.trend_baseline buckets before it. Both are kept as running
+// sums per hashtag: moving the window on by a bucket adds the bucket that
+// enters it, moves the one that leaves it to the baseline and takes out the
+// one that leaves the baseline, so a step only touches the hashtags of those
+// three buckets. A hashtag's score (how far its count in the window is above
+// the count expected from the baseline, in standard deviations of a Poisson
+// count) only changes with its sums, so scores are kept in an ordered set
+// that is updated for the hashtags touched, and the top of the set is
+// printed at every step
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <vector>
+#include "buckets.hpp"
+#include "combine.hpp"
+#include "options.hpp"
+#include "trending.hpp"
+
+using std::string;
+using std::unordered_map;
+
+/**
+ * Running sums and score of a hashtag.
+ */
+struct TrendState {
+	long long window = 0;
+	long long baseline = 0;
+	double score = 0;
+	bool ranked = false;  // in the set of ranked hashtags
+	bool touched = false; // to be scored at this step
+};
+
+/**
+ * Order of ranked hashtags: highest score first (then by hashtag).
+ */
+struct TrendOrder {
+	bool operator()(const std::pair<double, const string*>& a,
+					const std::pair<double, const string*>& b) const {
+		if (a.first != b.first) {
+			return a.first > b.first;
+		}
+		return *a.second < *b.second;
+	}
+};
+
+// Function prototypes
+static void print_trends(
+	long long bucket,
+	const std::set<std::pair<double, const string*>, TrendOrder>& ranked,
+	const unordered_map<string, TrendState>& states);
+
+/**
+ * Prints the hashtags rising the most (at least options.trend_min times in
+ * the window, and above the count expected from the baseline) at each
+ * position of the window, once the baseline is full.
+ * @param buckets hashtag counts of each bucket, by bucket index (buckets
+ * without tweets are left out)
+ */
+void report_trending(
+	const std::map<long long, const unordered_map<string, unsigned long>*>&
+		buckets) {
+	if (buckets.empty()) {
+		return;
+	}
+	const unordered_map<string, unsigned long> empty;
+	long long window = options.trending;
+	long long baseline = options.trend_baseline;
+	auto bucket_at = [&](long long b) -> const unordered_map<string,
+															 unsigned long>& {
+		auto it = buckets.find(b);
+		return it == buckets.end() ? empty : *it->second;
+	};
+
+	unordered_map<string, TrendState> states;
+	std::set<std::pair<double, const string*>, TrendOrder> ranked;
+	std::vector<std::pair<const string, TrendState>*> touched;
+
+	// Adds a bucket's counts (times dw) to the window sums and (times db) to
+	// the baseline sums
+	auto shift = [&](const unordered_map<string, unsigned long>& bucket,
+					 long long dw, long long db) {
+		for (const auto& it : bucket) {
+			auto& entry = *states.try_emplace(it.first).first;
+			entry.second.window += dw * (long long)it.second;
+			entry.second.baseline += db * (long long)it.second;
+			if (!entry.second.touched) {
+				entry.second.touched = true;
+				touched.push_back(&entry);
+			}
+		}
+	};
+
+	long long first = buckets.begin()->first;
+	long long last = buckets.rbegin()->first;
+	for (long long t = first; t <= last; t++) {
+		touched.clear();
+		shift(bucket_at(t), 1, 0);
+		shift(bucket_at(t - window), -1, 1);
+		shift(bucket_at(t - window - baseline), 0, -1);
+
+		// Score the hashtags touched
+		for (auto* entry : touched) {
+			TrendState& s = entry->second;
+			s.touched = false;
+			if (s.ranked) {
+				ranked.erase({s.score, &entry->first});
+				s.ranked = false;
+			}
+			if (s.window == 0 && s.baseline == 0) {
+				states.erase(states.find(entry->first));
+				continue;
+			}
+			double expected = (double)s.baseline * window / baseline;
+			s.score = (s.window - expected) / std::sqrt(expected + 1);
+			if (s.window >= (long long)options.trend_min && s.score > 0) {
+				ranked.insert({s.score, &entry->first});
+				s.ranked = true;
+			}
+		}
+		if (t >= first + window + baseline - 1 && !ranked.empty()) {
+			print_trends(t, ranked, states);
+		}
+	}
+}
+
+/**
+ * Prints the top TOP_K ranked hashtags of a position of the window.
+ * @param bucket last bucket of the window
+ * @param ranked ranked hashtags
+ * @param states sums of the hashtags
+ */
+static void print_trends(
+	long long bucket,
+	const std::set<std::pair<double, const string*>, TrendOrder>& ranked,
+	const unordered_map<string, TrendState>& states) {
+	long long window = options.trending;
+	long long baseline = options.trend_baseline;
+	std::cout << std::endl
+			  << "[*] Trending Hashtags, " << bucket_name(bucket - window + 1)
+			  << " to " << bucket_name(bucket) << std::endl;
+	size_t i = 0;
+	for (auto it = ranked.begin(); it != ranked.end() && i < TOP_K;
+		 ++it, i++) {
+		const TrendState& s = states.at(*it->second);
+		std::cout << i + 1 << ". " << *it->second << ", "
+				  << format_number(std::to_string(s.window)) << std::fixed
+				  << std::setprecision(1) << " (expected "
+				  << (double)s.baseline * window / baseline << ", z "
+				  << it->first << ")" << std::defaultfloat << std::endl;
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Prints the hashtags rising the most in each position of a sliding window
+ * over the buckets, against the buckets before the window.
+ */
+void report_trending(
+	const std::map<long long,
+				   const std::unordered_map<std::string, unsigned long>*>&
+		buckets);
@@ -0,0 +1,256 @@
+// Extracts the fields of a tweet from a line
+// Only the fields below are looked at, with a path matcher generated for them
+// (see json_paths.hpp), either by a SAX parser or by walking a structural
+// index of the line (see structural.hpp), so no DOM is built
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "tweet.hpp"
+#include "json_paths.hpp"
+#include "options.hpp"
+#include "scan.hpp"
+#include "structural.hpp"
+
+using std::string;
+using std::string_view;
+
+// Paths of the fields (their index is the field number), with those of the
+// entities, and with every field (see extract_fields)
+static constexpr const char* TWEET_PATHS[] = {
+	"doc.lang",
+	"doc.text",
+	"doc.entities.hashtags[].text",
+	"doc.created_at",
+};
+static constexpr const char* ENTITY_TWEET_PATHS[] = {
+	"doc.lang",
+	"doc.text",
+	"doc.entities.hashtags[].text",
+	"doc.created_at",
+	"doc.entities.user_mentions[].screen_name",
+	"doc.entities.urls[].expanded_url",
+};
+static constexpr const char* ALL_TWEET_PATHS[] = {
+	"doc.lang",
+	"doc.text",
+	"doc.entities.hashtags[].text",
+	"doc.created_at",
+	"doc.entities.user_mentions[].screen_name",
+	"doc.entities.urls[].expanded_url",
+	"doc.user.screen_name",
+	"doc.place.full_name",
+};
+enum TweetField { LANG, TEXT, HASHTAG, CREATED_AT, MENTION, URL, USER, PLACE };
+
+// Bytes of a line shown when extractors disagree on it
+static const size_t VERIFY_SHOWN_BYTES = 300;
+
+// Function prototypes
+struct TweetSink;
+static bool extract_with(Extractor extractor, char* line, size_t length,
+						 Tweet& tweet);
+template <const auto& PATHS>
+static bool extract_paths(Extractor extractor, char* line, size_t length,
+						  TweetSink& sink);
+static bool verify_tweet(char* line, size_t length, Tweet& tweet);
+static bool same_field(string_view a, string_view b);
+
+// Fields that are extracted
+static TweetFields fields = TweetFields::CORE;
+
+/**
+ * Stores the fields found by the parser in a tweet.
+ * Like a DOM lookup, the first of duplicate keys is kept.
+ */
+struct TweetSink {
+	Tweet& tweet;
+
+	void field(int field, const char* str, size_t length) {
+		switch (field) {
+		case LANG:
+			if (!tweet.lang.data()) {
+				tweet.lang = string_view(str, length);
+			}
+			break;
+		case TEXT:
+			if (!tweet.text.data()) {
+				tweet.text = string_view(str, length);
+			}
+			break;
+		case HASHTAG:
+			tweet.hashtags.emplace_back(str, length);
+			break;
+		case MENTION:
+			tweet.mentions.emplace_back(str, length);
+			break;
+		case URL:
+			tweet.urls.emplace_back(str, length);
+			break;
+		case CREATED_AT:
+			if (!tweet.created_at.data()) {
+				tweet.created_at = string_view(str, length);
+			}
+			break;
+		case USER:
+			if (!tweet.user.data()) {
+				tweet.user = string_view(str, length);
+			}
+			break;
+		case PLACE:
+			if (!tweet.place.data()) {
+				tweet.place = string_view(str, length);
+			}
+			break;
+		}
+	}
+};
+
+/**
+ * Clears the fields (keeping the capacity for hashtags, mentions and URLs).
+ */
+void Tweet::clear() {
+	lang = string_view();
+	text = string_view();
+	created_at = string_view();
+	hashtags.clear();
+	mentions.clear();
+	urls.clear();
+	user = string_view();
+	place = string_view();
+}
+
+/**
+ * Sets the fields that only some counts need (the mentions and URLs, and the
+ * user and place) to be extracted, before any line is. The scan extractor
+ * finds the entities but not the user or place, so with every field its
+ * lines are walked by the index extractor.
+ * @param extracted fields that are extracted
+ */
+void extract_fields(TweetFields extracted) {
+	fields = extracted;
+}
+
+/**
+ * Parses a line in place (unescaping strings within the line) and extracts
+ * its language, text, entity hashtags and created_at (and the other fields
+ * set by extract_fields), with options.extractor (checking every
+ * options.verify-th line against SAX).
+ * @param line line (null terminated JSON, overwritten by the parser)
+ * @param length number of bytes in line
+ * @param tweet set to the fields of the line
+ * @return whether the line is valid JSON
+ */
+bool extract_tweet(char* line, size_t length, Tweet& tweet) {
+	// Lines extracted by this thread
+	static thread_local unsigned long n_lines = 0;
+	if (options.verify && options.extractor != Extractor::SAX &&
+		n_lines++ % options.verify == 0) {
+		return verify_tweet(line, length, tweet);
+	}
+	return extract_with(options.extractor, line, length, tweet);
+}
+
+/**
+ * Extracts the fields of a line with an extractor.
+ * The index extractor only checks the structure of the line (brackets,
+ * strings and separators), and the scan extractor only the values it finds,
+ * where the SAX parser validates the whole line.
+ * @param extractor extractor
+ * @param line line (null terminated JSON, overwritten by the parser)
+ * @param length number of bytes in line
+ * @param tweet set to the fields of the line
+ * @return whether the line is valid JSON
+ */
+static bool extract_with(Extractor extractor, char* line, size_t length,
+						 Tweet& tweet) {
+	tweet.clear();
+	if (extractor == Extractor::SCAN && fields != TweetFields::ALL) {
+		ScanResult result = scan_tweet(
+			line, length, fields == TweetFields::ENTITIES, tweet);
+		if (result != ScanResult::UNUSUAL) {
+			return result == ScanResult::FOUND;
+		}
+		tweet.clear();
+		extractor = Extractor::SAX;
+	}
+	TweetSink sink{tweet};
+	switch (fields) {
+	case TweetFields::CORE:
+		return extract_paths<TWEET_PATHS>(extractor, line, length, sink);
+	case TweetFields::ENTITIES:
+		return extract_paths<ENTITY_TWEET_PATHS>(extractor, line, length,
+												 sink);
+	default:
+		return extract_paths<ALL_TWEET_PATHS>(extractor, line, length, sink);
+	}
+}
+
+/**
+ * Extracts the fields of the paths from a line by walking its structural
+ * index (for the index and scan extractors) or with SAX.
+ * @param extractor extractor
+ * @param line line (null terminated JSON, overwritten by the parser)
+ * @param length number of bytes in line
+ * @param sink sink of the fields
+ * @return whether the line is valid JSON
+ */
+template <const auto& PATHS>
+static bool extract_paths(Extractor extractor, char* line, size_t length,
+						  TweetSink& sink) {
+	if (extractor != Extractor::SAX && length < UINT32_MAX) {
+		size_t n = index_structurals(line, length, sink.tweet.structurals);
+		StructuralWalker<PATHS, TweetSink> walker(
+			line, sink.tweet.structurals.data(), n, sink);
+		return walker.walk();
+	}
+	PathHandler<PATHS, TweetSink> handler(sink);
+	rapidjson::Reader reader;
+	rapidjson::InsituStringStream ss(line);
+	return !reader.Parse<rapidjson::kParseInsituFlag>(ss, handler).IsError();
+}
+
+/**
+ * Extracts the fields of a line with options.extractor and with SAX (from a
+ * copy of the line), reporting any difference.
+ * @param line line (null terminated JSON, overwritten by the parser)
+ * @param length number of bytes in line
+ * @param tweet set to the fields of the line (from options.extractor)
+ * @return whether the line is valid JSON (according to options.extractor)
+ */
+static bool verify_tweet(char* line, size_t length, Tweet& tweet) {
+	static thread_local string copy;
+	static thread_local Tweet expected;
+	copy.assign(line, length);
+	string original = copy;
+
+	bool valid = extract_with(options.extractor, line, length, tweet);
+	bool expected_valid =
+		extract_with(Extractor::SAX, &copy[0], length, expected);
+
+	bool same = valid == expected_valid;
+	if (same && valid) {
+		same = same_field(tweet.lang, expected.lang) &&
+			   same_field(tweet.text, expected.text) &&
+			   same_field(tweet.created_at, expected.created_at) &&
+			   tweet.hashtags == expected.hashtags &&
+			   tweet.mentions == expected.mentions &&
+			   tweet.urls == expected.urls &&
+			   same_field(tweet.user, expected.user) &&
+			   same_field(tweet.place, expected.place);
+	}
+	if (!same) {
+		std::stringstream m;
+		m << "[!] Extractor differs from SAX on line: "
+		  << original.substr(0, VERIFY_SHOWN_BYTES) << std::endl;
+		std::cerr << m.str();
+	}
+	return valid;
+}
+
+/**
+ * Whether two fields are the same (both missing, or equal).
+ */
+static bool same_field(string_view a, string_view b) {
+	return (a.data() == nullptr) == (b.data() == nullptr) && a == b;
+}
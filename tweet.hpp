@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * Fields of a tweet that are extracted from a line (see extract_fields).
+ */
+enum class TweetFields {
+	CORE,     // language, text, hashtags and created_at
+	ENTITIES, // and the mentions and URLs of the entities
+	ALL,      // and the user and place
+};
+
+/**
+ * Fields of a tweet that are counted, pointing into the line they were
+ * extracted from (a field that is not in the line has a null data()). The
+ * mentions, URLs, user and place are only extracted with the TweetFields
+ * that include them.
+ */
+struct Tweet {
+	std::string_view lang;
+	std::string_view text;
+	std::string_view created_at;
+	std::vector<std::string_view> hashtags;
+	std::vector<std::string_view> mentions; // screen names
+	std::vector<std::string_view> urls;     // expanded URLs
+	std::string_view user;
+	std::string_view place;
+
+	// Structural index of the line (reused from line to line)
+	std::vector<uint32_t> structurals;
+
+	void clear();
+};
+
+/**
+ * Parses a line (in place) and extracts its fields into tweet, with the
+ * extractor chosen by options.extractor.
+ */
+bool extract_tweet(char* line, size_t length, Tweet& tweet);
+
+/**
+ * Sets the fields that are extracted (CORE by default), before any line is.
+ */
+void extract_fields(TweetFields fields);
@@ -0,0 +1,319 @@
+// UTF-8 decoding, word character classification and simple case folding
+// Used to find and normalise hashtags in any script, e.g. "#Café" and
+// "#CAFÉ" are the same hashtag, and "#ไทย" is a hashtag at all
+
+// References:
+// http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ (UTF-8 decoder)
+// https://www.unicode.org/reports/tr18/#Compatibility_Properties (\w)
+// https://www.unicode.org/Public/UCD/latest/ucd/CaseFolding.txt
+
+#include <array>
+#include "unicode.hpp"
+#include "unicode_data.hpp"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Decoder states
+static const uint32_t UTF8_ACCEPT = 0;
+static const uint32_t UTF8_REJECT = 12;
+
+// Byte classes (first 256 entries) and state transitions (the rest)
+static const uint8_t UTF8D[] = {
+	// 00..7f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0,
+	// 80..bf
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	// c0..ff
+	8, 8, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 10, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 3, 3, 11,
+	6, 6, 6, 5, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	// Transitions
+	0, 12, 24, 36, 60, 96, 84, 12, 12, 12, 48, 72, 12, 12, 12, 12, 12, 12, 12,
+	12, 12, 12, 12, 12, 12, 0, 12, 12, 12, 12, 12, 0, 12, 0, 12, 12, 12, 24,
+	12, 12, 12, 12, 12, 24, 12, 24, 12, 12, 12, 12, 12, 12, 12, 12, 12, 24, 12,
+	12, 12, 12, 12, 24, 12, 12, 12, 12, 12, 12, 12, 24, 12, 12, 12, 12, 12, 12,
+	12, 12, 12, 36, 12, 36, 12, 12, 12, 36, 12, 12, 12, 12, 12, 36, 12, 36, 12,
+	12, 12, 36, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12};
+
+// ASCII word characters [0-9A-Za-z_], one bit per character
+static const uint64_t ASCII_WORD[2] = {0x03ff000000000000ULL,
+									   0x07fffffe87fffffeULL};
+
+// Entries of the lookup table: bit 7 is set for word characters and the low
+// 7 bits are 1 + the index of the folding delta (0 when there is none)
+static const uint8_t WORD_BIT = 0x80;
+static const uint8_t FOLD_BITS = 0x7f;
+
+static const size_t N_BLOCKS = 0x1100;
+static const size_t BLOCK_SIZE = 256;
+static const size_t N_WORD_RANGES = sizeof(WORD_RANGES) / sizeof(*WORD_RANGES);
+static const size_t N_FOLD_RUNS = sizeof(FOLD_RUNS) / sizeof(*FOLD_RUNS);
+
+/**
+ * Number of 256 code point blocks whose entries are not all the same (they
+ * get their own row in the lookup table).
+ */
+constexpr size_t count_mixed_blocks() {
+	std::array<bool, N_BLOCKS> mixed{};
+	for (size_t i = 0; i < N_WORD_RANGES; i++) {
+		mixed[WORD_RANGES[i][0] / BLOCK_SIZE] |= WORD_RANGES[i][0] % BLOCK_SIZE;
+		mixed[WORD_RANGES[i][1] / BLOCK_SIZE] |=
+			(WORD_RANGES[i][1] + 1) % BLOCK_SIZE;
+	}
+	for (size_t i = 0; i < N_FOLD_RUNS; i++) {
+		for (uint32_t b = FOLD_RUNS[i][0] / BLOCK_SIZE;
+			 b <= FOLD_RUNS[i][1] / BLOCK_SIZE; b++) {
+			mixed[b] = true;
+		}
+	}
+	size_t n = 0;
+	for (bool m : mixed) {
+		n += m;
+	}
+	return n;
+}
+
+static constexpr size_t N_ROWS = 2 + count_mixed_blocks();
+
+/**
+ * Two stage lookup table: code point c has entry rows[blocks[c >> 8]][c & 255]
+ * (row 0 is all non-word and row 1 all word, for uniform blocks).
+ */
+struct CodePointTable {
+	std::array<uint8_t, N_BLOCKS> blocks;
+	std::array<std::array<uint8_t, BLOCK_SIZE>, N_ROWS> rows;
+};
+
+/**
+ * Expands WORD_RANGES and FOLD_RUNS into the lookup table (at compile time).
+ */
+constexpr CodePointTable build_table() {
+	CodePointTable t{};
+	std::array<bool, N_BLOCKS> mixed{}, word{};
+
+	// Classify blocks as mixed, or uniformly word / non-word
+	for (size_t i = 0; i < N_WORD_RANGES; i++) {
+		uint32_t first = WORD_RANGES[i][0], last = WORD_RANGES[i][1];
+		mixed[first / BLOCK_SIZE] |= first % BLOCK_SIZE;
+		mixed[last / BLOCK_SIZE] |= (last + 1) % BLOCK_SIZE;
+		for (uint32_t b = first / BLOCK_SIZE; b <= last / BLOCK_SIZE; b++) {
+			word[b] = true;
+		}
+	}
+	for (size_t i = 0; i < N_FOLD_RUNS; i++) {
+		for (uint32_t b = FOLD_RUNS[i][0] / BLOCK_SIZE;
+			 b <= FOLD_RUNS[i][1] / BLOCK_SIZE; b++) {
+			mixed[b] = true;
+		}
+	}
+	for (size_t j = 0; j < BLOCK_SIZE; j++) {
+		t.rows[1][j] = WORD_BIT;
+	}
+	size_t row = 2;
+	for (size_t b = 0; b < N_BLOCKS; b++) {
+		t.blocks[b] = mixed[b] ? row++ : word[b];
+	}
+
+	// Fill mixed rows
+	for (size_t i = 0; i < N_WORD_RANGES; i++) {
+		for (uint32_t c = WORD_RANGES[i][0]; c <= WORD_RANGES[i][1]; c++) {
+			if (!mixed[c / BLOCK_SIZE]) {
+				// Skip to the next block
+				c |= BLOCK_SIZE - 1;
+				continue;
+			}
+			t.rows[t.blocks[c / BLOCK_SIZE]][c % BLOCK_SIZE] |= WORD_BIT;
+		}
+	}
+	for (size_t i = 0; i < N_FOLD_RUNS; i++) {
+		for (uint32_t c = FOLD_RUNS[i][0]; c <= FOLD_RUNS[i][1];
+			 c += FOLD_RUNS[i][2]) {
+			t.rows[t.blocks[c / BLOCK_SIZE]][c % BLOCK_SIZE] |=
+				1 + FOLD_RUNS[i][3];
+		}
+	}
+	return t;
+}
+
+static constexpr CodePointTable TABLE = build_table();
+
+/**
+ * Looks up the table entry of a code point.
+ */
+static inline uint8_t lookup(uint32_t cp) {
+	if (cp >= N_BLOCKS * BLOCK_SIZE) {
+		return 0;
+	}
+	return TABLE.rows[TABLE.blocks[cp / BLOCK_SIZE]][cp % BLOCK_SIZE];
+}
+
+/**
+ * Whether an ASCII character is a word character (without branching).
+ */
+static inline bool is_ascii_word(unsigned char c) {
+	return (ASCII_WORD[c >> 6] >> (c & 63)) & 1;
+}
+
+/**
+ * Decodes the code point starting at p.
+ * @param p start of the code point
+ * @param end end of the string
+ * @param cp decoded code point
+ * @return number of bytes of the code point (0 if it is not valid UTF-8)
+ */
+static inline size_t decode(const unsigned char* p, const unsigned char* end,
+							uint32_t& cp) {
+	uint32_t state = UTF8_ACCEPT;
+	cp = 0;
+	for (const unsigned char* q = p; q < end; q++) {
+		uint32_t type = UTF8D[*q];
+		cp = (state != UTF8_ACCEPT) ? (*q & 0x3fu) | (cp << 6)
+									: (0xffu >> type) & *q;
+		state = UTF8D[256 + state + type];
+		if (state == UTF8_ACCEPT) {
+			return q - p + 1;
+		}
+		if (state == UTF8_REJECT) {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Encodes a code point as UTF-8.
+ * @return number of bytes written to dst
+ */
+static inline size_t encode(uint32_t cp, char* dst) {
+	if (cp < 0x80) {
+		dst[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		dst[0] = (char)(0xc0 | (cp >> 6));
+		dst[1] = (char)(0x80 | (cp & 0x3f));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		dst[0] = (char)(0xe0 | (cp >> 12));
+		dst[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		dst[2] = (char)(0x80 | (cp & 0x3f));
+		return 3;
+	}
+	dst[0] = (char)(0xf0 | (cp >> 18));
+	dst[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+	dst[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+	dst[3] = (char)(0x80 | (cp & 0x3f));
+	return 4;
+}
+
+/**
+ * Whether a code point is a word character (letter, mark, number or
+ * connector punctuation).
+ * @param cp code point
+ * @return whether cp is a word character
+ */
+bool is_word_code_point(uint32_t cp) {
+	return lookup(cp) & WORD_BIT;
+}
+
+/**
+ * Simple case folding of a code point (single code point to single code
+ * point, e.g. 'É' -> 'é', 'Σ' and 'ς' -> 'σ').
+ * @param cp code point
+ * @return folded code point
+ */
+uint32_t fold_code_point(uint32_t cp) {
+	uint8_t fold = lookup(cp) & FOLD_BITS;
+	return fold ? cp + FOLD_DELTAS[fold - 1] : cp;
+}
+
+/**
+ * Number of bytes of the run of word characters at the start of a UTF-8
+ * string. ASCII is classified 16 bytes at a time, other characters are
+ * decoded and looked up.
+ * @param text UTF-8 string, e.g.: "Café au lait"
+ * @param length number of bytes in text
+ * @return number of bytes in the run, e.g.: 5 ("Café")
+ */
+size_t word_run_length(const char* text, size_t length) {
+	const unsigned char* p = (const unsigned char*)text;
+	const unsigned char* end = p + length;
+	while (p < end) {
+#if defined(__SSE2__)
+		if (end - p >= 16) {
+			// Word characters: (x | 0x20) in a-z, 0-9 or _
+			__m128i x = _mm_loadu_si128((const __m128i*)p);
+			__m128i l = _mm_or_si128(x, _mm_set1_epi8(0x20));
+			__m128i w = _mm_or_si128(
+				_mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+							  _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1))),
+				_mm_or_si128(
+					_mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)),
+								  _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1))),
+					_mm_cmpeq_epi8(x, _mm_set1_epi8('_'))));
+			unsigned words = (unsigned)_mm_movemask_epi8(w);
+			if (words == 0xffff) {
+				p += 16;
+				continue;
+			}
+			p += __builtin_ctz(~words);
+		}
+#endif
+		// ASCII run
+		while (p < end && *p < 0x80 && is_ascii_word(*p)) {
+			p++;
+		}
+		if (p == end || *p < 0x80) {
+			break;
+		}
+
+		// Other characters
+		uint32_t cp;
+		size_t n = decode(p, end, cp);
+		if (n == 0 || !is_word_code_point(cp)) {
+			break;
+		}
+		p += n;
+	}
+	return (const char*)p - text;
+}
+
+/**
+ * Case folds a UTF-8 string into dst (bytes that are not valid UTF-8 are
+ * copied as they are).
+ * @param src UTF-8 string, e.g.: "#CAFÉ"
+ * @param length number of bytes in src
+ * @param dst where the folded string is written, e.g.: "#café" (folding can
+ * make a string longer, there must be room for 2 * length bytes)
+ * @return number of bytes written to dst
+ */
+size_t fold_utf8(const char* src, size_t length, char* dst) {
+	const unsigned char* p = (const unsigned char*)src;
+	const unsigned char* end = p + length;
+	char* out = dst;
+	while (p < end) {
+		if (*p < 0x80) {
+			unsigned char c = *p++;
+			*out++ = (char)(c + (((unsigned)(c - 'A') < 26) << 5));
+			continue;
+		}
+		uint32_t cp;
+		size_t n = decode(p, end, cp);
+		if (n == 0) {
+			*out++ = (char)*p++;
+			continue;
+		}
+		out += encode(fold_code_point(cp), out);
+		p += n;
+	}
+	return out - dst;
+}
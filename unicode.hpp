@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Whether a code point is a word character (letter, mark, number or
+ * connector punctuation).
+ */
+bool is_word_code_point(uint32_t cp);
+
+/**
+ * Simple case folding of a code point.
+ */
+uint32_t fold_code_point(uint32_t cp);
+
+/**
+ * Number of bytes of the run of word characters at the start of a UTF-8
+ * string.
+ */
+size_t word_run_length(const char* text, size_t length);
+
+/**
+ * Case folds a UTF-8 string into dst and returns the length of the result.
+ */
+size_t fold_utf8(const char* src, size_t length, char* dst);